@@ -0,0 +1,97 @@
+//
+//  index_bench.cc
+//  PROJECT index_bench
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+#include "indexer.h"
+
+// usage: index_bench [key_num] [thread_num] [scan_len]
+using Clock = std::chrono::steady_clock;
+
+template <typename Func>
+static double runThreads(uint32_t threadNum, Func func) {
+  std::vector<std::thread> threads;
+  auto start = Clock::now();
+  for (uint32_t t = 0; t < threadNum; t++) threads.emplace_back(func, t);
+  for (auto &thread : threads) thread.join();
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void benchIndex(NKV::IndexType type, const std::string &name,
+                       const std::vector<uint64_t> &keys, uint32_t threadNum,
+                       uint32_t scanLen) {
+  NKV::IndexerT indexer(type);
+  uint64_t keyNum = keys.size();
+  uint64_t perThread = keyNum / threadNum;
+
+  double insertSecs = runThreads(threadNum, [&](uint32_t t) {
+    for (uint64_t i = t * perThread; i < (t + 1) * perThread; i++) {
+      indexer.insert({keys[i], NKV::ValuePtr(NKV::PmemAddress(i))});
+    }
+  });
+
+  std::atomic<uint64_t> found{0};
+  double getSecs = runThreads(threadNum, [&](uint32_t t) {
+    std::mt19937_64 rng(t);
+    uint64_t hits = 0;
+    for (uint64_t i = 0; i < perThread; i++) {
+      auto iter = indexer.find(keys[rng() % keyNum]);
+      if (iter != indexer.end()) hits++;
+    }
+    found.fetch_add(hits);
+  });
+
+  std::atomic<uint64_t> scanned{0};
+  uint64_t scanOps = perThread / std::max<uint32_t>(scanLen / 8, 1);
+  // a hash-only index has no order to scan
+  if (!indexer.isOrdered()) scanOps = 0;
+  double scanSecs = runThreads(threadNum, [&](uint32_t t) {
+    std::mt19937_64 rng(t + threadNum);
+    uint64_t rows = 0;
+    for (uint64_t i = 0; i < scanOps; i++) {
+      auto iter = indexer.upper_bound(keys[rng() % keyNum]);
+      for (uint32_t j = 0; j < scanLen && iter != indexer.end(); j++, iter++)
+        rows++;
+    }
+    scanned.fetch_add(rows);
+  });
+
+  uint64_t totalOps = perThread * threadNum;
+  std::cout << fmt::format(
+                   "{:8}: insert {:.3f} Mops/s, get {:.3f} Mops/s (found {}), "
+                   "scan{} {:.3f} Mops/s ({} rows)",
+                   name, totalOps / insertSecs / 1e6, totalOps / getSecs / 1e6,
+                   found.load(), scanLen,
+                   scanOps * threadNum / scanSecs / 1e6, scanned.load())
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  uint64_t keyNum = argc > 1 ? std::stoull(argv[1]) : 1000000;
+  uint32_t threadNum = argc > 2 ? std::stoul(argv[2]) : 4;
+  uint32_t scanLen = argc > 3 ? std::stoul(argv[3]) : 100;
+
+  std::vector<uint64_t> keys(keyNum);
+  for (uint64_t i = 0; i < keyNum; i++) keys[i] = i * 2 + 1;
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(42));
+  std::cout << fmt::format("keys: {}, threads: {}", keyNum, threadNum)
+            << std::endl;
+
+  benchIndex(NKV::IndexType::SKIPLIST, "skiplist", keys, threadNum, scanLen);
+  benchIndex(NKV::IndexType::BTREE, "btree", keys, threadNum, scanLen);
+  benchIndex(NKV::IndexType::HASH, "hash", keys, threadNum, scanLen);
+  benchIndex(NKV::IndexType::HYBRID, "hybrid", keys, threadNum, scanLen);
+  return 0;
+}
@@ -4,33 +4,30 @@
 //  Created by zhenliu on 23/08/2023.
 //  Copyright (c) 2023 zhenliu <liuzhenm@mail.ustc.edu.cn>.
 //
-#include <oneapi/tbb/concurrent_map.h>
 #include <oneapi/tbb/concurrent_queue.h>
 #include <oneapi/tbb/concurrent_set.h>
 #include <oneapi/tbb/concurrent_vector.h>
 #include "field_type.h"
+#include "indexer.h"
 #include "kv_type.h"
 #include "schema.h"
 
 namespace NKV {
 
-using IndexerT =
-    oneapi::tbb::concurrent_map<decltype(Key::primaryKey), ValuePtr>;
-using IndexerList = std::unordered_map<SchemaId, std::shared_ptr<IndexerT>>;
-using IndexerIterator = IndexerT::iterator;
-
 // async buffer entry
 struct AsyncBufferEntry {
   uint32_t _entry_size = 0;
-  TimeStamp _oldTS;
+  ValuePtr::State _oldState;
   TimeStamp _newTS;
   IndexerIterator _iter;
+  // to check that _iter is still in the index before using it
+  uint64_t _primaryKey = 0;
   std::atomic_bool _entryReady{false};
   Value _entry_content;
 
   AsyncBufferEntry(uint32_t entry_size);
-  bool copyContent(TimeStamp oldTS, TimeStamp newTS, IndexerIterator iter,
-                   const Value &src);
+  bool copyContent(ValuePtr::State oldState, TimeStamp newTS,
+                   IndexerIterator iter, const Value &src);
 
   inline bool getContentReady() {
     return _entryReady.load(std::memory_order_acquire);
@@ -57,8 +54,8 @@ class AsyncBufferQueue {
                    uint32_t queue_size);
   SchemaId getSchemaId();
 
-  bool EnqueueOneEntry(TimeStamp oldTS, TimeStamp newTS, IndexerIterator iter,
-                       const Value &value);
+  bool EnqueueOneEntry(ValuePtr::State oldState, TimeStamp newTS,
+                       IndexerIterator iter, const Value &value);
   std::shared_ptr<AsyncBufferEntry> DequeueOneEntry();
   bool Empty();
 };
@@ -0,0 +1,114 @@
+//
+//  async_kv.h
+//  PROJECT async_kv
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <oneapi/tbb/concurrent_queue.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "kv_type.h"
+
+namespace NKV {
+
+class NeoPMKV;
+class AsyncCompletionQueue;
+
+enum class AsyncOp : uint8_t { GET, PUT, PARTIAL_UPDATE, STOP };
+
+struct AsyncRequest {
+  AsyncOp op = AsyncOp::STOP;
+  Key key{0, 0};
+  // the row of a PUT, the new field value of a PARTIAL_UPDATE
+  std::vector<Value> fields;
+  uint32_t fieldId = 0;
+  uint64_t userData = 0;
+  AsyncCompletionQueue *cq = nullptr;
+};
+
+struct AsyncCompletion {
+  uint64_t userData = 0;
+  AsyncOp op = AsyncOp::STOP;
+  bool status = false;
+  // the row read by a GET
+  Value value;
+};
+
+// Where the workers post the results of the requests submitted with it. One
+// per event loop is the intended use, so that a thread reaps only its own
+// completions.
+class AsyncCompletionQueue {
+ public:
+  // move up to maxCount completions into out, without blocking
+  uint32_t poll(std::vector<AsyncCompletion> &out, uint32_t maxCount = 64);
+  // like poll, but wait up to timeout until minCount are there
+  uint32_t wait(std::vector<AsyncCompletion> &out, uint32_t minCount,
+                uint32_t maxCount = 64,
+                std::chrono::milliseconds timeout = std::chrono::seconds(5));
+
+  // submitted and not yet reaped
+  uint64_t inflight() const { return _inflight.load(); }
+
+ private:
+  friend class AsyncKV;
+
+  void _post(AsyncCompletion &&completion);
+
+  oneapi::tbb::concurrent_queue<AsyncCompletion> _done;
+  std::atomic<uint64_t> _inflight{0};
+  // posted and not yet reaped
+  std::atomic<uint64_t> _ready{0};
+  // posting only takes the lock when someone waits
+  std::atomic<uint32_t> _waiters{0};
+  std::mutex _waitLock;
+  std::condition_variable _waitCond;
+};
+
+// Submit/poll front end of a NeoPMKV. Requests go to the ring of the worker
+// their key hashes to, so the requests of one key run in submission order.
+// Each worker is pinned to a core and drains its ring in batches, running a
+// run of GETs as one MultiGet. Has to be destroyed before the NeoPMKV.
+class AsyncKV {
+ public:
+  AsyncKV(NeoPMKV *kv, uint32_t workerNum = std::thread::hardware_concurrency(),
+          uint32_t ringSize = 1024);
+  ~AsyncKV();
+  AsyncKV(const AsyncKV &) = delete;
+  AsyncKV &operator=(const AsyncKV &) = delete;
+
+  // false without a completion if the worker's ring is full
+  bool SubmitGet(const Key &key, AsyncCompletionQueue &cq, uint64_t userData);
+  bool SubmitPut(const Key &key, const std::vector<Value> &fieldList,
+                 AsyncCompletionQueue &cq, uint64_t userData);
+  bool SubmitPartialUpdate(const Key &key, const Value &fieldValue,
+                           uint32_t fieldId, AsyncCompletionQueue &cq,
+                           uint64_t userData);
+
+  uint32_t getWorkerNum() const { return _rings.size(); }
+
+  // requests a worker takes off its ring at most at once
+  static constexpr uint32_t WORKER_BATCH = 32;
+
+ private:
+  using Ring = oneapi::tbb::concurrent_bounded_queue<AsyncRequest>;
+
+  bool _submit(AsyncRequest &&request);
+  void _workerLoop(uint32_t workerId);
+  void _runBatch(std::vector<AsyncRequest> &batch);
+  void _runGets(std::vector<AsyncRequest> &batch, size_t begin, size_t end);
+
+  NeoPMKV *_kv;
+  std::vector<std::unique_ptr<Ring>> _rings;
+  std::vector<std::thread> _workers;
+};
+
+}  // namespace NKV
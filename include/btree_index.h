@@ -0,0 +1,144 @@
+//
+//  btree_index.h
+//  PROJECT btree_index
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "kv_type.h"
+
+namespace NKV {
+
+// the entries are allocated on the heap and never move, so a ValuePtr can be
+// referenced from outside the index (PBRB row headers, async buffer entries)
+using IndexEntry = std::pair<const uint64_t, ValuePtr>;
+
+// Concurrent B+tree with optimistic lock coupling: readers never write shared
+// memory, they validate node versions and restart on conflicts; writers lock
+// only the nodes they modify. Nodes are 512B and cache line aligned, leaves
+// are linked to their right sibling for scans. Nodes are never merged.
+// Growing keys (timestamps, sequence ids) are appended to the rightmost leaf
+// without a descent from the root.
+class BTreeIndex {
+ public:
+  // version word: bit 0 obsolete, bit 1 locked, the rest counts writes
+  struct OptLock {
+    std::atomic<uint64_t> typeVersionLockObsolete{0b100};
+
+    static bool isLocked(uint64_t version) { return (version & 0b10) != 0; }
+    static bool isObsolete(uint64_t version) { return (version & 1) != 0; }
+
+    uint64_t readLockOrRestart(bool &needRestart) const;
+    void checkOrRestart(uint64_t startRead, bool &needRestart) const {
+      readUnlockOrRestart(startRead, needRestart);
+    }
+    void readUnlockOrRestart(uint64_t startRead, bool &needRestart) const {
+      needRestart = (startRead != typeVersionLockObsolete.load());
+    }
+    void upgradeToWriteLockOrRestart(uint64_t &version, bool &needRestart);
+    void writeUnlock() { typeVersionLockObsolete.fetch_add(0b10); }
+  };
+
+  enum class NodeType : uint8_t { INNER = 1, LEAF = 2 };
+
+  struct NodeBase : public OptLock {
+    NodeType type;
+    uint16_t count = 0;
+  };
+
+  struct alignas(64) LeafNode : public NodeBase {
+    static constexpr uint16_t MAX_ENTRIES = 30;
+    uint64_t keys[MAX_ENTRIES];
+    IndexEntry *payloads[MAX_ENTRIES];
+    LeafNode *next = nullptr;
+
+    LeafNode() { type = NodeType::LEAF; }
+    bool isFull() const { return count == MAX_ENTRIES; }
+    // first position whose key is >= key
+    uint16_t lowerBound(uint64_t key) const;
+    void insert(uint16_t pos, IndexEntry *entry);
+    void erase(uint16_t pos);
+    // an append split of the rightmost leaf leaves it full and starts an
+    // empty one, so that leaves filled by growing keys stay full
+    LeafNode *split(uint64_t &sep, bool append = false);
+  };
+
+  struct alignas(64) InnerNode : public NodeBase {
+    static constexpr uint16_t MAX_ENTRIES = 31;
+    // children[i] holds the keys <= keys[i], children[count] the rest
+    uint64_t keys[MAX_ENTRIES];
+    NodeBase *children[MAX_ENTRIES];
+
+    InnerNode() { type = NodeType::INNER; }
+    bool isFull() const { return count == MAX_ENTRIES - 1; }
+    uint16_t lowerBound(uint64_t key) const;
+    void insert(uint64_t key, NodeBase *child);
+    InnerNode *split(uint64_t &sep);
+  };
+
+  // position of a scan, stays usable across concurrent changes of its leaf;
+  // a cursor with only key set is positioned on the first next()
+  struct Cursor {
+    LeafNode *leaf = nullptr;
+    uint16_t pos = 0;
+    uint64_t version = 0;
+    uint64_t key = 0;
+    IndexEntry *entry = nullptr;
+  };
+
+  BTreeIndex();
+  ~BTreeIndex();
+  BTreeIndex(const BTreeIndex &) = delete;
+  BTreeIndex &operator=(const BTreeIndex &) = delete;
+
+  IndexEntry *lookup(uint64_t key) const;
+  // insert the entry if the key is absent, returns the entry of the key
+  std::pair<IndexEntry *, bool> insert(IndexEntry *entry);
+  // unlink the entry of key (only if it is expected, when given), the
+  // caller owns it afterwards
+  IndexEntry *erase(uint64_t key, IndexEntry *expected = nullptr);
+
+  // position on the first entry with a key >= key (> key if exclusive),
+  // false if there is none
+  bool seek(uint64_t key, bool exclusive, Cursor &cursor) const;
+  bool seekFirst(Cursor &cursor) const { return seek(0, false, cursor); }
+  // move to the following entry, false once the scan is past the last key
+  bool next(Cursor &cursor) const;
+
+  // up to parts - 1 keys, in order, that cut the tree into ranges of about
+  // the same number of leaves; taken from the top two inner levels
+  void splitKeys(uint32_t parts, std::vector<uint64_t> &keys) const;
+
+  size_t size() const { return _size.load(std::memory_order_relaxed); }
+
+ private:
+  void _makeRoot(uint64_t sep, NodeBase *left, NodeBase *right);
+  // descend to the leaf of key with optimistic lock coupling
+  LeafNode *_findLeaf(uint64_t key, uint64_t &version, bool &needRestart) const;
+  // position on the first entry from leaf[pos] on, walking the siblings;
+  // false if a leaf changed after version was read
+  bool _scanFrom(LeafNode *leaf, uint64_t version, uint16_t pos,
+                 Cursor &cursor) const;
+  void _freeNode(NodeBase *node);
+  // insert past the last key straight into the rightmost leaf, false if the
+  // key is not past it or the leaf is full
+  bool _appendToTail(IndexEntry *entry);
+  // whether key is certainly past the last key of the tree
+  bool _pastTail(uint64_t key) const;
+
+  std::atomic<NodeBase *> _root;
+  std::atomic<size_t> _size{0};
+  // the rightmost leaf as last seen by an insert; only a hint, whoever uses
+  // it checks that it has no right sibling. Apart from _root and _size,
+  // which every insert of other keys touches as well
+  alignas(64) std::atomic<LeafNode *> _tailLeaf{nullptr};
+};
+
+}  // namespace NKV
@@ -11,6 +11,7 @@
 #include <oneapi/tbb/concurrent_queue.h>
 #include <atomic>
 #include <list>
+#include <mutex>
 #include "buffer_page.h"
 #include "schema.h"
 
@@ -32,9 +33,11 @@ class BufferListBySchema {
   std::atomic<uint32_t> curRowNum;
 
   SchemaUMap *sUMap = nullptr;
-  // manage the buffer list
-  BufferPage *headPage = nullptr;
-  BufferPage *tailPage = nullptr;
+  // manage the buffer list, a stack new pages are pushed onto lock-free.
+  // Only unlinking a sealed page takes the lock, so that a page has a single
+  // unlinker; writers walk the list and claim rows without it
+  std::atomic<BufferPage *> headPage{nullptr};
+  std::mutex unlinkLock;
 
  public:
   // return occupancy Ratio
@@ -50,7 +53,8 @@ class BufferListBySchema {
       return 0;
   }
 
-  BufferPage *getHeadPage() { return headPage; }
+  BufferPage *getHeadPage() { return headPage.load(); }
+  uint32_t getPageNum() { return curPageNum.load(); }
 
   BufferListBySchema() {}
 
@@ -61,7 +65,6 @@ class BufferListBySchema {
                      SchemaUMap *sUMapPtr, BufferPage *headPagePtr) {
     sUMap = sUMapPtr;
     headPage = headPagePtr;
-    tailPage = headPagePtr;
     curRowNum = 0;
     curPageNum = 0;
     setInfo(schemaId, pageSize, pageHeaderSize, rowHeaderSize);
@@ -69,6 +72,9 @@ class BufferListBySchema {
   void setOccuBitmapSize(uint32_t pageSize);
   void setInfo(SchemaId schemaId, uint32_t pageSize, uint32_t pageHeaderSize,
                uint32_t rowHeaderSize);
+  void pushPage(BufferPage *pagePtr);
+  // take a sealed page out of the list, it is no longer live afterwards
+  void unlinkPage(BufferPage *pagePtr);
   bool reclaimPage(
       oneapi::tbb::concurrent_bounded_queue<BufferPage *> &freePageList,
       BufferPage *pagePtr);
@@ -8,6 +8,7 @@
 
 #pragma once
 #include <assert.h>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
@@ -23,6 +24,10 @@ namespace NKV {
 constexpr int pageSize = 4 * 1024;  // 4KB
 
 const long long mask = 0x0000000000000FFF;  // 0x0000000000000FFF;
+// magic of a page linked into a schema list
+constexpr uint16_t livePageMagic = 0x1010;
+// hot rows number of an emptied page that no row may be claimed in any more
+constexpr uint32_t sealedPageRows = 1u << 31;
 
 using RowOffset = uint32_t;
 using CRC32 = uint32_t;
@@ -33,18 +38,21 @@ struct OccupancyBitmap {
   unsigned char bitmap[16];
 } __attribute__((packed));
 
+// the fields updated by concurrent writers are naturally aligned
 struct PageHeader {
   uint16_t magic = 0;                 // 0 (2)
-  uint32_t schemaId = 0;              // 2 (4)
-  uint32_t howRowNum = 0;             // 6 (4)
-  BufferPage *prevPagePtr = nullptr;  // 10 (8)
-  BufferPage *nextpagePtr = nullptr;  // 18 (8)
-  OccupancyBitmap occupancyBitmap;    // 26 (16)
-  char reserved[22] = {'\0'};         // 42 (22)
+  uint16_t padding = 0;               // 2 (2)
+  uint32_t schemaId = 0;              // 4 (4)
+  uint32_t howRowNum = 0;             // 8 (4)
+  uint32_t padding2 = 0;              // 12 (4)
+  BufferPage *prevPagePtr = nullptr;  // 16 (8)
+  BufferPage *nextpagePtr = nullptr;  // 24 (8)
+  OccupancyBitmap occupancyBitmap;    // 32 (16)
+  char reserved[16] = {'\0'};         // 48 (16)
 } __attribute__((packed));
 
 struct RowHeader {                    // size 24
-  char CRC[4];
+  uint32_t seq;
   TimeStamp timestamp;
   PmemAddress pmemAddr;
   ValuePtr *kvNodeAddr;
@@ -67,13 +75,15 @@ class BufferPage {
   }
   // get (magic, 0, 2)
   inline uint16_t getMagicPage() { return ((PageHeader *)content)->magic; }
+  // a page unlinked from its list keeps magic 0 until it is initialized again
+  inline bool isLivePage() { return getMagicPage() == livePageMagic; }
 
-  // set (schemaID, 2, 4)
+  // set (schemaID, 4, 4)
   inline void setSchemaIDPage(uint32_t schemaID) {
     ((PageHeader *)content)->schemaId = schemaID;
   }
 
-  // get (schemaID, 2, 4)
+  // get (schemaID, 4, 4)
   inline SchemaId getSchemaIDPage() {
     return ((PageHeader *)content)->schemaId;
   }
@@ -88,28 +98,38 @@ class BufferPage {
     return ((PageHeader *)content)->prevPagePtr;
   }
 
-  // set (nextPagePtr, 16, 8)
+  // set (nextPagePtr, 24, 8), walked by writers while pages are pushed
   inline void setNextPage(BufferPage *nextPagePtr) {
-    ((PageHeader *)content)->nextpagePtr = nextPagePtr;
+    __atomic_store_n(nextPageField(), nextPagePtr, __ATOMIC_RELEASE);
   }
 
-  // get (nextPagePtr, 16, 8)
+  // get (nextPagePtr, 24, 8)
   inline BufferPage *getNextPage() {
-    return ((PageHeader *)content)->nextpagePtr;
+    return __atomic_load_n(nextPageField(), __ATOMIC_ACQUIRE);
   }
 
-  // set (hotRowsNum, 24, 2)
+  // set (hotRowsNum, 8, 4)
   inline void setHotRowsNumPage(uint32_t hotRowsNum) {
-    ((PageHeader *)content)->howRowNum = hotRowsNum;
+    __atomic_store_n(hotRowsField(), hotRowsNum, __ATOMIC_RELAXED);
   }
 
-  // set (hotRowsNum, 24, 2)
+  // get (hotRowsNum, 8, 4), counts the rows claimed and being claimed
   inline uint32_t getHotRowsNumPage() {
-    return ((PageHeader *)content)->howRowNum;
+    return __atomic_load_n(hotRowsField(), __ATOMIC_RELAXED);
   }
 
-  inline void setReservedHeader() {  // reserved is 22 bytes
-    memset(((PageHeader *)content)->reserved, 0, 22);
+  inline void setReservedHeader() {  // reserved is 16 bytes
+    memset(((PageHeader *)content)->reserved, 0, 16);
+  }
+
+  inline BufferPage **nextPageField() {
+    return (BufferPage **)(content + offsetof(PageHeader, nextpagePtr));
+  }
+  inline uint32_t *hotRowsField() {
+    return (uint32_t *)(content + offsetof(PageHeader, howRowNum));
+  }
+  inline unsigned char *bitmapByte(RowOffset rowOffset) {
+    return content + offsetof(PageHeader, occupancyBitmap) + rowOffset / 8;
   }
 
   inline void clearPageBitMap(uint32_t occuBitmapSize) {
@@ -119,10 +139,26 @@ class BufferPage {
   // 1.2 Row get & set functions.
 
   // Row Struct:
-  // CRC (4) | Timestamp (8) | PlogAddr (8) | KVNodeAddr(8)
+  // Seq (4) | Timestamp (8) | PlogAddr (8) | KVNodeAddr(8)
 
-  inline uint32_t getCRCRow();
-  inline void setCRCRow();
+  // Seq: (RowAddr + 0, 4), a seqlock over the row, odd while it is written
+  // or dropped. Readers take it before copying the row and check it after
+  inline uint32_t getSeqRow(RowAddr rAddr) {
+    return __atomic_load_n((uint32_t *)rAddr, __ATOMIC_ACQUIRE);
+  }
+  inline void beginWriteRow(RowAddr rAddr) {
+    __atomic_fetch_or((uint32_t *)rAddr, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+  }
+  inline void endWriteRow(RowAddr rAddr) {
+    __atomic_fetch_add((uint32_t *)rAddr, 1, __ATOMIC_RELEASE);
+  }
+  // whether the row read since seq was taken is unchanged
+  inline bool validateSeqRow(RowAddr rAddr, uint32_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (seq & 1) == 0 &&
+           __atomic_load_n((uint32_t *)rAddr, __ATOMIC_RELAXED) == seq;
+  }
 
   // Timestamp: (RowAddr + 4, 8)
   inline TimeStamp getTimestampRow(RowAddr rAddr) {
@@ -191,11 +227,19 @@ class BufferPage {
 
   // a bit for a row, page size = 64KB, row size = 128B, there are at most 512
   // rows, so 512 bits=64 Bytes is sufficient
+  // all bitmap updates are atomic, so rows of a page are claimed and
+  // released by many writers without a lock
   bool setRowBitMapPage(RowOffset rowOffset);
 
   bool clearRowBitMapPage(RowOffset rowOffset);
   bool isBitmapSet(RowOffset rowOffset);
 
+  // Claim an empty row, searching from hint on
+  // Output: offset [UINT32_MAX when the page is full or sealed]
+  RowOffset claimRow(uint32_t maxRowNumOfPage, RowOffset hint = 0);
+  // Seal an empty page, only the sealing caller may unlink it
+  bool sealPage();
+
   // Return the idx of first slot (0) in Bitmap
   // Input: bitmapSize (byte)
   // Output: offset [Position of first 0 in bitmap, UINT32_MAX represent no
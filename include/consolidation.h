@@ -0,0 +1,118 @@
+//
+//  consolidation.h
+//  PROJECT consolidation
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "kv_type.h"
+
+namespace NKV {
+
+// partial chains longer than this are merged into a full row
+const uint8_t PARTIAL_CHAIN_MERGE_THRESHOLD = 3;
+// writers merge inline once the background worker falls this far behind
+const uint8_t PARTIAL_CHAIN_HARD_LIMIT = 32;
+
+struct ChainCandidate {
+  SchemaId schemaId;
+  uint64_t primaryKey;
+  uint64_t readCount;
+};
+
+// Keys whose partial chain grew past the merge threshold, with the number of
+// reads that had to walk the chain since. Sharded by key to keep the write
+// and read paths off a single lock.
+class ChainTracker {
+ public:
+  ChainTracker(uint32_t shardNum = 64) : _shards(shardNum) {}
+
+  void addCandidate(SchemaId sid, uint64_t primaryKey);
+
+  // only counted for keys that are already candidates
+  void recordRead(SchemaId sid, uint64_t primaryKey);
+
+  // remove and return up to maxCount candidates with the most reads
+  void popHottest(uint32_t maxCount, std::vector<ChainCandidate> &candidates);
+
+  size_t size();
+
+ private:
+  using CandidateKey = std::pair<SchemaId, uint64_t>;
+  struct CandidateHash {
+    size_t operator()(const CandidateKey &key) const {
+      return std::hash<uint64_t>()(key.second) ^ ((size_t)key.first << 48);
+    }
+  };
+  struct Shard {
+    std::mutex lock;
+    std::unordered_map<CandidateKey, uint64_t, CandidateHash> readCounts;
+  };
+
+  Shard &_shardOf(const CandidateKey &key) {
+    return _shards[CandidateHash()(key) % _shards.size()];
+  }
+
+  std::vector<Shard> _shards;
+};
+
+// Picks the chain length of a schema at which partial rows get merged.
+// Merging after T links costs C_merge / T per partial write, while a read
+// walks T / 2 links on average at c_link each, so the total cost is the
+// smallest at T* = sqrt(2 * W * C_merge / (R * c_link)) for W partial writes
+// and R chain reads. The samples decay by half every window of writes.
+class AdaptiveChainThreshold {
+ public:
+  AdaptiveChainThreshold(uint64_t window = 4096) : _window(window) {}
+
+  void recordPartialWrite() {
+    _windowWrites.fetch_add(1, std::memory_order_relaxed);
+    if (_partialWrites.fetch_add(1, std::memory_order_relaxed) % _window ==
+        _window - 1)
+      _retune();
+  }
+  void recordChainRead(uint32_t links, uint64_t nanos) {
+    _chainReads.fetch_add(1, std::memory_order_relaxed);
+    _linksWalked.fetch_add(links, std::memory_order_relaxed);
+    _walkNanos.fetch_add(nanos, std::memory_order_relaxed);
+  }
+  void recordMerge(uint64_t rows, uint64_t nanos) {
+    _merges.fetch_add(rows, std::memory_order_relaxed);
+    _mergeNanos.fetch_add(nanos, std::memory_order_relaxed);
+  }
+
+  uint8_t getThreshold() const {
+    uint8_t fixed = _override.load(std::memory_order_relaxed);
+    if (fixed != NO_OVERRIDE) return fixed;
+    return _threshold.load(std::memory_order_relaxed);
+  }
+  // pin the threshold, or go back to tuning with NO_OVERRIDE
+  void setOverride(uint8_t threshold) { _override.store(threshold); }
+
+  static const uint8_t NO_OVERRIDE = UINT8_MAX;
+
+ private:
+  void _retune();
+
+  uint64_t _window;
+  std::atomic<uint8_t> _threshold{PARTIAL_CHAIN_MERGE_THRESHOLD};
+  std::atomic<uint8_t> _override{NO_OVERRIDE};
+
+  std::atomic<uint64_t> _partialWrites{0};
+  std::atomic<uint64_t> _chainReads{0};
+  std::atomic<uint64_t> _linksWalked{0};
+  std::atomic<uint64_t> _walkNanos{0};
+  std::atomic<uint64_t> _merges{0};
+  std::atomic<uint64_t> _mergeNanos{0};
+  std::atomic<uint64_t> _windowWrites{0};
+  std::mutex _tuneLock;
+};
+
+}  // namespace NKV
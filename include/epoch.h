@@ -0,0 +1,82 @@
+//
+//  epoch.h
+//  PROJECT epoch
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace NKV {
+
+// Epoch based reclamation. Readers announce themselves in the counter of the
+// current epoch's parity, writers retire what they unlinked into the limbo
+// list of the current epoch. The epoch only advances once no reader of the
+// previous epoch is left, and what was retired then is freed on the advance.
+// Counters are sharded by thread so that readers rarely share a cache line.
+class EpochManager {
+ public:
+  static constexpr uint32_t READER_SHARDS = 64;
+  // try to advance once this many objects wait in limbo
+  static constexpr uint32_t RECLAIM_BATCH = 64;
+
+  EpochManager() = default;
+  // frees everything still in limbo, no reader may be left
+  ~EpochManager() { drain(); }
+  EpochManager(const EpochManager &) = delete;
+  EpochManager &operator=(const EpochManager &) = delete;
+
+  // returns the epoch to pass to exit
+  uint64_t enter();
+  void exit(uint64_t epoch);
+
+  // run deleter once no reader that may still see the object is left
+  void retire(std::function<void()> deleter);
+
+  // advance the epoch if the readers allow it, returns the number freed
+  size_t tryReclaim();
+  // free everything in limbo right now, only safe without readers
+  void drain();
+
+  uint64_t getEpoch() const { return _epoch.load(); }
+  size_t pendingCount();
+
+ private:
+  struct alignas(64) ReaderCount {
+    std::atomic<int64_t> count{0};
+  };
+
+  static uint32_t _shardOfThread();
+
+  std::atomic<uint64_t> _epoch{0};
+  ReaderCount _readers[2][READER_SHARDS];
+  std::mutex _limboLock;
+  std::vector<std::function<void()>> _limbo[2];
+};
+
+// keeps the calling thread inside an epoch for its scope, no-op on nullptr
+class EpochGuard {
+ public:
+  explicit EpochGuard(EpochManager *manager) : _manager(manager) {
+    if (_manager) _epoch = _manager->enter();
+  }
+  explicit EpochGuard(EpochManager &manager) : EpochGuard(&manager) {}
+  ~EpochGuard() {
+    if (_manager) _manager->exit(_epoch);
+  }
+  EpochGuard(const EpochGuard &) = delete;
+  EpochGuard &operator=(const EpochGuard &) = delete;
+
+ private:
+  EpochManager *_manager;
+  uint64_t _epoch = 0;
+};
+
+}  // namespace NKV
@@ -0,0 +1,95 @@
+//
+//  hash_index.h
+//  PROJECT hash_index
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include "btree_index.h"
+#include "epoch.h"
+
+namespace NKV {
+
+// Concurrent open addressing hash table for point lookups. Slots are kept in
+// groups of 16 with one control byte each, holding 7 bits of the hash or the
+// empty/deleted marker, so a probe compares a whole group with one SSE2
+// instruction. Readers take no lock; writers claim slots with a CAS and only
+// hold a shared lock against a concurrent resize.
+class HashIndex {
+ public:
+  static constexpr uint32_t GROUP_SLOTS = 16;
+  static constexpr uint8_t CTRL_EMPTY = 0x80;
+  static constexpr uint8_t CTRL_DELETED = 0xFE;
+
+  struct alignas(64) Group {
+    uint8_t ctrl[GROUP_SLOTS];
+    std::atomic<IndexEntry *> slots[GROUP_SLOTS];
+  };
+
+  struct Table {
+    explicit Table(uint64_t groupNum);
+    uint64_t groupNum;
+    uint64_t groupMask;
+    // slots ever claimed, erased ones stay claimed until the next resize
+    std::atomic<uint64_t> used{0};
+    std::vector<Group> groups;
+  };
+
+  // position of an unordered walk over all entries
+  struct Cursor {
+    Table *table = nullptr;
+    uint64_t slot = 0;
+    IndexEntry *entry = nullptr;
+  };
+
+  // the entries are deleted with the table if ownEntries is set; replaced
+  // tables are retired through epochs if given, kept until destruction
+  // otherwise
+  HashIndex(bool ownEntries, EpochManager *epochs = nullptr,
+            uint64_t initGroups = 64);
+  ~HashIndex();
+  HashIndex(const HashIndex &) = delete;
+  HashIndex &operator=(const HashIndex &) = delete;
+
+  IndexEntry *lookup(uint64_t key) const;
+  // start loading the group a lookup of key probes first
+  void prefetch(uint64_t key) const;
+  // insert the entry if the key is absent, returns the entry of the key
+  std::pair<IndexEntry *, bool> insert(IndexEntry *entry);
+  // unlink the entry of key, the caller owns it afterwards
+  IndexEntry *erase(uint64_t key);
+
+  bool first(Cursor &cursor) const;
+  bool next(Cursor &cursor) const;
+
+  size_t size() const { return _size.load(std::memory_order_relaxed); }
+
+ private:
+  // marks an erased slot, so that probes go on past it
+  static IndexEntry *const TOMBSTONE;
+
+  static uint64_t _hash(uint64_t key);
+  static bool _insertInto(Table *table, IndexEntry *entry,
+                          IndexEntry *&existing);
+  void _grow(Table *oldTable);
+  bool _scanFrom(Table *table, uint64_t slot, Cursor &cursor) const;
+
+  bool _ownEntries;
+  EpochManager *_epochs;
+  std::atomic<Table *> _table;
+  std::atomic<size_t> _size{0};
+  // writers share it, a resize takes it exclusively
+  std::shared_mutex _resizeLock;
+  // replaced tables, kept until destruction for readers still probing them
+  std::vector<Table *> _retiredTables;
+};
+
+}  // namespace NKV
@@ -0,0 +1,177 @@
+//
+//  indexer.h
+//  PROJECT indexer
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <oneapi/tbb/concurrent_map.h>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "btree_index.h"
+#include "epoch.h"
+#include "hash_index.h"
+#include "kv_type.h"
+
+namespace NKV {
+
+// the index kept for the primary keys of one schema
+enum class IndexType : uint8_t {
+  // tbb::concurrent_map, a lock-free skip list
+  SKIPLIST = 0,
+  // BTreeIndex, wide nodes and optimistic readers
+  BTREE,
+  // HashIndex only, for schemas without range access: no Scan, and
+  // iteration is in no particular order
+  HASH,
+  // HashIndex for point lookups plus a BTreeIndex over the same entries
+  HYBRID,
+};
+
+// how the keys of a schema are split over independent indexes
+enum class PartitionType : uint8_t {
+  // consecutive key ranges, iterated one after the other
+  RANGE = 0,
+  // by a hash of the key, so that growing keys go to all partitions; ordered
+  // iteration merges them, which seeks every partition per step
+  HASH,
+};
+
+struct IndexPartitioning {
+  PartitionType type = PartitionType::RANGE;
+  // RANGE: the first key of every partition but the first, ascending
+  std::vector<uint64_t> rangeStarts;
+  // HASH: the number of partitions
+  uint32_t hashParts = 1;
+
+  uint32_t partNum() const {
+    if (type == PartitionType::HASH) return std::max<uint32_t>(hashParts, 1);
+    return rangeStarts.size() + 1;
+  }
+};
+
+// Primary key index with the subset of the tbb::concurrent_map interface
+// that the engine uses. Entries never move while they are in the index, so
+// iterators and references to the ValuePtr stay valid until they are erased;
+// with an EpochManager, until the last reader in an EpochGuard left.
+class IndexerT {
+ public:
+  using value_type = IndexEntry;
+  using SkipListT = oneapi::tbb::concurrent_map<uint64_t, ValuePtr>;
+
+  class iterator {
+   public:
+    iterator() = default;
+
+    value_type &operator*() const { return *_entry; }
+    value_type *operator->() const { return _entry; }
+    iterator &operator++();
+    iterator operator++(int) {
+      iterator old = *this;
+      ++*this;
+      return old;
+    }
+    bool operator==(const iterator &other) const {
+      return _entry == other._entry;
+    }
+    bool operator!=(const iterator &other) const {
+      return _entry != other._entry;
+    }
+
+   private:
+    friend class IndexerT;
+    void _advance();
+    // move past entries that were removed but not unlinked yet
+    void _skipRemoved();
+
+    // the index of the backend cursors below, a partition if partitioned
+    const IndexerT *_owner = nullptr;
+    // the partitioned index the iterator came from and its partition
+    const IndexerT *_router = nullptr;
+    uint32_t _part = 0;
+    value_type *_entry = nullptr;
+    SkipListT::iterator _skipIter;
+    BTreeIndex::Cursor _cursor;
+    HashIndex::Cursor _hashCursor;
+  };
+
+  // erased entries are freed through epochs if given, right away otherwise;
+  // each partition is an index of type of its own
+  IndexerT(IndexType type = IndexType::SKIPLIST,
+           EpochManager *epochs = nullptr,
+           const IndexPartitioning &partitioning = IndexPartitioning());
+  IndexType getType() const { return _type; }
+  EpochManager *getEpochManager() const { return _epochs; }
+  // whether begin() walks the keys in order and the bounds are supported
+  bool isOrdered() const { return _type != IndexType::HASH; }
+  uint32_t getPartitionNum() const {
+    return std::max<size_t>(_parts.size(), 1);
+  }
+
+  iterator begin();
+  iterator end() { return iterator(); }
+  iterator find(uint64_t key);
+  // start loading what a find of key touches first, so that the misses of
+  // several keys overlap; only the hash backends know where to look
+  void prefetch(uint64_t key) const {
+    if (!_parts.empty()) return _parts[_partOf(key)]->prefetch(key);
+    if (_hash) _hash->prefetch(key);
+  }
+  // the first entry with a key >= key, end() if not ordered
+  iterator lower_bound(uint64_t key);
+  // the first entry with a key > key, end() if not ordered
+  iterator upper_bound(uint64_t key);
+  // keys in order that cut the index into about parts ranges of similar
+  // size, empty if the backend cannot tell without walking it; the ends of
+  // range partitions are always among them
+  void splitKeys(uint32_t parts, std::vector<uint64_t> &keys) const;
+  // insert if the key is absent, otherwise return the existing entry
+  std::pair<iterator, bool> insert(const value_type &entry);
+  // safe against concurrent readers in an EpochGuard, false if the entry
+  // was removed already; the skip list only marks it removed and reuses it
+  // on the next insert of the key, it cannot unlink under concurrency
+  bool erase(iterator iter);
+  // frees the entry right away, not safe against concurrent readers
+  void unsafe_erase(iterator iter);
+  size_t size() const;
+
+ private:
+  iterator _fromSkipList(SkipListT::iterator skipIter);
+  iterator _fromCursor(bool found, const BTreeIndex::Cursor &cursor);
+  iterator _fromHashCursor(bool found, const HashIndex::Cursor &cursor);
+
+  uint32_t _partOf(uint64_t key) const;
+  // iter of partition part, as an iterator of this index
+  iterator _adopt(iterator iter, uint32_t part) const;
+  // the first entry of the partitions from part on
+  iterator _partBegin(uint32_t part) const;
+  // ordered iteration over hash partitions takes the smallest of them
+  bool _mergesParts() const {
+    return _partType == PartitionType::HASH && isOrdered();
+  }
+  iterator _smallestOf(const std::function<iterator(IndexerT &)> &position)
+      const;
+
+  IndexType _type;
+  EpochManager *_epochs;
+  std::unique_ptr<SkipListT> _skipList;
+  // skip list entries marked removed but still linked
+  std::atomic<size_t> _removedNum{0};
+  std::unique_ptr<BTreeIndex> _btree;
+  std::unique_ptr<HashIndex> _hash;
+  // set if partitioned, the backends above are left empty then
+  std::vector<std::unique_ptr<IndexerT>> _parts;
+  PartitionType _partType = PartitionType::RANGE;
+  std::vector<uint64_t> _rangeStarts;
+};
+
+using IndexerList = std::unordered_map<SchemaId, std::shared_ptr<IndexerT>>;
+using IndexerIterator = IndexerT::iterator;
+
+}  // namespace NKV
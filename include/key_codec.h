@@ -0,0 +1,40 @@
+//
+//  key_codec.h
+//  PROJECT key_codec
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "field_type.h"
+#include "kv_type.h"
+#include "schema.h"
+
+namespace NKV {
+
+// Order preserving encoding of field values: comparing two encodings with
+// memcmp gives the order of the values.
+//  - integers: big endian with the sign bit flipped, fixed width
+//  - strings: zero padding dropped, 0x00 escaped as 0x00 0xFF and closed by
+//    0x00 0x01, so that a string sorts before every longer one it prefixes
+// A tuple is the concatenation of its encoded fields.
+class KeyCodec {
+ public:
+  // the fields that can be part of a key
+  static bool isEncodable(FieldType type);
+
+  // append the encoding of one raw field value, as stored in the row
+  static void encodeField(FieldType type, uint32_t fieldSize,
+                          const Value &fieldValue, std::string &out);
+
+  // the encoding of the key fields of schemaPtr, one value per key field;
+  // fewer values encode a prefix of the tuple
+  static std::string encodeKey(Schema *schemaPtr,
+                               const std::vector<Value> &keyValues);
+};
+
+}  // namespace NKV
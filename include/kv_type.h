@@ -56,54 +56,148 @@ struct Key {
 
 using Value = std::string;
 
-class ValuePtr {
+// The state of an entry is one 16 byte word, changed only by a 16 byte CAS
+// (cmpxchg16b), so that the plog address, the hot bit and the PBRB row
+// address always move together:
+//   lo: | plog address 48 | chain length 8 | hot 1 | version 7 |
+//   hi: | PBRB row address 48 | access tick 16 |      while hot
+//       | inline row address 48 | inline seq 16 |     inline schemas
+// Readers load the two halves with plain 8 byte loads; a write against a
+// torn snapshot simply fails its CAS.
+class alignas(16) ValuePtr {
  public:
+  // what a reader saw of an entry, a PBRB row is published or read only if
+  // the entry is still in this state
+  struct State {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+
+    bool isHot() const { return (lo & HOT_BIT) != 0; }
+    PmemAddress getPmemAddr() const { return _toPmemAddr(lo); }
+    uint8_t getPrevItemCount() const { return (lo >> COUNT_SHIFT) & 0xFF; }
+    RowAddr getPBRBAddr() const {
+      return isHot() ? reinterpret_cast<RowAddr>(hi & ADDR_MASK) : nullptr;
+    }
+  };
+
   ValuePtr() {}
-  ValuePtr(PmemAddress pmAddr, TimeStamp ts);
-  ValuePtr(RowAddr rowAddr, TimeStamp ts);
+  explicit ValuePtr(PmemAddress pmAddr);
   ~ValuePtr() {}
   ValuePtr(const ValuePtr &valuePtr);
 
- private:
-  PmemAddress _pmemAddr = 0;
-  RowAddr _pbrbAddr = 0;
-  std::atomic<TimeStamp> _timestamp{{0}};
-  // identify the previous record count
-  // 0 : full record, no prev record
-  // 1 ~ N : partial record, has prev records
-  std::atomic_uint8_t _prevItemCount{0};
-  std::atomic_bool _isHot{false};
-
- public:
-  TimeStamp getTimestamp() const {
-    return _timestamp.load(std::memory_order_acquire);
+  State getState() const {
+    State state;
+    state.lo = __atomic_load_n(&_word[0], __ATOMIC_ACQUIRE);
+    state.hi = __atomic_load_n(&_word[1], __ATOMIC_ACQUIRE);
+    return state;
   }
 
-  PmemAddress getPmemAddr() const { return _pmemAddr; }
+  PmemAddress getPmemAddr() const {
+    return _toPmemAddr(__atomic_load_n(&_word[0], __ATOMIC_ACQUIRE));
+  }
 
-  RowAddr getPBRBAddr() const { return _pbrbAddr; }
+  RowAddr getPBRBAddr() const { return getState().getPBRBAddr(); }
 
-  std::pair<bool, TimeStamp> getHotStatus() const;
+  std::pair<bool, State> getHotStatus() const {
+    State state = getState();
+    return {state.isHot(), state};
+  }
 
-  bool isHot() const;
+  bool isHot() const {
+    return (__atomic_load_n(&_word[0], __ATOMIC_ACQUIRE) & HOT_BIT) != 0;
+  }
 
-  void setFullColdPmemAddr(PmemAddress pmAddr, TimeStamp newTS = TimeStamp());
+  // the setters return the PBRB row they took out of the entry, nullptr if
+  // it was cold; the caller retires it
+  RowAddr setFullColdPmemAddr(PmemAddress pmAddr);
 
-  void setPartialColdPmemAddr(PmemAddress pmAddr,
-                              TimeStamp newTS = TimeStamp());
+  RowAddr setPartialColdPmemAddr(PmemAddress pmAddr);
 
   uint8_t getPrevItemCount() const {
-    return _prevItemCount.load(std::memory_order_relaxed);
+    return (__atomic_load_n(&_word[0], __ATOMIC_RELAXED) >> COUNT_SHIFT) &
+           0xFF;
   }
-  bool isFullRecord() const {
-    return _prevItemCount.load(std::memory_order_relaxed) == 0;
+  bool isFullRecord() const { return getPrevItemCount() == 0; }
+
+  // point to a rewritten copy of the row read in the state seen, fails if
+  // the entry changed since; the version in the word tells a row rewritten
+  // at the same address apart
+  bool relocatePmemAddr(const State &seen, PmemAddress newAddr);
+
+  // the PBRB row taken out, nullptr if another thread moved it out first
+  RowAddr evictToCold();
+
+  // a removed entry may still be held by readers that found it before,
+  // they treat it as absent
+  static constexpr PmemAddress REMOVED_PMEM_ADDR = UINT64_MAX;
+  bool isRemoved() const { return getPmemAddr() == REMOVED_PMEM_ADDR; }
+  // false if it was removed already
+  bool markRemoved();
+  // reuse a removed entry for valuePtr, false if another insert did first
+  // or the remover has not taken its PBRB row out yet
+  bool revive(const ValuePtr &valuePtr);
+
+  // a read of the PBRB row found in state seen; false if the entry changed
+  // since. The access tick only moves if it is stale, so most hits do not
+  // write the entry
+  bool setHotTimeStamp(const State &seen, TimeStamp newTS);
+  // whether the entry is still in state seen, the access tick aside
+  bool matches(const State &seen) const {
+    State state = getState();
+    return state.lo == seen.lo &&
+           state.getPBRBAddr() == seen.getPBRBAddr();
   }
 
-  void evictToCold();
+  // publish the PBRB row of the cold entry read in state seen
+  bool setHotPBRBAddr(RowAddr rowAddr, const State &seen, TimeStamp newTS);
+
+  // the access tick is the TSC in units of 2^ACCESS_TICK_SHIFT cycles and
+  // wraps after 2^16 units (about 20 s at 3 GHz); an entry idle for longer
+  // looks accessed at a random point of the last period
+  static constexpr uint32_t ACCESS_TICK_SHIFT = 20;
+  // whether the entry was last read after ts, only meaningful while hot
+  bool accessedAfter(TimeStamp ts) const;
+  TimeStamp getTimestamp() const;
+
+  // rows whose fields fit here can be kept in the index entry as well
+  static constexpr uint32_t INLINE_ROW_SIZE = 2 * sizeof(uint64_t);
+  // keep a copy of the fields of the full row at pmAddr
+  void setInlineRow(PmemAddress pmAddr, const char *row, uint32_t size);
+  // the fields of the current row, false if there is no copy of it
+  bool readInlineRow(char *row, uint32_t size) const;
+
+ private:
+  static constexpr uint64_t ADDR_MASK = (1ULL << 48) - 1;
+  static constexpr uint32_t COUNT_SHIFT = 48;
+  static constexpr uint64_t COUNT_MASK = 0xFFULL << COUNT_SHIFT;
+  static constexpr uint64_t HOT_BIT = 1ULL << 56;
+  static constexpr uint32_t VERSION_SHIFT = 57;
+  static constexpr uint32_t TICK_SHIFT = 48;
+
+  static PmemAddress _toPmemAddr(uint64_t lo) {
+    uint64_t addr = lo & ADDR_MASK;
+    return addr == ADDR_MASK ? REMOVED_PMEM_ADDR : addr;
+  }
+  // the low word with a new address, chain length and hot bit, and the
+  // version bumped so that a snapshot taken before does not match again
+  static uint64_t _nextLo(uint64_t lo, PmemAddress pmAddr, uint8_t count,
+                          bool hot) {
+    uint64_t version = ((lo >> VERSION_SHIFT) + 1) << VERSION_SHIFT;
+    return version | (pmAddr & ADDR_MASK) | ((uint64_t)count << COUNT_SHIFT) |
+           (hot ? HOT_BIT : 0);
+  }
+  static uint16_t _tickOf(TimeStamp ts) {
+    return ts.txn_ticks >> ACCESS_TICK_SHIFT;
+  }
+  // the 16 byte CAS, expected is updated to the current state on failure
+  bool _cas(State &expected, const State &desired);
 
-  bool setHotTimeStamp(TimeStamp oldTS, TimeStamp newTS);
+  // a consistent snapshot of the inline copy, false if there never was one
+  bool _loadInlineRow(PmemAddress &addr, uint64_t *words) const;
+  void _copyInlineRow(const ValuePtr &valuePtr);
 
-  bool setHotPBRBAddr(RowAddr rowAddr, TimeStamp oldTS, TimeStamp newTS);
+  uint64_t _word[2] = {0, 0};
+  std::atomic<uint64_t> _inlineRow[2] = {0, 0};
 };
 
 }  // namespace NKV
@@ -8,20 +8,33 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include "buffer_page.h"
+#include "consolidation.h"
+#include "epoch.h"
+#include "key_codec.h"
 #include "kv_type.h"
 #include "logging.h"
 #include "mempool.h"
 #include "pbrb.h"
+#include "plog_iterator.h"
 #include "pmem_engine.h"
 #include "pmem_log.h"
+#include "prefix_key_index.h"
 #include "profiler.h"
+#include "replication.h"
+#include "scan_iterator.h"
 #include "schema.h"
 #include "schema_parser.h"
+#include "secondary_index.h"
+#include "table_handle.h"
 #include "timestamp.h"
 
+class NeoPMKVTest;
+
 namespace NKV {
 
 using std::pair;
@@ -38,7 +51,9 @@ class NeoPMKV {
           bool enable_async_gc = false, bool in_place_update_opt = false,
           uint32_t max_page_num = 1ull << 18, uint64_t rw_mirco = 2000,
           double gc_threshold = 0.7, uint64_t gc_inteval_micro = 2000,
-          double hit_threshold = 0.3) {
+          double hit_threshold = 0.3, bool bg_consolidation = false,
+          bool read_write_back = false,
+          AccessTracking access_tracking = AccessTracking::EXACT) {
     _enable_pbrb = enable_pbrb;
     _async_pbrb = async_pbrb;
     _in_place_update_opt = in_place_update_opt;
@@ -57,10 +72,23 @@ class NeoPMKV {
       _pbrb = new PBRB(max_page_num, &ts_start_pbrb, &_indexerList, &_sMap,
                        &_sParser, _engine_ptr, rw_mirco, 4, async_pbrb,
                        enable_async_gc, gc_threshold, gc_inteval_micro,
-                       hit_threshold);
+                       hit_threshold, access_tracking);
+    }
+    // a merged chain read from pmem is appended back as a full row
+    _read_write_back = read_write_back;
+    // long partial chains are merged by a background worker
+    _bg_consolidation = bg_consolidation;
+    if (_bg_consolidation == true) {
+      _consolidateThread = std::thread(&NeoPMKV::consolidateLoop, this);
     }
   }
   ~NeoPMKV() {
+    if (_bg_consolidation == true) {
+      _stopConsolidation.store(true);
+      _consolidateThread.join();
+    }
+    // rows and entries retired by the last writers
+    _epochs.drain();
     delete _memPoolPtr;
     for (const auto &[_, schemaParser] : _sParser) delete schemaParser;
     delete _engine_ptr;
@@ -70,18 +98,42 @@ class NeoPMKV {
     outputReadStat();
   }
   // DDL (data definition language)
-  SchemaId CreateSchema(vector<SchemaField> fields, uint32_t primarykeyId,
-                        string name);
+  // the primary keys of the schema are kept in an index of indexType;
+  // Scan and PartialScan fail on IndexType::HASH. With partitioning, every
+  // partition has an index of its own, so that writers of different
+  // partitions do not contend on one index
+  SchemaId CreateSchema(
+      vector<SchemaField> fields, uint32_t primarykeyId, string name,
+      IndexType indexType = IndexType::SKIPLIST,
+      const IndexPartitioning &partitioning = IndexPartitioning());
+  // the primary key is the tuple of keyFields (INT*, STRING, VARSTR), kept in
+  // order by its encoding; rows go through PutRow and ScanByKey, and each key
+  // maps to a 64 bit id that the other APIs take as Key::primaryKey
+  SchemaId CreateSchema(vector<SchemaField> fields, vector<uint32_t> keyFields,
+                        string name, IndexType indexType = IndexType::SKIPLIST);
+  // partial chains longer than the threshold get merged, tuned from the
+  // schema's read/write mix unless pinned by SetChainThreshold
+  void SetChainThreshold(SchemaId sid, uint8_t threshold);
+  void ResetChainThreshold(SchemaId sid);
+  uint8_t GetChainThreshold(SchemaId sid);
   // DML (data manipulation language)
   Schema *QuerySchema(SchemaId sid);
   SchemaVer AddField(SchemaId sid, SchemaField &sField);
   SchemaVer DropField(SchemaId sid, SchemaId fieldId);
 
+  // keys a MultiGet works on together
+  static constexpr uint32_t MULTI_GET_BATCH = 16;
+
   // DQL (data query language)
   bool MultiPartialGet(Key &key, vector<Value> &value,
                        const vector<uint32_t> fields);
   bool PartialGet(Key &key, Value &value, uint32_t field);
   bool Get(Key &key, Value &value);
+  // Get of many keys, values[i] for keys[i] and left empty if it is missing;
+  // false if any key is missing. The index probes, PBRB rows and plog
+  // records of a batch are prefetched before any of them is read, so their
+  // cache and pmem misses overlap instead of stalling one by one
+  bool MultiGet(const vector<Key> &keys, vector<Value> &values);
 
   bool Put(const Key &key, vector<Value> &fieldList);
   bool Put(const Key &key, Value&value);
@@ -92,26 +144,170 @@ class NeoPMKV {
 
   bool Remove(Key &key);
 
+  // composite key part: the id of the key tuple keyValues, a new one is given
+  // out if create is set and the tuple was never seen
+  bool ResolveKey(SchemaId sid, const vector<Value> &keyValues, Key &key,
+                  bool create = false);
+  // put a full row, its key is taken from the key fields of fieldList
+  bool PutRow(SchemaId sid, vector<Value> &fieldList);
+  // the rows after the key tuple startKey in key order; a prefix of a tuple
+  // starts at the first tuple that has it
+  bool ScanByKey(SchemaId sid, const vector<Value> &startKey,
+                 vector<Value> &valueList, uint32_t scanLen);
+
   bool PartialScan(Key &start, vector<Value> &valueList, uint32_t scanLen,
                    uint32_t fieldId);
   bool Scan(Key &start, vector<Value> &valueList, uint32_t scanLen);
+  // streaming scan of the rows of sid within range, nullptr for an unknown
+  // schema; has to be destroyed before this NeoPMKV
+  std::unique_ptr<ScanIterator> NewScanIterator(
+      SchemaId sid, const ScanRange &range = ScanRange());
+  // the range cut into partitions (4 per TBB worker by default) that TBB
+  // tasks scan concurrently, each through its own iterator; the rows go to
+  // callback, or into valueList in the order a ScanIterator returns them
+  bool ParallelScan(SchemaId sid, const ScanRange &range,
+                    const ScanCallback &callback, uint32_t partitions = 0);
+  bool ParallelScan(SchemaId sid, const ScanRange &range,
+                    vector<Value> &valueList, uint32_t partitions = 0);
+
+  // the resolved state of schema sid, nullptr for an unknown schema; valid as
+  // long as this NeoPMKV
+  TableHandle *OpenTable(SchemaId sid);
+  // the same operations through a handle, which skips the per call catalog
+  // lookups; the key has to be of the table's schema
+  bool Get(const TableHandle &table, Key &key, Value &value);
+  bool PartialGet(const TableHandle &table, Key &key, Value &value,
+                  uint32_t field);
+  bool MultiPartialGet(const TableHandle &table, Key &key,
+                       vector<Value> &value, vector<uint32_t> fields);
+  bool Put(const TableHandle &table, const Key &key, vector<Value> &fieldList);
+  bool PartialUpdate(const TableHandle &table, Key &key, Value &fieldValue,
+                     uint32_t fieldId);
+  bool MultiPartialUpdate(const TableHandle &table, Key &key,
+                          vector<Value> &fieldValues,
+                          vector<uint32_t> &fields);
+  bool Remove(const TableHandle &table, Key &key);
+  bool PartialScan(const TableHandle &table, Key &start,
+                   vector<Value> &valueList, uint32_t scanLen,
+                   uint32_t fieldId);
+  bool Scan(const TableHandle &table, Key &start, vector<Value> &valueList,
+            uint32_t scanLen);
+  std::unique_ptr<ScanIterator> NewScanIterator(
+      const TableHandle &table, const ScanRange &range = ScanRange());
+  bool ParallelScan(const TableHandle &table, const ScanRange &range,
+                    const ScanCallback &callback, uint32_t partitions = 0);
+  bool ParallelScan(const TableHandle &table, const ScanRange &range,
+                    vector<Value> &valueList, uint32_t partitions = 0);
+
+  // secondary index on a fixed width field (INT*, STRING), kept by Put,
+  // PartialUpdate and Remove; the rows already stored are indexed here
+  bool CreateSecondaryIndex(SchemaId sid, uint32_t fieldId);
+  // the rows whose field fieldId equals fieldValue
+  bool GetBySecondary(SchemaId sid, uint32_t fieldId, const Value &fieldValue,
+                      vector<Value> &valueList);
+  // the rows with low <= field fieldId <= high, in field order
+  bool ScanBySecondary(SchemaId sid, uint32_t fieldId, const Value &low,
+                       const Value &high, vector<Value> &valueList,
+                       uint32_t scanLen = UINT32_MAX);
+
+  // rewrite the live rows of a schema in primary key order, so that range
+  // scans read the plog mostly sequentially afterwards. The old rows are not
+  // freed, every call grows the plog by the size of the live rows
+  bool Compact(SchemaId sid, uint32_t batchRows = 1024);
+
+  // change data capture: tail the plog from start in append order
+  std::unique_ptr<PlogIterator> NewCDCIterator(PmemAddress start = 0) {
+    return std::make_unique<PlogIterator>(_engine_ptr, start);
+  }
+  // the position a new CDC reader may start from to skip the history
+  PmemAddress GetLogTail() { return _engine_ptr->getUsedSpace(); }
+
+  // replication: ship this plog to a follower listening on endpoint
+  std::unique_ptr<ReplicationSender> NewReplicationSender(
+      string endpoint, PmemAddress start = 0) {
+    return std::make_unique<ReplicationSender>(_engine_ptr, endpoint, start);
+  }
+  // follower side: mirror a primary plog range and index its rows
+  bool ApplyReplicatedRange(PmemAddress addr, const char *data, uint32_t size);
 
   void outputReadStat();
 
  private:
-  bool putNewValue(const Key &key, const Value &value);
-  bool putExistedValue(IndexerIterator &idxIter, ValuePtr *vPtr, const Key &key,
-                       const Value &value, bool isPartial);
-  bool getValueHelper(IndexerIterator &idxIter, shared_ptr<IndexerT> indexer,
-                      SchemaId schemaid, vector<Value> &value,
-                      vector<uint32_t> &fields);
-  bool getValueHelper(IndexerIterator &idxIter, shared_ptr<IndexerT> indexer,
-                      SchemaId schemaid, Value &value,
-                      uint32_t fieldId = UINT32_MAX);
-  bool updateFullValue(IndexerIterator &idxIter, shared_ptr<IndexerT> indexer,
+  bool putNewValue(const TableHandle &table, const Key &key,
+                   const Value &value);
+  bool putExistedValue(const TableHandle &table, IndexerIterator &idxIter,
+                       ValuePtr *vPtr, const Key &key, const Value &value,
+                       bool isPartial);
+  bool getValueHelper(IndexerIterator &idxIter, const TableHandle &table,
+                      vector<Value> &value, vector<uint32_t> &fields);
+  bool getValueHelper(IndexerIterator &idxIter, const TableHandle &table,
+                      Value &value, uint32_t fieldId = UINT32_MAX);
+  bool updateFullValue(IndexerIterator &idxIter, const TableHandle &table,
                        const Key &key, Value &newPartialValue);
+  // keep the fields of the full row at pmAddr in the entry of an inline table
+  void inlineRow(const TableHandle &table, ValuePtr &vPtr, PmemAddress pmAddr,
+                 const Value &row);
+  // the full row from the entry, false if it holds no current copy
+  bool readInlineRow(const TableHandle &table, const ValuePtr &vPtr,
+                     char *row);
+  // consecutive sub-ranges of range, cut where the index says the rows
+  // split evenly, or evenly over the occupied keys if it cannot tell
+  void partitionRange(const TableHandle &table, const ScanRange &range,
+                      uint32_t partitions, vector<ScanRange> &parts);
+  void scanPartitions(const TableHandle &table, const vector<ScanRange> &parts,
+                      const ScanCallback &callback);
+  // one MultiGet batch of keys[order[begin, end)], all of the table's schema
+  bool multiGetBatch(const TableHandle &table, const vector<Key> &keys,
+                     const vector<uint32_t> &order, uint32_t begin,
+                     uint32_t end, vector<Value> &values);
   bool dropSchemaVersion(SchemaId sid, SchemaVer version);
+  // drop a row taken out of the PBRB once no reader is left
+  void retireHotRow(RowAddr rowAddr, const TableHandle &table);
+  bool applyReplicatedRecord(PlogRecord &record);
+  bool readMergedRow(PmemAddress pmemAddr, Schema *schemaPtr, Value &value);
+  // merge the chains of the most read candidates, returns the merged count
+  uint32_t consolidateChains(uint32_t maxCount);
+  void consolidateLoop();
+  // called after a partial row was appended to the chain
+  void trackPartialChain(const TableHandle &table, const Key &key,
+                         uint8_t chainLength);
+  void writeBackMergedRow(const TableHandle &table, uint64_t primaryKey,
+                          const ValuePtr::State &seen, const Value &mergedRow);
+  // the rows were read in the states seen, a key changed since keeps its row
+  bool relocateBatch(const TableHandle &table, vector<uint64_t> &keys,
+                     vector<ValuePtr::State> &seen, vector<Value> &rows);
+
+  // secondary index part
+  struct SecondaryChange {
+    SecondaryIndex *index;
+    bool hasOld = false;
+    Value oldValue;
+    bool hasNew = false;
+    Value newValue;
+  };
+  bool hasSecondary(const TableHandle &table) {
+    return table.secondaryIndexes->empty() == false;
+  }
+  // the indexed fields of a full row with their values
+  void secondaryFieldsOfRow(const TableHandle &table, const Value &row,
+                            vector<uint32_t> &fieldIds,
+                            vector<Value> &fieldValues);
+  // before a write of key that sets fieldIds to newValues (none for a
+  // remove): index the new values, remember the old ones of the row at
+  // oldAddr, REMOVED_PMEM_ADDR if there is none
+  void prepareSecondary(const TableHandle &table, const Key &key,
+                        PmemAddress oldAddr,
+                        const vector<uint32_t> &fieldIds,
+                        const vector<Value> &newValues,
+                        vector<SecondaryChange> &changes);
+  // after the write succeeded: unindex the old values that changed
+  void commitSecondary(const Key &key, vector<SecondaryChange> &changes);
+  bool readBySecondary(SchemaId sid, uint32_t fieldId, const Value &low,
+                       const Value &high, vector<Value> &valueList,
+                       uint32_t scanLen);
 
+  // removed index entries and PBRB rows wait here for concurrent readers
+  EpochManager _epochs;
   // use store the key -> valueptr
   IndexerList _indexerList;
   // use to allocate schema
@@ -124,6 +320,32 @@ class NeoPMKV {
   MemPool *_memPoolPtr = nullptr;
 
   bool _in_place_update_opt = false;
+  bool _read_write_back = false;
+
+  // background consolidation part
+  bool _bg_consolidation = false;
+  ChainTracker _chainTracker;
+  std::unordered_map<SchemaId, std::unique_ptr<AdaptiveChainThreshold>>
+      _chainThresholds;
+  std::atomic_bool _stopConsolidation{false};
+  std::thread _consolidateThread;
+  uint64_t _consolidateIntervalMicro = 1000;
+  uint32_t _consolidateBatch = 256;
+
+  // encoded key -> id of a schema with a composite key
+  struct EncodedKeySpace {
+    PrefixKeyIndex keys;
+    std::atomic<uint64_t> nextId{1};
+  };
+  // schema id -> its key space, only changed by DDL
+  std::unordered_map<SchemaId, std::unique_ptr<EncodedKeySpace>> _keySpaces;
+
+  // schema id -> its resolved state, only changed by DDL
+  std::unordered_map<SchemaId, std::unique_ptr<TableHandle>> _tables;
+
+  // schema id -> its secondary indexes, only changed by DDL
+  std::unordered_map<SchemaId, vector<std::unique_ptr<SecondaryIndex>>>
+      _secondaryIndexes;
 
   // pbrb part
   bool _enable_pbrb = false;
@@ -133,7 +355,9 @@ class NeoPMKV {
   PmemEngineConfig _engine_config;
   PmemEngine *_engine_ptr = nullptr;
 
+  friend class ScanIterator;
   friend class VariableFieldTest;
+  friend class ::NeoPMKVTest;
 
   // Statistics:
   struct StatStruct {
@@ -163,6 +387,9 @@ class NeoPMKV {
 
     std::atomic<uint64_t> pbrbWriteCount = {0};
     std::atomic<uint64_t> pbrbWriteTimeNanoSecs = {0};
+
+    std::atomic<uint64_t> consolidateCount = {0};
+    std::atomic<uint64_t> consolidateTimeNanoSecs = {0};
   } _durationStat;
 };
 
@@ -26,6 +26,7 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <new>
 #include <numeric>
 #include <tuple>
@@ -39,9 +40,12 @@
 #include "pmem_engine.h"
 #include "profiler.h"
 #include "schema.h"
+#include "table_handle.h"
 #include "timestamp.h"
 #include "async_buffer.h"
 
+class NeoPMKVTest;
+
 namespace NKV {
 
 class SchemaParser;
@@ -49,9 +53,9 @@ class SchemaParser;
 using std::string;
 using std::vector;
 
-const uint32_t rowCRC32Offset = 0;
-const uint32_t rowTSOffset = sizeof(CRC32);
-const uint32_t rowPlogAddrOffset = sizeof(CRC32) + sizeof(TimeStamp);
+const uint32_t rowSeqOffset = 0;
+const uint32_t rowTSOffset = sizeof(uint32_t);
+const uint32_t rowPlogAddrOffset = sizeof(uint32_t) + sizeof(TimeStamp);
 const uint32_t pbrbAsyncQueueSize = 32;
 using SchemaParserMap = std::unordered_map<SchemaId, SchemaParser *>;
 
@@ -97,6 +101,14 @@ struct AccessStatistics {
     }
   }
 };
+// How a PBRB hit records its recency for the GC watermark. EXACT reads
+// the TSC and stamps the entry and the row on every hit. SAMPLED does so
+// for about one hit in ACCESS_SAMPLE_RATE. COARSE stamps the entry with a
+// shared clock that sampled hits, promotions and the GC thread move on, so
+// most hits do not read the TSC, and the entry is written at most once per
+// clock step.
+enum class AccessTracking : uint8_t { EXACT, SAMPLED, COARSE };
+
 // PBRB interface
 class PBRB {
  public:
@@ -106,19 +118,61 @@ class PBRB {
        uint64_t retentionWindowMicrosecs = 2000, uint32_t maxPageSearchNum = 5,
        bool async_pbrb = false, bool enable_async_gc = false,
        double targetOccupancyRatio = 0.7, uint64_t gcIntervalMicrosecs = 100000,
-       double hitThreshold = 0.3);
+       double hitThreshold = 0.3,
+       AccessTracking accessTracking = AccessTracking::EXACT);
+
+  static constexpr uint32_t ACCESS_SAMPLE_RATE = 16;
+  // the stamp a hit passes to read, zero if the hit is not recorded
+  TimeStamp accessStamp() {
+    TimeStamp ts;
+    if (_accessTracking == AccessTracking::COARSE) {
+      // a read-only workload keeps the clock going through its samples
+      if (_sampleAccess()) {
+        ts.getNow();
+        _advanceAccessClock(ts);
+      }
+      ts.txn_ticks = _accessClock.load(std::memory_order_relaxed);
+    } else if (_accessTracking == AccessTracking::EXACT || _sampleAccess()) {
+      ts.getNow();
+    }
+    return ts;
+  }
 
   bool traverseIdxGC();
   // dtor
   ~PBRB();
-  bool read(TimeStamp oldTS, TimeStamp newTS, const RowAddr addr,
+  bool read(ValuePtr::State oldState, TimeStamp newTS, const RowAddr addr,
             SchemaId schemaId, vector<Value> &value, ValuePtr *vPtr,
             vector<uint32_t> fields = std::vector<uint32_t>());
-  bool read(TimeStamp oldTS, TimeStamp newTS, const RowAddr addr,
+  bool read(ValuePtr::State oldState, TimeStamp newTS, const RowAddr addr,
             SchemaId schemaId, Value &value, ValuePtr *vPtr,
             uint32_t fieldId = UINT32_MAX);
-  bool write(TimeStamp oldTS, TimeStamp newTS, SchemaId schemaId,
+  bool write(ValuePtr::State oldState, TimeStamp newTS, SchemaId schemaId,
              const Value &value, IndexerIterator iter);
+  // the same through a handle filled in by resolveTable, no map lookups
+  bool read(ValuePtr::State oldState, TimeStamp newTS, const RowAddr addr,
+            const TableHandle &table, vector<Value> &value, ValuePtr *vPtr,
+            vector<uint32_t> fields);
+  bool read(ValuePtr::State oldState, TimeStamp newTS, const RowAddr addr,
+            const TableHandle &table, Value &value, ValuePtr *vPtr,
+            uint32_t fieldId = UINT32_MAX);
+  bool write(ValuePtr::State oldState, TimeStamp newTS,
+             const TableHandle &table, const Value &value, IndexerIterator iter);
+
+  // set the PBRB part of table, whose schemaId, indexer and schema are set,
+  // once createCacheForSchema was called for it
+  void resolveTable(TableHandle &table);
+
+  // pull a hot row towards the caches ahead of a read of it
+  inline void prefetcht2Row(RowAddr rowAddr, size_t size) {
+    // sysconf reports 0 where the cache geometry is unknown
+    static const size_t clsize =
+        std::max<long>(sysconf(_SC_LEVEL1_DCACHE_LINESIZE), 64);
+    for (size_t off = 0; off < size; off += clsize) {
+      __builtin_prefetch((uint8_t *)rowAddr + off, 0, 1);
+    }
+    return;
+  }
 
   bool dropRow(RowAddr rAddr, Schema *schemaPtr);
 
@@ -126,6 +180,8 @@ class PBRB {
 
   bool schemaHit(SchemaId sid);
   bool schemaMiss(SchemaId sid);
+  bool schemaHit(const TableHandle &table);
+  bool schemaMiss(const TableHandle &table);
   double getHitRatio(SchemaId sid);
   void outputHitRatios();
 
@@ -143,8 +199,34 @@ class PBRB {
 
   // A list to store allocated free pages
   BufferPage *_bufferPoolPtr = nullptr;
+  // the mapping behind the pool, backed by hugepages where the system has
+  // them so that a random hit does not miss the TLB
+  void *_bufferPoolMap = nullptr;
+  size_t _bufferPoolMapSize = 0;
   // std::list<BufferPage *> _freePageList;
-  oneapi::tbb::concurrent_bounded_queue<BufferPage *> _freePageList;
+  // The pool is split into one contiguous partition per NUMA node, each
+  // bound to its node. Every node has a global free list of its own
+  // pages, cores only take and give back batches of pages
+  uint32_t _nodeNum = 1;
+  uint32_t _nodePageNum = 0;
+  std::vector<
+      std::unique_ptr<oneapi::tbb::concurrent_bounded_queue<BufferPage *>>>
+      _freePageLists;
+
+  // Free pages cached by a core in front of the global pool. The lock is
+  // only contended when a thread moves cores or another core steals.
+  // Occupancy is the sum of the per core counters, so that counting a page
+  // does not touch a shared line either.
+  static constexpr uint32_t FREE_PAGE_BATCH = 32;
+  struct alignas(64) FreePageCache {
+    std::mutex lock;
+    std::vector<BufferPage *> pages;
+    // the node of the core, refills come from its partition first
+    uint32_t node = 0;
+    // pages freed on this core minus the pages taken here
+    std::atomic<int64_t> freeDelta{0};
+  };
+  std::vector<std::unique_ptr<FreePageCache>> _freePageCaches;
 
   // A Map to store pages used by different SKV table, and one SKV table
   // corresponds to a list
@@ -172,6 +254,9 @@ class PBRB {
   std::atomic<uint64_t> _pbrbAsyncWriteTimeNanoSecs = {0};
 
   TimeStamp _watermark;
+  AccessTracking _accessTracking = AccessTracking::EXACT;
+  // the COARSE clock, never moves backwards
+  std::atomic<uint64_t> _accessClock{0};
 
   // GC
   bool _asyncGC = false;
@@ -187,18 +272,34 @@ class PBRB {
  private:
   BufferPage *getPageAddr(void *rowAddr);
 
-  auto &getFreePageList() { return _freePageList; }
+  auto &getFreePageList(uint32_t node) { return *_freePageLists[node]; }
+
+  // the partition a page belongs to
+  uint32_t _nodeOfPage(BufferPage *pagePtr) {
+    return (pagePtr - _bufferPoolPtr) / _nodePageNum;
+  }
+  void _allocBufferPool();
 
   uint32_t getMaxPageNumber() { return _maxPageNumber; }
 
+  // push a new page onto the list, its first row is claimed for the caller
   BufferPage *AllocNewPageForSchema(SchemaId schemaId);
 
-  BufferPage *AllocNewPageForSchema(SchemaId schemaId, BufferPage *pagePtr);
-
   float totalPageUsage() {
-    return 1 - ((float)_freePageList.size() / (float)_maxPageNumber);
+    return 1 - ((float)_freePageNum() / (float)_maxPageNumber);
   }
 
+  FreePageCache &_localFreePageCache();
+  // nullptr once no core has a free page left
+  BufferPage *_popFreePage();
+  void _pushFreePage(BufferPage *pagePtr);
+  // put a page counted as free already into the cache
+  void _cacheFreePage(BufferPage *pagePtr);
+  BufferPage *_stealFreePage(FreePageCache &thief);
+  // give a page back to the free list of its node
+  void _releaseFreePage(BufferPage *pagePtr);
+  uint64_t _freePageNum();
+
   // move cold row in pAddress to PBRB and insert hot address into KVNode
   void *cacheColdRow(PmemAddress pAddress, Key key);
 
@@ -206,10 +307,9 @@ class PBRB {
   void *cacheRowHeaderFrom(uint32_t schemaId, BufferPage *pagePtr,
                            RowOffset rowOffset, ValuePtr *vPtr, void *nodePtr);
 
-  // find an empty slot between the beginOffset and endOffset in the page
-  inline RowOffset findEmptySlotInPage(
-      std::shared_ptr<BufferListBySchema> &blbs, BufferPage *pagePtr,
-      RowOffset beginOffset = 0, RowOffset endOffset = UINT32_MAX);
+  // claim an empty slot in the page, searching from hint on
+  inline RowOffset claimSlotInPage(BufferListBySchema *blbs,
+                                   BufferPage *pagePtr, RowOffset hint = 0);
 
   // find an empty slot in the page
 
@@ -222,18 +322,24 @@ class PBRB {
   std::pair<BufferPage *, RowOffset> findCacheRowPosition(
       uint32_t schemaID, FCRPSlowCaseStatus &stat);
 
-  // Find the page pointer and row offset to cache cold row
-  std::pair<BufferPage *, RowOffset> findCacheRowPosition(uint32_t schemaID,
-                                                          IndexerIterator iter);
+  // Find the page pointer and row offset to cache cold row, the row is
+  // claimed for the caller
+  std::pair<BufferPage *, RowOffset> findCacheRowPosition(
+      const TableHandle &table, IndexerIterator iter);
 
-  // Traverse cache list to find empty row from pagePtr
+  // Traverse cache list to claim an empty row from pagePtr
   std::pair<BufferPage *, RowOffset> traverseFindEmptyRow(
-      uint32_t schemaID, BufferPage *pagePtr = nullptr,
+      BufferListBySchema *blbs, BufferPage *pagePtr = nullptr,
       uint32_t maxPageSearchingNum = UINT32_MAX);
 
   // return pagePtr and rowOffset.
   std::pair<BufferPage *, RowOffset> findPageAndRowByAddr(void *rowAddr);
   RowAddr getAddrByPageAndRow(BufferPage *pagePtr, RowOffset rowOff);
+  // the same with the buffer list of the page's schema at hand
+  std::pair<BufferPage *, RowOffset> findPageAndRowByAddr(
+      BufferListBySchema *blbs, void *rowAddr);
+  RowAddr getAddrByPageAndRow(BufferListBySchema *blbs, BufferPage *pagePtr,
+                              RowOffset rowOff);
   // evict row and return cold addr.
 
   // mark the row as unoccupied when evicting a hot row
@@ -270,14 +376,6 @@ class PBRB {
   void *getAddrByPageAndOffset(uint32_t schemaId, BufferPage *pagePtr,
                                RowOffset offset);
 
-  inline void prefetcht2Row(RowAddr rowAddr, size_t size) {
-    size_t clsize = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
-    for (size_t off = 0; off < size; off += clsize) {
-      __builtin_prefetch((uint8_t *)rowAddr + off, 0, 1);
-    }
-    return;
-  }
-
  private:
   std::unordered_map<SchemaId, AccessStatistics> _AccStatBySchema;
 
@@ -291,15 +389,27 @@ class PBRB {
   bool _reclaimEmptyPages(SchemaId schemaid);
   inline bool _checkOccupancyRatio(double ratio);
   inline double _getOccupancyRatio() {
-    return 1 - ((double)_freePageList.size() / _maxPageNumber);
+    return 1 - ((double)_freePageNum() / _maxPageNumber);
   }
 
   void _stopGC();
   bool _asyncTraverseIdxGC();
-  bool writeImpl(TimeStamp oldTS, TimeStamp newTS, SchemaId schemaId,
-                 const Value &value, IndexerIterator iter);
-  bool asyncWrite(TimeStamp oldTS, TimeStamp newTS, SchemaId schemaId,
-                  const Value &value, IndexerIterator iter);
+  // a handle built from the maps, for the paths that only have the id
+  TableHandle _tableOf(SchemaId schemaId);
+  bool _sampleAccess();
+  void _advanceAccessClock(TimeStamp now);
+  bool _recordHit(BufferPage *pagePtr, RowAddr addr, ValuePtr *vPtr,
+                  const ValuePtr::State &seen, TimeStamp newTS);
+  char *_rowToParse(BufferPage *pagePtr, RowAddr addr,
+                    const TableHandle &table, uint32_t seq);
+  bool _validateRow(BufferPage *pagePtr, RowAddr addr, ValuePtr *vPtr,
+                    const ValuePtr::State &seen, uint32_t seq);
+  // clear the slot and give the page back once it is empty
+  bool _releaseRow(BufferListBySchema *blbs, BufferPage *pagePtr,
+                   RowOffset rowOffset, EpochManager *epochs);
+  bool writeImpl(ValuePtr::State oldState, TimeStamp newTS,
+                 const TableHandle &table, const Value &value,
+                 IndexerIterator iter);
   void asyncWriteHandler(decltype(&_asyncThreadPollList));
 
  public:
@@ -325,6 +435,7 @@ class PBRB {
   friend class BufferListBySchema;
 
   // For gtest
+  friend class ::NeoPMKVTest;
   friend class VariableFieldTest;
   FRIEND_TEST(PBRBTest, Test01);
 };
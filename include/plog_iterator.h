@@ -0,0 +1,64 @@
+//
+//  plog_iterator.h
+//  PROJECT plog_iterator
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <chrono>
+#include "kv_type.h"
+#include "pmem_engine.h"
+#include "schema.h"
+
+namespace NKV {
+
+// one published record of the plog, rowHead points into pmem directly
+struct PlogRecord {
+  // address of the first byte of the record (the ROW_KEY head if keyed)
+  PmemAddress recordAddr = 0;
+  // address of the row, the same value the indexer keeps for it
+  PmemAddress rowAddr = 0;
+  RowMetaHead *rowHead = nullptr;
+  RowType type = RowType::FULL_FIELD;
+  SchemaId schemaId = 0;
+  bool hasKey = false;
+  uint64_t primaryKey = 0;
+  // set for a compacted copy, which holds the same value as the row at
+  // relocatedFrom and only replaces it if the key still points there
+  bool relocated = false;
+  PmemAddress relocatedFrom = 0;
+
+  char *rowData() { return reinterpret_cast<char *>(rowHead); }
+  uint32_t rowSize() { return rowHead->getSize() + ROW_META_HEAD_SIZE; }
+};
+
+// Tailing iterator over the plog in append order. It only returns records
+// whose head is published, so it never blocks writers and never observes a
+// half-written record. Records are read in place without copying.
+class PlogIterator {
+ public:
+  PlogIterator(PmemEngine *engine, PmemAddress start = 0)
+      : _engine(engine), _position(start) {}
+
+  // move to the next published record, false if the reader caught up
+  bool Next(PlogRecord &record);
+
+  // like Next, but waits up to timeout for a new record to be published
+  bool WaitNext(PlogRecord &record, std::chrono::microseconds timeout);
+
+  // the address of the next record to read, usable to resume later
+  PmemAddress getPosition() { return _position; }
+  void Seek(PmemAddress position) { _position = position; }
+
+ private:
+  // the head at addr if it is published, nullptr otherwise
+  RowMetaHead *_loadHead(PmemAddress addr);
+
+  PmemEngine *_engine;
+  PmemAddress _position;
+};
+
+}  // namespace NKV
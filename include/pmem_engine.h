@@ -181,6 +181,15 @@ class PmemEngine {
   virtual Status append(PmemAddress &pmemAddr, const char *value, uint32_t size) = 0;
 
   virtual Status append(PmemAddress &pmemAddr, const char *value, uint32_t size, bool noHead) = 0;
+  // append a ROW_KEY record and the row in one reservation
+  // rowAddr is the output parameter and points to the row (not the key record)
+  virtual Status appendWithKey(PmemAddress &rowAddr, SchemaId schemaId, uint64_t primaryKey, const char *value, uint32_t size) = 0;
+  // append rewritten rows back to back behind RELOCATED_KEY records, rows[i]
+  // replaces the row at oldAddrs[i]; rowAddrs is the output parameter
+  virtual Status appendRelocated(std::vector<PmemAddress> &rowAddrs, SchemaId schemaId, const std::vector<uint64_t> &keys, const std::vector<PmemAddress> &oldAddrs, const std::vector<std::string> &rows) = 0;
+  // copy a byte range shipped from a primary plog to the same address
+  // only for a follower plog, addr must not be behind the tail
+  virtual Status replicate(PmemAddress addr, const char *data, uint32_t size) = 0;
   // pmemAddr is the input parameter
   virtual Status write(PmemAddress writeAddr, const char *value, uint32_t size) = 0;
 
@@ -195,6 +204,11 @@ class PmemEngine {
   virtual uint64_t getFreeSpace() = 0;
 
   virtual uint64_t getUsedSpace() = 0;
+
+  virtual uint64_t getChunkSize() = 0;
+
+  // zero-copy access to a plog address, nullptr if its chunk is not mapped yet
+  virtual char *convertToPtr(PmemAddress addr) = 0;
 };
 
 } // ns NKV
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <libpmem.h>
+#include <algorithm>
 #include <atomic>
 #include <cmath>
 #include <filesystem>
@@ -49,6 +50,14 @@ class PmemLog : public PmemEngine {
                 uint32_t size) override;
   Status append(PmemAddress &pmemAddr, const char *value, uint32_t size,
                 bool noHead) override;
+  Status appendWithKey(PmemAddress &rowAddr, SchemaId schemaId,
+                       uint64_t primaryKey, const char *value,
+                       uint32_t size) override;
+  Status appendRelocated(std::vector<PmemAddress> &rowAddrs, SchemaId schemaId,
+                         const std::vector<uint64_t> &keys,
+                         const std::vector<PmemAddress> &oldAddrs,
+                         const std::vector<std::string> &rows) override;
+  Status replicate(PmemAddress addr, const char *data, uint32_t size) override;
   Status write(PmemAddress writeAddr, const char *value,
                uint32_t size) override;
 
@@ -64,32 +73,80 @@ class PmemLog : public PmemEngine {
 
   uint64_t getUsedSpace() override;
 
+  uint64_t getChunkSize() override { return _plog_meta.chunk_size; }
+
+  char *convertToPtr(PmemAddress addr) override;
+
  private:
-  // private _append function to write srcdata to plog
-  inline PmemAddress _append(char *srcdata, size_t len) {
-    uint64_t now_tail_offset = _tail_offset.fetch_add(len);
-    if ((1 + _active_chunk_id.load()) * _plog_meta.chunk_size <
-        now_tail_offset + len) {
-      _mutex.lock();
-      _addNewChunk();
-      now_tail_offset = _tail_offset.fetch_add(len);
-      _mutex.unlock();
+  // reserve an aligned space in the plog, a reservation never straddles two
+  // chunks: the one crossing the chunk end skips to the next chunk and marks
+  // the rest of the old chunk with a CHUNK_PADDING record
+  inline PmemAddress _reserve(uint64_t len, bool &mapped) {
+    uint64_t chunk_size = _plog_meta.chunk_size;
+    uint64_t now_tail_offset = _tail_offset.load(std::memory_order_relaxed);
+    uint64_t start_offset;
+    do {
+      start_offset = now_tail_offset;
+      uint64_t chunk_end = (now_tail_offset / chunk_size + 1) * chunk_size;
+      if (start_offset + len > chunk_end) start_offset = chunk_end;
+    } while (!_tail_offset.compare_exchange_weak(now_tail_offset,
+                                                 start_offset + len));
+    mapped = true;
+    if (start_offset != now_tail_offset &&
+        (mapped = _ensureChunkMapped(now_tail_offset / chunk_size))) {
+      _padChunkTail(now_tail_offset);
     }
-
-    char *pmem_addr =
-        _chunk_list[now_tail_offset / _plog_meta.chunk_size].pmem_addr +
-        now_tail_offset % _plog_meta.chunk_size;
+    mapped = mapped && _ensureChunkMapped(start_offset / chunk_size);
     NKV_LOG_D(std::cout,
-              "Append data: len=>{} to offset=>{}, activate chunk id=>{}", len,
-              now_tail_offset, _active_chunk_id.load());
+              "Reserve data: len=>{} at offset=>{}, activate chunk id=>{}", len,
+              start_offset, _active_chunk_id.load());
+    return start_offset;
+  }
 
-    // *(uint32_t *)pmem_addr = len;
+  inline void _padChunkTail(PmemAddress padOffset) {
+    uint64_t chunk_size = _plog_meta.chunk_size;
+    if (chunk_size - padOffset % chunk_size < ROW_META_HEAD_SIZE) return;
+    RowMetaHead padHead;
+    padHead.setMeta(0, RowType::CHUNK_PADDING, 0, 0);
+    _publish(_convertToPtr(padOffset), (char *)&padHead);
+  }
+
+  // make the record visible: the row meta head is stored last with a single
+  // 8B store, so a reader that sees a non-zero head sees the whole record
+  inline void _publish(char *pmem_addr, const char *head) {
+    uint64_t headWord;
+    memcpy(&headWord, head, ROW_META_HEAD_SIZE);
+    __atomic_store_n(reinterpret_cast<uint64_t *>(pmem_addr), headWord,
+                     __ATOMIC_RELEASE);
     if (_is_pmem) {
-      _copyToPmem(pmem_addr, srcdata, len);
+      pmem_persist(pmem_addr, ROW_META_HEAD_SIZE);
     } else {
-      _copyToNonPmem(pmem_addr, srcdata, len);
+      pmem_msync(pmem_addr, ROW_META_HEAD_SIZE);
     }
-    // atomic modify the tail_offset variable
+  }
+
+  inline void _copy(char *pmem_addr, const char *src, size_t len) {
+    if (len == 0) return;
+    if (_is_pmem) {
+      _copyToPmem(pmem_addr, src, len);
+    } else {
+      _copyToNonPmem(pmem_addr, src, len);
+    }
+  }
+
+  // private _append function to write srcdata to plog
+  inline PmemAddress _append(const char *srcdata, size_t len, bool &mapped) {
+    PmemAddress now_tail_offset = _reserve(alignPlogRecord(len), mapped);
+    if (mapped == false) return now_tail_offset;
+    char *pmem_addr = _convertToPtr(now_tail_offset);
+    if (len < ROW_META_HEAD_SIZE) {
+      _copy(pmem_addr, srcdata, len);
+      return now_tail_offset;
+    }
+    // copy the content first, then publish the head
+    _copy(pmem_addr + ROW_META_HEAD_SIZE, srcdata + ROW_META_HEAD_SIZE,
+          len - ROW_META_HEAD_SIZE);
+    _publish(pmem_addr, srcdata);
     return now_tail_offset;
   }
 
@@ -164,10 +221,6 @@ class PmemLog : public PmemEngine {
     return PmemStatuses::S201_Created_File;
   }
   inline Status _addNewChunk() {
-    if (_tail_offset.load() <
-        (_active_chunk_id.load() + 1) * _plog_meta.chunk_size) {
-      return PmemStatuses::S201_Created_File;
-    }
     std::string chunk_name = _genNewChunkName();
     char *chunk_addr = nullptr;
     auto chunk_status =
@@ -179,13 +232,23 @@ class PmemLog : public PmemEngine {
     _chunk_list.push_back(
         {.file_name = std::move(chunk_name), .pmem_addr = chunk_addr});
 
-    _active_chunk_id.fetch_add(1);
-    _tail_offset.store(_plog_meta.chunk_size * _active_chunk_id.load());
+    _active_chunk_id.fetch_add(1, std::memory_order_release);
     NKV_LOG_D(std::cout,
               "generate new chunk, now active chunk id:{}, tail offset:{}",
               _active_chunk_id.load(), _tail_offset.load());
     return PmemStatuses::S201_Created_File;
   }
+
+  // map chunks until chunkId is mapped
+  inline bool _ensureChunkMapped(uint64_t chunkId) {
+    if ((int64_t)chunkId <= _active_chunk_id.load(std::memory_order_acquire))
+      return true;
+    std::lock_guard<std::mutex> guard(_mutex);
+    while ((int64_t)chunkId > _active_chunk_id.load()) {
+      if (!_addNewChunk().is2xxOK()) return false;
+    }
+    return true;
+  }
   // generate the new chunk name
   inline std::string _genNewChunkName() {
     return fmt::format("{}/{}_{}.plog", _plog_meta.engine_path,
@@ -227,6 +290,7 @@ class PmemLog : public PmemEngine {
   std::atomic<uint64_t> _tail_offset{0};
 
   // record all the information of chunks
+  // reserved up to the capacity at init, so readers never see it reallocate
   std::vector<FileInfo> _chunk_list;
   std::mutex _mutex;
 
@@ -0,0 +1,66 @@
+//
+//  prefix_key_index.h
+//  PROJECT prefix_key_index
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace NKV {
+
+// Ordered map from variable length binary keys to 64 bit ids, kept in
+// blocks of sorted entries. Within a block every key only stores the bytes
+// that differ from the key before it, so encoded keys that share long
+// prefixes (tuples with the same leading fields) cost little memory.
+// Blocks are found by their first key; a block is decoded for a lookup and
+// re-encoded on insert, so both stay bounded by the block size.
+class PrefixKeyIndex {
+ public:
+  // a block is split in two once it holds this many keys
+  static constexpr uint32_t MAX_BLOCK_KEYS = 32;
+
+  // insert key with id if absent, returns the id of key and whether it was
+  // inserted
+  std::pair<uint64_t, bool> insert(const std::string &key, uint64_t id);
+  bool find(const std::string &key, uint64_t &id) const;
+  using Entry = std::pair<std::string, uint64_t>;
+
+  // at most limit keys with their ids from start on in key order, start
+  // itself excluded if exclusive
+  void scan(const std::string &start, bool exclusive, uint32_t limit,
+            std::vector<Entry> &entries) const;
+
+  size_t size() const;
+  // bytes held by the encoded blocks and their first keys
+  size_t memoryUsage() const;
+
+ private:
+  struct Block {
+    std::string data;
+    uint32_t count = 0;
+  };
+
+  static void _encode(const std::vector<Entry> &entries, size_t begin,
+                      size_t end, Block &block);
+  static void _decode(const Block &block, std::vector<Entry> &entries);
+  // the block key belongs to, the first one for keys before every block
+  std::map<std::string, Block>::iterator _blockOf(const std::string &key);
+  std::map<std::string, Block>::const_iterator _blockOf(
+      const std::string &key) const;
+
+  mutable std::shared_mutex _lock;
+  // first key -> block
+  std::map<std::string, Block> _blocks;
+  size_t _size = 0;
+};
+
+}  // namespace NKV
@@ -0,0 +1,108 @@
+//
+//  replication.h
+//  PROJECT replication
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "kv_type.h"
+#include "pmem_engine.h"
+#include "plog_iterator.h"
+
+namespace NKV {
+
+class NeoPMKV;
+
+// Every frame on the wire is a ReplicationFrame followed by size bytes of the
+// primary plog starting at startAddr. The follower answers each frame with the
+// plog offset (uint64_t) it has applied up to.
+struct ReplicationFrame {
+  PmemAddress startAddr;
+  uint32_t size;
+  uint32_t reserved;
+};
+
+// endpoints are "unix:/path/to/socket" or "tcp:host:port"
+int ConnectEndpoint(const std::string &endpoint);
+int ListenEndpoint(const std::string &endpoint);
+
+// Ships the plog of a primary to one follower. Records are batched into byte
+// ranges that end at a chunk boundary, so the follower lays them out in its
+// own chunks at the very same addresses.
+class ReplicationSender {
+ public:
+  ReplicationSender(PmemEngine *engine, std::string endpoint,
+                    PmemAddress start = 0, uint32_t max_batch_bytes = 1 << 20)
+      : _engine(engine),
+        _endpoint(endpoint),
+        _iter(engine, start),
+        _sentOffset(start),
+        _ackedOffset(start),
+        _maxBatchBytes(max_batch_bytes) {}
+  ~ReplicationSender() { stop(); }
+
+  // connect to the follower, retry until timeout
+  bool connect(std::chrono::milliseconds timeout = std::chrono::seconds(5));
+
+  // ship everything published so far, false if the follower is gone
+  bool shipOnce();
+
+  // keep shipping from a background thread until stop()
+  void start(uint64_t idle_micro = 100);
+  void stop();
+
+  // wait until the follower acknowledged everything up to offset
+  bool waitForAck(PmemAddress offset, std::chrono::milliseconds timeout);
+
+  PmemAddress getSentOffset() { return _sentOffset.load(); }
+  PmemAddress getAckedOffset() { return _ackedOffset.load(); }
+
+ private:
+  bool _sendBatch(PmemAddress start, uint32_t size);
+  void _ackLoop();
+
+  PmemEngine *_engine;
+  std::string _endpoint;
+  PlogIterator _iter;
+  int _fd = -1;
+  std::atomic<PmemAddress> _sentOffset;
+  std::atomic<PmemAddress> _ackedOffset;
+  uint32_t _maxBatchBytes;
+
+  std::atomic_bool _stopFlag{false};
+  std::thread _shipThread;
+  std::thread _ackThread;
+};
+
+// Receives plog ranges on a follower, mirrors them into its plog and updates
+// its indexes. The schemas must be created on the follower in the same order
+// as on the primary so that the schema ids match.
+class ReplicationReceiver {
+ public:
+  ReplicationReceiver(std::string endpoint) : _endpoint(endpoint) {}
+  ~ReplicationReceiver();
+
+  // bind the endpoint, can be called before forking a follower process
+  bool listen();
+  // the bound endpoint, with the actual port for "tcp:host:0"
+  std::string getEndpoint() { return _endpoint; }
+
+  // accept one primary and apply its stream until it disconnects
+  bool serve(NeoPMKV *kv);
+
+  PmemAddress getAppliedOffset() { return _appliedOffset.load(); }
+
+ private:
+  std::string _endpoint;
+  int _listenFd = -1;
+  std::atomic<PmemAddress> _appliedOffset{0};
+};
+
+}  // namespace NKV
@@ -0,0 +1,98 @@
+//
+//  scan_iterator.h
+//  PROJECT scan_iterator
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "epoch.h"
+#include "indexer.h"
+#include "kv_type.h"
+#include "table_handle.h"
+
+namespace NKV {
+
+class NeoPMKV;
+
+// primary key bounds and direction of a ScanIterator, the whole table by
+// default; [start, end) is startInclusive = true, endInclusive = false
+struct ScanRange {
+  uint64_t start = 0;
+  bool startInclusive = true;
+  uint64_t end = UINT64_MAX;
+  bool endInclusive = true;
+  // from the end bound down to the start bound
+  bool reverse = false;
+
+  // the same range with inclusive bounds, false if it is empty
+  bool toInclusive(uint64_t &lo, uint64_t &hi) const {
+    if ((!startInclusive && start == UINT64_MAX) ||
+        (!endInclusive && end == 0))
+      return false;
+    lo = startInclusive ? start : start + 1;
+    hi = endInclusive ? end : end - 1;
+    return lo <= hi;
+  }
+};
+
+// what a parallel scan hands each row to, called concurrently for different
+// partitions; the partitions are numbered in key order
+using ScanCallback =
+    std::function<void(uint32_t partition, uint64_t key, const Value &row)>;
+
+// Streaming scan over the rows of a table in primary key order. The index
+// is walked a batch of entries at a time and re-sought by key for the next
+// batch, so memory stays bounded and the epoch that keeps the entries alive
+// is only held for one batch. A row is only decoded when getValue asks for
+// it, into a buffer reused for every row.
+class ScanIterator {
+ public:
+  // index entries taken per batch
+  static constexpr uint32_t SCAN_BATCH = 64;
+
+  ScanIterator(NeoPMKV *kv, const TableHandle &table, const ScanRange &range);
+  ~ScanIterator() { _leaveEpoch(); }
+  ScanIterator(const ScanIterator &) = delete;
+  ScanIterator &operator=(const ScanIterator &) = delete;
+
+  bool Valid() const { return _pos < _batch.size(); }
+  void Next();
+
+  uint64_t getKey() const { return _batch[_pos]->first; }
+  // the full row, valid until Next; empty if it was removed since the
+  // batch was taken
+  const Value &getValue();
+
+ private:
+  void _refill();
+  void _refillForward();
+  void _refillReverse();
+  void _leaveEpoch();
+
+  NeoPMKV *_kv;
+  const TableHandle *_table;
+  // the keys left to scan, inclusive on both sides
+  uint64_t _lo = 0;
+  uint64_t _hi = 0;
+  bool _reverse;
+  bool _exhausted = false;
+
+  std::vector<IndexerIterator> _batch;
+  size_t _pos = 0;
+  Value _value;
+  bool _decoded = false;
+
+  EpochManager *_epochs;
+  uint64_t _epoch = 0;
+  bool _inEpoch = false;
+  // key distance a reverse batch looks back, adapted to the key density
+  uint64_t _stride = SCAN_BATCH;
+};
+
+}  // namespace NKV
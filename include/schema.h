@@ -33,6 +33,15 @@ enum RowType : uint16_t {
   FULL_FIELD = 0,
   FULL_DATA,
   PARTIAL_FIELD,
+  // plog only: carries the primary key of the row appended right behind it
+  ROW_KEY,
+  // plog only: the key of the preceding ROW_KEY record was removed
+  TOMBSTONE,
+  // plog only: the rest of the chunk is unused, continue at the next chunk
+  CHUNK_PADDING,
+  // plog only: like ROW_KEY, the row behind it is a compacted copy of the row
+  // at the address stored after the key
+  RELOCATED_KEY,
 };
 // Sequential Row format:
 // | Row Meta Head |  field0 content   |   field1 content |
@@ -59,6 +68,20 @@ inline RowMetaHead *RowMetaPtr(char *src) {
 }
 inline char *skipRowMeta(char *src) { return src + ROW_META_HEAD_SIZE; }
 
+// Keyed plog record format:
+// | Row Meta Head (ROW_KEY) |  primary key  | Row Meta Head |  row content  |
+//  <-------- 8B -------->    <---- 8B ---->  <---- 8B ---->
+// Every record starts at an address aligned to PLOG_RECORD_ALIGN, so the row
+// meta head can be published with a single 8B store
+const uint32_t ROW_KEY_RECORD_SIZE = ROW_META_HEAD_SIZE + sizeof(uint64_t);
+// | Row Meta Head (RELOCATED_KEY) |  primary key  |  old row address  | ...
+const uint32_t RELOCATED_KEY_RECORD_SIZE =
+    ROW_KEY_RECORD_SIZE + sizeof(PmemAddress);
+const uint32_t PLOG_RECORD_ALIGN = 8;
+inline uint64_t alignPlogRecord(uint64_t size) {
+  return (size + PLOG_RECORD_ALIGN - 1) & ~(uint64_t)(PLOG_RECORD_ALIGN - 1);
+}
+
 // Partial Row format
 // | Row Meta Head |  Partial  Row   Meta |  field0 content  |   field1 content
 // |
@@ -143,6 +166,9 @@ class Schema {
   SchemaId schemaId = ERRMASK;
   // the primary key field id
   uint32_t primaryKeyField = 0;
+  // the fields of a composite or string key, in key order
+  std::vector<uint32_t> keyFields;
+  bool encodedKey = false;
   // define the schema data size
   uint32_t size = 0;
   uint32_t allFieldSize = 0;
@@ -183,6 +209,16 @@ class Schema {
 
   SchemaId getSchemaId() const { return schemaId; }
 
+  uint32_t getPrimaryKeyField() const { return primaryKeyField; }
+
+  // key the rows by the encoded tuple of these fields, see KeyCodec
+  void setKeyFields(const std::vector<uint32_t> &fieldIds) {
+    keyFields = fieldIds;
+    encodedKey = true;
+  }
+  const std::vector<uint32_t> &getKeyFields() const { return keyFields; }
+  bool hasEncodedKey() const { return encodedKey; }
+
   uint32_t getSize() const { return size; }
 
   uint32_t getVersion() const { return latestVersion; }
@@ -0,0 +1,58 @@
+//
+//  secondary_index.h
+//  PROJECT secondary_index
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "field_type.h"
+#include "kv_type.h"
+#include "schema.h"
+
+namespace NKV {
+
+// Ordered index from the value of one fixed width field to the primary keys
+// of the rows holding it. Entries are (encoded value, primary key) pairs, so
+// rows with equal values sit together and a value range is one ordered walk.
+// Concurrent writers of the same key may leave a stale pair behind, so
+// readers check the field in the row before returning it.
+class SecondaryIndex {
+ public:
+  SecondaryIndex(Schema *schemaPtr, uint32_t fieldId);
+
+  // INT16T, INT32T, INT64T and STRING fields
+  static bool isIndexable(FieldType type);
+
+  uint32_t getFieldId() const { return _fieldId; }
+
+  // the field value as KeyCodec encodes it, byte order is value order
+  std::string encode(const Value &fieldValue) const;
+
+  void insert(const Value &fieldValue, uint64_t primaryKey);
+  void erase(const Value &fieldValue, uint64_t primaryKey);
+
+  // primary keys of the rows with low <= value <= high in value order,
+  // at most limit of them
+  void lookup(const Value &low, const Value &high,
+              std::vector<uint64_t> &primaryKeys,
+              uint32_t limit = UINT32_MAX) const;
+
+  size_t size() const;
+
+ private:
+  FieldType _type;
+  uint32_t _fieldId;
+  uint32_t _fieldSize;
+  mutable std::shared_mutex _lock;
+  std::set<std::pair<std::string, uint64_t>> _entries;
+};
+
+}  // namespace NKV
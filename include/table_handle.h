@@ -0,0 +1,47 @@
+//
+//  table_handle.h
+//  PROJECT table_handle
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "indexer.h"
+#include "schema.h"
+
+namespace NKV {
+
+class SchemaParser;
+class AdaptiveChainThreshold;
+class SecondaryIndex;
+class BufferListBySchema;
+class AsyncBufferQueue;
+struct AccessStatistics;
+
+// The per schema state an operation needs, resolved once when the schema is
+// created, so that reads and writes through a handle do no catalog lookups.
+// The pointers stay valid as long as the NeoPMKV that handed it out.
+struct TableHandle {
+  SchemaId schemaId = 0;
+  IndexerT *indexer = nullptr;
+  Schema *schema = nullptr;
+  SchemaParser *parser = nullptr;
+  AdaptiveChainThreshold *chainThreshold = nullptr;
+  std::vector<std::unique_ptr<SecondaryIndex>> *secondaryIndexes = nullptr;
+  // the fields of a row fit in its index entry, which keeps a copy of them
+  // next to the plog address; such rows are never cached in the PBRB
+  bool inlineRows = false;
+  // the head of every full row of the schema, the copy leaves it out
+  RowMetaHead inlineHead;
+  // PBRB part, nullptr if the PBRB is disabled
+  BufferListBySchema *bufferList = nullptr;
+  AccessStatistics *accessStat = nullptr;
+  // nullptr unless the PBRB writes asynchronously
+  AsyncBufferQueue *asyncQueue = nullptr;
+};
+
+}  // namespace NKV
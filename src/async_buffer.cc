@@ -16,12 +16,13 @@ AsyncBufferEntry::AsyncBufferEntry(uint32_t entry_size)
   _entryReady.store(false, std::memory_order_release);
 }
 
-bool AsyncBufferEntry::copyContent(TimeStamp oldTS, TimeStamp newTS,
+bool AsyncBufferEntry::copyContent(ValuePtr::State oldState, TimeStamp newTS,
                                    IndexerIterator iter, const Value &src) {
   if (_entryReady.load(std::memory_order_acquire) == false) {
-    _oldTS = oldTS;
+    _oldState = oldState;
     _newTS = newTS;
     _iter = iter;
+    _primaryKey = iter->first;
     memcpy((char *)_entry_content.data(), src.c_str(), _entry_size);
     // _entry_content.assign(src);
     _entryReady.store(true, std::memory_order_release);
@@ -45,15 +46,15 @@ AsyncBufferQueue::AsyncBufferQueue(uint32_t schema_id, uint32_t schema_size,
 }
 SchemaId AsyncBufferQueue::getSchemaId() { return _schema_id; }
 
-bool AsyncBufferQueue::EnqueueOneEntry(TimeStamp oldTS, TimeStamp newTS,
-                                       IndexerIterator iter,
+bool AsyncBufferQueue::EnqueueOneEntry(ValuePtr::State oldState,
+                                       TimeStamp newTS, IndexerIterator iter,
                                        const Value &value) {
   uint32_t allocated_offset =
       _enqueue_head.fetch_add(1, std::memory_order_relaxed);
   if (allocated_offset <
       _dequeue_tail.load(std::memory_order_relaxed) + _queue_size) {
     auto res = _queue_contents[allocated_offset % _queue_size]->copyContent(
-        oldTS, newTS, iter, value);
+        oldState, newTS, iter, value);
     // NKV_LOG_I(std::cout, "Enqueue Entry [{}]: {}", allocated_offset,
     // value);
     if (res == true) return true;
@@ -0,0 +1,190 @@
+//
+//  async_kv.cc
+//  PROJECT async_kv
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "async_kv.h"
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include "logging.h"
+#include "neopmkv.h"
+
+namespace NKV {
+
+uint32_t AsyncCompletionQueue::poll(std::vector<AsyncCompletion> &out,
+                                    uint32_t maxCount) {
+  uint32_t count = 0;
+  AsyncCompletion completion;
+  while (count < maxCount && _done.try_pop(completion)) {
+    out.push_back(std::move(completion));
+    count++;
+  }
+  _ready.fetch_sub(count);
+  _inflight.fetch_sub(count);
+  return count;
+}
+
+uint32_t AsyncCompletionQueue::wait(std::vector<AsyncCompletion> &out,
+                                    uint32_t minCount, uint32_t maxCount,
+                                    std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  uint32_t count = poll(out, maxCount);
+  while (count < minCount && count < maxCount) {
+    _waiters.fetch_add(1);
+    {
+      std::unique_lock<std::mutex> guard(_waitLock);
+      _waitCond.wait_until(guard, deadline, [this] { return _ready.load() > 0; });
+    }
+    _waiters.fetch_sub(1);
+    count += poll(out, maxCount - count);
+    if (std::chrono::steady_clock::now() >= deadline) break;
+  }
+  return count;
+}
+
+void AsyncCompletionQueue::_post(AsyncCompletion &&completion) {
+  _done.push(std::move(completion));
+  // pairs with the waiter bumping _waiters before it checks _ready
+  _ready.fetch_add(1);
+  if (_waiters.load() > 0) {
+    std::lock_guard<std::mutex> guard(_waitLock);
+    _waitCond.notify_all();
+  }
+}
+
+AsyncKV::AsyncKV(NeoPMKV *kv, uint32_t workerNum, uint32_t ringSize)
+    : _kv(kv) {
+  if (workerNum == 0) workerNum = 1;
+  for (uint32_t i = 0; i < workerNum; i++) {
+    _rings.push_back(std::make_unique<Ring>());
+    _rings.back()->set_capacity(ringSize);
+  }
+  uint32_t coreNum = std::max(std::thread::hardware_concurrency(), 1u);
+  for (uint32_t i = 0; i < workerNum; i++) {
+    _workers.emplace_back(&AsyncKV::_workerLoop, this, i);
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(i % coreNum, &cpus);
+    if (pthread_setaffinity_np(_workers.back().native_handle(), sizeof(cpus),
+                               &cpus) != 0)
+      NKV_LOG_I(std::cout, "AsyncKV: worker {} runs unpinned", i);
+  }
+}
+
+AsyncKV::~AsyncKV() {
+  // queued behind everything submitted so far, which still completes
+  for (auto &ring : _rings) ring->push(AsyncRequest());
+  for (auto &worker : _workers) worker.join();
+}
+
+bool AsyncKV::SubmitGet(const Key &key, AsyncCompletionQueue &cq,
+                        uint64_t userData) {
+  AsyncRequest request;
+  request.op = AsyncOp::GET;
+  request.key = key;
+  request.userData = userData;
+  request.cq = &cq;
+  return _submit(std::move(request));
+}
+
+bool AsyncKV::SubmitPut(const Key &key, const std::vector<Value> &fieldList,
+                        AsyncCompletionQueue &cq, uint64_t userData) {
+  AsyncRequest request;
+  request.op = AsyncOp::PUT;
+  request.key = key;
+  request.fields = fieldList;
+  request.userData = userData;
+  request.cq = &cq;
+  return _submit(std::move(request));
+}
+
+bool AsyncKV::SubmitPartialUpdate(const Key &key, const Value &fieldValue,
+                                  uint32_t fieldId, AsyncCompletionQueue &cq,
+                                  uint64_t userData) {
+  AsyncRequest request;
+  request.op = AsyncOp::PARTIAL_UPDATE;
+  request.key = key;
+  request.fields.push_back(fieldValue);
+  request.fieldId = fieldId;
+  request.userData = userData;
+  request.cq = &cq;
+  return _submit(std::move(request));
+}
+
+bool AsyncKV::_submit(AsyncRequest &&request) {
+  uint64_t hash = std::hash<uint64_t>()(request.key.primaryKey) ^
+                  ((uint64_t)request.key.schemaId << 48);
+  Ring &ring = *_rings[hash % _rings.size()];
+  AsyncCompletionQueue *cq = request.cq;
+  // counted first, a fast worker may post before try_push returns
+  cq->_inflight.fetch_add(1);
+  if (ring.try_push(std::move(request))) return true;
+  cq->_inflight.fetch_sub(1);
+  return false;
+}
+
+void AsyncKV::_workerLoop(uint32_t workerId) {
+  Ring &ring = *_rings[workerId];
+  std::vector<AsyncRequest> batch;
+  batch.reserve(WORKER_BATCH);
+  for (;;) {
+    batch.resize(1);
+    ring.pop(batch[0]);
+    AsyncRequest request;
+    while (batch.size() < WORKER_BATCH && batch.back().op != AsyncOp::STOP &&
+           ring.try_pop(request))
+      batch.push_back(std::move(request));
+    bool stop = batch.back().op == AsyncOp::STOP;
+    if (stop) batch.pop_back();
+    _runBatch(batch);
+    if (stop) return;
+  }
+}
+
+void AsyncKV::_runBatch(std::vector<AsyncRequest> &batch) {
+  size_t i = 0;
+  while (i < batch.size()) {
+    AsyncRequest &request = batch[i];
+    if (request.op == AsyncOp::GET) {
+      // only consecutive GETs, a write in between has to land first
+      size_t end = i + 1;
+      while (end < batch.size() && batch[end].op == AsyncOp::GET) end++;
+      _runGets(batch, i, end);
+      i = end;
+      continue;
+    }
+    AsyncCompletion completion;
+    completion.userData = request.userData;
+    completion.op = request.op;
+    if (request.op == AsyncOp::PUT) {
+      completion.status = _kv->Put(request.key, request.fields);
+    } else {
+      completion.status = _kv->PartialUpdate(request.key, request.fields[0],
+                                             request.fieldId);
+    }
+    request.cq->_post(std::move(completion));
+    i++;
+  }
+}
+
+void AsyncKV::_runGets(std::vector<AsyncRequest> &batch, size_t begin,
+                       size_t end) {
+  std::vector<Key> keys;
+  for (size_t i = begin; i < end; i++) keys.push_back(batch[i].key);
+  std::vector<Value> values;
+  _kv->MultiGet(keys, values);
+  for (size_t i = begin; i < end; i++) {
+    AsyncCompletion completion;
+    completion.userData = batch[i].userData;
+    completion.op = AsyncOp::GET;
+    completion.value = std::move(values[i - begin]);
+    completion.status = !completion.value.empty();
+    batch[i].cq->_post(std::move(completion));
+  }
+}
+
+}  // namespace NKV
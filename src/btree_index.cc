@@ -0,0 +1,454 @@
+//
+//  btree_index.cc
+//  PROJECT btree_index
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "btree_index.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+namespace NKV {
+
+static void backoff(uint32_t restartCount) {
+  if (restartCount < 16) {
+    _mm_pause();
+  } else {
+    std::this_thread::yield();
+  }
+}
+
+uint64_t BTreeIndex::OptLock::readLockOrRestart(bool &needRestart) const {
+  uint64_t version = typeVersionLockObsolete.load();
+  if (isLocked(version) || isObsolete(version)) {
+    _mm_pause();
+    needRestart = true;
+  }
+  return version;
+}
+
+void BTreeIndex::OptLock::upgradeToWriteLockOrRestart(uint64_t &version,
+                                                      bool &needRestart) {
+  if (typeVersionLockObsolete.compare_exchange_strong(version,
+                                                      version + 0b10)) {
+    version = version + 0b10;
+  } else {
+    _mm_pause();
+    needRestart = true;
+  }
+}
+
+uint16_t BTreeIndex::LeafNode::lowerBound(uint64_t key) const {
+  // count may be torn under an optimistic read, keep the search in bounds
+  uint16_t lower = 0, upper = std::min(count, MAX_ENTRIES);
+  while (lower < upper) {
+    uint16_t mid = (lower + upper) / 2;
+    if (keys[mid] < key) {
+      lower = mid + 1;
+    } else {
+      upper = mid;
+    }
+  }
+  return lower;
+}
+
+void BTreeIndex::LeafNode::insert(uint16_t pos, IndexEntry *entry) {
+  memmove(keys + pos + 1, keys + pos, sizeof(uint64_t) * (count - pos));
+  memmove(payloads + pos + 1, payloads + pos,
+          sizeof(IndexEntry *) * (count - pos));
+  keys[pos] = entry->first;
+  payloads[pos] = entry;
+  count++;
+}
+
+void BTreeIndex::LeafNode::erase(uint16_t pos) {
+  memmove(keys + pos, keys + pos + 1, sizeof(uint64_t) * (count - pos - 1));
+  memmove(payloads + pos, payloads + pos + 1,
+          sizeof(IndexEntry *) * (count - pos - 1));
+  count--;
+}
+
+BTreeIndex::LeafNode *BTreeIndex::LeafNode::split(uint64_t &sep,
+                                                  bool append) {
+  LeafNode *newLeaf = new LeafNode();
+  newLeaf->count = append ? 0 : count - count / 2;
+  count = count - newLeaf->count;
+  memcpy(newLeaf->keys, keys + count, sizeof(uint64_t) * newLeaf->count);
+  memcpy(newLeaf->payloads, payloads + count,
+         sizeof(IndexEntry *) * newLeaf->count);
+  newLeaf->next = next;
+  next = newLeaf;
+  sep = keys[count - 1];
+  return newLeaf;
+}
+
+uint16_t BTreeIndex::InnerNode::lowerBound(uint64_t key) const {
+  uint16_t lower = 0, upper = std::min<uint16_t>(count, MAX_ENTRIES - 1);
+  while (lower < upper) {
+    uint16_t mid = (lower + upper) / 2;
+    if (keys[mid] < key) {
+      lower = mid + 1;
+    } else {
+      upper = mid;
+    }
+  }
+  return lower;
+}
+
+void BTreeIndex::InnerNode::insert(uint64_t key, NodeBase *child) {
+  uint16_t pos = lowerBound(key);
+  memmove(keys + pos + 1, keys + pos, sizeof(uint64_t) * (count - pos + 1));
+  memmove(children + pos + 1, children + pos,
+          sizeof(NodeBase *) * (count - pos + 1));
+  // the split node keeps its slot for the lower half, child takes the upper
+  keys[pos] = key;
+  children[pos] = child;
+  std::swap(children[pos], children[pos + 1]);
+  count++;
+}
+
+BTreeIndex::InnerNode *BTreeIndex::InnerNode::split(uint64_t &sep) {
+  InnerNode *newInner = new InnerNode();
+  newInner->count = count - (count / 2);
+  count = count - newInner->count - 1;
+  sep = keys[count];
+  memcpy(newInner->keys, keys + count + 1,
+         sizeof(uint64_t) * (newInner->count + 1));
+  memcpy(newInner->children, children + count + 1,
+         sizeof(NodeBase *) * (newInner->count + 1));
+  return newInner;
+}
+
+BTreeIndex::BTreeIndex() : _root(new LeafNode()) {
+  _tailLeaf.store(static_cast<LeafNode *>(_root.load()));
+}
+
+BTreeIndex::~BTreeIndex() {
+  _freeNode(_root.load());
+}
+
+void BTreeIndex::_freeNode(NodeBase *node) {
+  if (node->type == NodeType::INNER) {
+    InnerNode *inner = static_cast<InnerNode *>(node);
+    for (uint16_t i = 0; i <= inner->count; i++) _freeNode(inner->children[i]);
+    delete inner;
+    return;
+  }
+  LeafNode *leaf = static_cast<LeafNode *>(node);
+  for (uint16_t i = 0; i < leaf->count; i++) delete leaf->payloads[i];
+  delete leaf;
+}
+
+void BTreeIndex::_makeRoot(uint64_t sep, NodeBase *left, NodeBase *right) {
+  InnerNode *inner = new InnerNode();
+  inner->count = 1;
+  inner->keys[0] = sep;
+  inner->children[0] = left;
+  inner->children[1] = right;
+  _root.store(inner);
+}
+
+BTreeIndex::LeafNode *BTreeIndex::_findLeaf(uint64_t key, uint64_t &version,
+                                            bool &needRestart) const {
+  NodeBase *node = _root.load();
+  version = node->readLockOrRestart(needRestart);
+  if (needRestart || node != _root.load()) {
+    needRestart = true;
+    return nullptr;
+  }
+  InnerNode *parent = nullptr;
+  uint64_t parentVersion = 0;
+  while (node->type == NodeType::INNER) {
+    InnerNode *inner = static_cast<InnerNode *>(node);
+    if (parent) {
+      parent->readUnlockOrRestart(parentVersion, needRestart);
+      if (needRestart) return nullptr;
+    }
+    parent = inner;
+    parentVersion = version;
+    node = inner->children[inner->lowerBound(key)];
+    inner->checkOrRestart(version, needRestart);
+    if (needRestart) return nullptr;
+    version = node->readLockOrRestart(needRestart);
+    if (needRestart) return nullptr;
+  }
+  if (parent) {
+    parent->readUnlockOrRestart(parentVersion, needRestart);
+    if (needRestart) return nullptr;
+  }
+  return static_cast<LeafNode *>(node);
+}
+
+bool BTreeIndex::_pastTail(uint64_t key) const {
+  LeafNode *tail = _tailLeaf.load(std::memory_order_acquire);
+  bool needRestart = false;
+  uint64_t version = tail->readLockOrRestart(needRestart);
+  if (needRestart) return false;
+  // the rightmost leaf holds every key above its lower fence
+  uint16_t count = std::min(tail->count, LeafNode::MAX_ENTRIES);
+  bool past = tail->next == nullptr && count > 0 && tail->keys[count - 1] < key;
+  tail->readUnlockOrRestart(version, needRestart);
+  return past && !needRestart;
+}
+
+bool BTreeIndex::_appendToTail(IndexEntry *entry) {
+  LeafNode *tail = _tailLeaf.load(std::memory_order_acquire);
+  bool needRestart = false;
+  uint64_t version = tail->readLockOrRestart(needRestart);
+  if (needRestart) return false;
+  uint16_t count = tail->count;
+  if (tail->next != nullptr || count == 0 || count >= LeafNode::MAX_ENTRIES ||
+      tail->keys[count - 1] >= entry->first)
+    return false;
+  // fails if the leaf changed since the checks above
+  tail->upgradeToWriteLockOrRestart(version, needRestart);
+  if (needRestart) return false;
+  tail->insert(count, entry);
+  tail->writeUnlock();
+  _size.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+IndexEntry *BTreeIndex::lookup(uint64_t key) const {
+  // a Put of the next growing key looks it up first
+  if (_pastTail(key)) return nullptr;
+  for (uint32_t restartCount = 0;; restartCount++) {
+    if (restartCount) backoff(restartCount);
+    bool needRestart = false;
+    uint64_t version;
+    LeafNode *leaf = _findLeaf(key, version, needRestart);
+    if (needRestart) continue;
+    uint16_t pos = leaf->lowerBound(key);
+    IndexEntry *entry = nullptr;
+    if (pos < leaf->count && leaf->keys[pos] == key) entry = leaf->payloads[pos];
+    leaf->readUnlockOrRestart(version, needRestart);
+    if (needRestart) continue;
+    return entry;
+  }
+}
+
+std::pair<IndexEntry *, bool> BTreeIndex::insert(IndexEntry *entry) {
+  uint64_t key = entry->first;
+  if (_appendToTail(entry)) return {entry, true};
+  for (uint32_t restartCount = 0;; restartCount++) {
+    if (restartCount) backoff(restartCount);
+    bool needRestart = false;
+    NodeBase *node = _root.load();
+    uint64_t version = node->readLockOrRestart(needRestart);
+    if (needRestart || node != _root.load()) continue;
+    InnerNode *parent = nullptr;
+    uint64_t parentVersion = 0;
+
+    // split full nodes eagerly on the way down, so that a split never has to
+    // propagate further than the locked parent
+    auto splitNode = [&](auto *full) {
+      if (parent) {
+        parent->upgradeToWriteLockOrRestart(parentVersion, needRestart);
+        if (needRestart) return;
+      }
+      full->upgradeToWriteLockOrRestart(version, needRestart);
+      if (needRestart) {
+        if (parent) parent->writeUnlock();
+        return;
+      }
+      if (parent == nullptr && full != _root.load()) {
+        // another thread grew the tree above us
+        full->writeUnlock();
+        return;
+      }
+      uint64_t sep;
+      NodeBase *newNode;
+      if constexpr (std::is_same_v<decltype(full), LeafNode *>) {
+        bool append =
+            full->next == nullptr && key > full->keys[full->count - 1];
+        newNode = full->split(sep, append);
+      } else {
+        newNode = full->split(sep);
+      }
+      if (parent) {
+        parent->insert(sep, newNode);
+      } else {
+        _makeRoot(sep, full, newNode);
+      }
+      full->writeUnlock();
+      if (parent) parent->writeUnlock();
+    };
+
+    while (node->type == NodeType::INNER) {
+      InnerNode *inner = static_cast<InnerNode *>(node);
+      if (inner->isFull()) {
+        splitNode(inner);
+        needRestart = true;
+        break;
+      }
+      if (parent) {
+        parent->readUnlockOrRestart(parentVersion, needRestart);
+        if (needRestart) break;
+      }
+      parent = inner;
+      parentVersion = version;
+      node = inner->children[inner->lowerBound(key)];
+      inner->checkOrRestart(version, needRestart);
+      if (needRestart) break;
+      version = node->readLockOrRestart(needRestart);
+      if (needRestart) break;
+    }
+    if (needRestart) continue;
+
+    LeafNode *leaf = static_cast<LeafNode *>(node);
+    uint16_t pos = leaf->lowerBound(key);
+    if (pos < leaf->count && leaf->keys[pos] == key) {
+      IndexEntry *existing = leaf->payloads[pos];
+      leaf->readUnlockOrRestart(version, needRestart);
+      if (needRestart) continue;
+      return {existing, false};
+    }
+    if (leaf->isFull()) {
+      splitNode(leaf);
+      continue;
+    }
+    leaf->upgradeToWriteLockOrRestart(version, needRestart);
+    if (needRestart) continue;
+    if (parent) {
+      parent->readUnlockOrRestart(parentVersion, needRestart);
+      if (needRestart) {
+        leaf->writeUnlock();
+        continue;
+      }
+    }
+    // the leaf did not change since the version we read, pos is still valid
+    leaf->insert(pos, entry);
+    if (leaf->next == nullptr)
+      _tailLeaf.store(leaf, std::memory_order_release);
+    leaf->writeUnlock();
+    _size.fetch_add(1, std::memory_order_relaxed);
+    return {entry, true};
+  }
+}
+
+IndexEntry *BTreeIndex::erase(uint64_t key, IndexEntry *expected) {
+  for (uint32_t restartCount = 0;; restartCount++) {
+    if (restartCount) backoff(restartCount);
+    bool needRestart = false;
+    uint64_t version;
+    LeafNode *leaf = _findLeaf(key, version, needRestart);
+    if (needRestart) continue;
+    uint16_t pos = leaf->lowerBound(key);
+    if (pos >= leaf->count || leaf->keys[pos] != key ||
+        (expected != nullptr && leaf->payloads[pos] != expected)) {
+      leaf->readUnlockOrRestart(version, needRestart);
+      if (needRestart) continue;
+      return nullptr;
+    }
+    leaf->upgradeToWriteLockOrRestart(version, needRestart);
+    if (needRestart) continue;
+    IndexEntry *entry = leaf->payloads[pos];
+    leaf->erase(pos);
+    leaf->writeUnlock();
+    _size.fetch_sub(1, std::memory_order_relaxed);
+    return entry;
+  }
+}
+
+bool BTreeIndex::seek(uint64_t key, bool exclusive, Cursor &cursor) const {
+  for (uint32_t restartCount = 0;; restartCount++) {
+    if (restartCount) backoff(restartCount);
+    bool needRestart = false;
+    uint64_t version;
+    LeafNode *leaf = _findLeaf(key, version, needRestart);
+    if (needRestart) continue;
+    uint16_t pos = leaf->lowerBound(key);
+    if (exclusive && pos < leaf->count && leaf->keys[pos] == key) pos++;
+    if (_scanFrom(leaf, version, pos, cursor)) return cursor.leaf != nullptr;
+  }
+}
+
+bool BTreeIndex::next(Cursor &cursor) const {
+  // not positioned yet, e.g. after a point lookup
+  if (cursor.leaf == nullptr) return seek(cursor.key, true, cursor);
+  if (_scanFrom(cursor.leaf, cursor.version, cursor.pos + 1, cursor))
+    return cursor.leaf != nullptr;
+  // the leaf changed under us, find the successor of the current key
+  return seek(cursor.key, true, cursor);
+}
+
+void BTreeIndex::splitKeys(uint32_t parts, std::vector<uint64_t> &keys) const {
+  for (uint32_t restartCount = 0;; restartCount++) {
+    if (restartCount) backoff(restartCount);
+    keys.clear();
+    bool needRestart = false;
+    NodeBase *root = _root.load();
+    uint64_t version = root->readLockOrRestart(needRestart);
+    if (needRestart) continue;
+    // a single leaf, nothing to cut
+    if (root->type == NodeType::LEAF) return;
+    InnerNode *inner = static_cast<InnerNode *>(root);
+    std::vector<NodeBase *> children(inner->children,
+                                     inner->children + inner->count + 1);
+    keys.assign(inner->keys, inner->keys + inner->count);
+    root->readUnlockOrRestart(version, needRestart);
+    if (needRestart) continue;
+    if (keys.size() + 1 < parts && children[0]->type == NodeType::INNER) {
+      // too coarse, take the separators one level down as well; nodes are
+      // never freed while the tree lives, so the children stay readable
+      std::vector<uint64_t> finer;
+      for (size_t i = 0; i < children.size() && !needRestart; i++) {
+        InnerNode *child = static_cast<InnerNode *>(children[i]);
+        uint64_t childVersion = child->readLockOrRestart(needRestart);
+        if (needRestart) break;
+        finer.insert(finer.end(), child->keys, child->keys + child->count);
+        child->readUnlockOrRestart(childVersion, needRestart);
+        if (i < keys.size()) finer.push_back(keys[i]);
+      }
+      if (needRestart) continue;
+      keys.swap(finer);
+    }
+    break;
+  }
+  if (parts == 0 || keys.size() < parts) return;
+  std::vector<uint64_t> picked;
+  for (uint32_t i = 1; i < parts; i++)
+    picked.push_back(keys[(uint64_t)i * keys.size() / parts]);
+  keys.swap(picked);
+}
+
+bool BTreeIndex::_scanFrom(LeafNode *leaf, uint64_t version, uint16_t pos,
+                           Cursor &cursor) const {
+  bool needRestart = false;
+  for (uint32_t restartCount = 0;; restartCount++) {
+    uint16_t count = std::min(leaf->count, LeafNode::MAX_ENTRIES);
+    uint64_t key = pos < count ? leaf->keys[pos] : 0;
+    IndexEntry *entry = pos < count ? leaf->payloads[pos] : nullptr;
+    LeafNode *sibling = leaf->next;
+    leaf->readUnlockOrRestart(version, needRestart);
+    if (needRestart) return false;
+    if (entry != nullptr) {
+      cursor.leaf = leaf;
+      cursor.pos = pos;
+      cursor.version = version;
+      cursor.key = key;
+      cursor.entry = entry;
+      return true;
+    }
+    if (sibling == nullptr) {
+      cursor.leaf = nullptr;
+      cursor.entry = nullptr;
+      return true;
+    }
+    // leaves are never freed, so the sibling can be read optimistically
+    for (version = sibling->readLockOrRestart(needRestart); needRestart;
+         version = sibling->readLockOrRestart(needRestart)) {
+      needRestart = false;
+      backoff(restartCount++);
+    }
+    leaf = sibling;
+    pos = 0;
+  }
+}
+
+}  // namespace NKV
@@ -41,33 +41,35 @@ void BufferListBySchema::setInfo(SchemaId schemaId, uint32_t pageSize,
   maxRowCnt = (pageSize - pageHeaderSize) / rowSize;
 }
 
+void BufferListBySchema::pushPage(BufferPage *pagePtr) {
+  BufferPage *head = headPage.load();
+  do {
+    pagePtr->setNextPage(head);
+  } while (!headPage.compare_exchange_weak(head, pagePtr));
+  curPageNum++;
+}
+
+void BufferListBySchema::unlinkPage(BufferPage *pagePtr) {
+  std::lock_guard<std::mutex> unlinkGuard(unlinkLock);
+  // pages are only pushed in front of the head, the rest of the list is
+  // changed by the holder of the lock alone
+  BufferPage *head = pagePtr;
+  if (!headPage.compare_exchange_strong(head, pagePtr->getNextPage())) {
+    BufferPage *prevPtr = head;
+    while (prevPtr != nullptr && prevPtr->getNextPage() != pagePtr)
+      prevPtr = prevPtr->getNextPage();
+    assert(prevPtr != nullptr);
+    if (prevPtr != nullptr) prevPtr->setNextPage(pagePtr->getNextPage());
+  }
+  // writers still on the page go on from its next page
+  pagePtr->setMagicPage(0);
+  curPageNum--;
+}
+
 bool BufferListBySchema::reclaimPage(
     oneapi::tbb::concurrent_bounded_queue<BufferPage *> &freePageList,
     BufferPage *pagePtr) {
-  // Case 1: head page
-  if (pagePtr == headPage) {
-    curPageNum--;
-    headPage = pagePtr->getNextPage();
-
-    // special: only 1 page now
-    if (headPage == nullptr) {
-      assert(curPageNum.load() == 0);
-      tailPage = nullptr;
-      freePageList.push(pagePtr);
-      return true;
-    }
-    headPage->setPrevPage(nullptr);
-  } else if (pagePtr == tailPage) {
-    curPageNum--;
-    tailPage = pagePtr->getPrevPage();
-    tailPage->setNextPage(nullptr);
-  } else {
-    curPageNum--;
-    BufferPage *prevPtr = pagePtr->getPrevPage();
-    BufferPage *nextPtr = pagePtr->getNextPage();
-    prevPtr->setNextPage(nextPtr);
-    nextPtr->setPrevPage(prevPtr);
-  }
+  unlinkPage(pagePtr);
   freePageList.push(pagePtr);
   return true;
 }
@@ -81,9 +83,9 @@ uint64_t BufferListBySchema::reclaimEmptyPages(
   BufferPage *nextPage = nullptr;
   for (BufferPage *pagePtr = headPage; pagePtr != nullptr; pagePtr = nextPage) {
     nextPage = pagePtr->getNextPage();
-    if (pagePtr->getHotRowsNumPage() == 0) continue;
+    if (pagePtr->sealPage() == false) continue;
     if (reclaimPage(freePageList, pagePtr)) reclaimedPageNum++;
   }
   return reclaimedPageNum;
 }
-}  // end of namespace NKV
\ No newline at end of file
+}  // end of namespace NKV
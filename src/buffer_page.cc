@@ -12,41 +12,74 @@
 namespace NKV {
 
 bool BufferPage::setRowBitMapPage(RowOffset rowOffset) {
-  if (isBitmapSet(rowOffset)) return false;
-  uint32_t byteIndex = rowOffset / 8;
-  uint32_t offset = rowOffset % 8;
-  ((PageHeader *)content)->occupancyBitmap.bitmap[byteIndex] |= 0x1 << offset;
-  setHotRowsNumPage(getHotRowsNumPage() + 1);
+  unsigned char bit = 0x1 << (rowOffset % 8);
+  if (__atomic_fetch_or(bitmapByte(rowOffset), bit, __ATOMIC_ACQ_REL) & bit)
+    return false;
+  __atomic_fetch_add(hotRowsField(), 1, __ATOMIC_RELAXED);
   return true;
 }
 
 bool BufferPage::clearRowBitMapPage(RowOffset rowOffset) {
-  if (!isBitmapSet(rowOffset)) return false;
-  uint32_t byteIndex = rowOffset / 8;
-  uint32_t offset = rowOffset % 8;
-  ((PageHeader *)content)->occupancyBitmap.bitmap[byteIndex] &=
-      ~(0x1 << offset);
-  setHotRowsNumPage(getHotRowsNumPage() - 1);
+  unsigned char bit = 0x1 << (rowOffset % 8);
+  if ((__atomic_fetch_and(bitmapByte(rowOffset), (unsigned char)~bit,
+                          __ATOMIC_ACQ_REL) &
+       bit) == 0)
+    return false;
+  __atomic_fetch_sub(hotRowsField(), 1, __ATOMIC_RELEASE);
   return true;
 }
 
 bool BufferPage::isBitmapSet(RowOffset rowOffset) {
-  uint32_t byteIndex = rowOffset / 8;
-  uint32_t offset = rowOffset % 8;
   uint8_t bit =
-      (((PageHeader *)content)->occupancyBitmap.bitmap[byteIndex] >> offset) &
+      (__atomic_load_n(bitmapByte(rowOffset), __ATOMIC_ACQUIRE) >>
+       (rowOffset % 8)) &
       1;
   if (bit)
     return true;
   else
     return false;
 }
+
+RowOffset BufferPage::claimRow(uint32_t maxRowNumOfPage, RowOffset hint) {
+  // reserve a row in the count first, every reserver then finds a free bit
+  uint32_t rows = getHotRowsNumPage();
+  do {
+    // a sealed page counts more rows than any page holds
+    if (rows >= maxRowNumOfPage) return UINT32_MAX;
+  } while (!__atomic_compare_exchange_n(hotRowsField(), &rows, rows + 1, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+  if (hint >= maxRowNumOfPage) hint = 0;
+  uint32_t byteNum = (maxRowNumOfPage - 1) / 8 + 1;
+  for (uint32_t i = 0;; i++) {
+    uint32_t byteIdx = (hint / 8 + i) % byteNum;
+    unsigned char *byte = bitmapByte(byteIdx * 8);
+    unsigned char used = __atomic_load_n(byte, __ATOMIC_RELAXED);
+    // rows past the end of the page are never free
+    if (byteIdx == byteNum - 1 && maxRowNumOfPage % 8 != 0)
+      used |= 0xFF << (maxRowNumOfPage % 8);
+    while (used != 0xFF) {
+      unsigned char bit = 0x1 << __builtin_ctz((unsigned char)~used);
+      used = __atomic_fetch_or(byte, bit, __ATOMIC_ACQ_REL);
+      if ((used & bit) == 0) return byteIdx * 8 + __builtin_ctz(bit);
+      if (byteIdx == byteNum - 1 && maxRowNumOfPage % 8 != 0)
+        used |= 0xFF << (maxRowNumOfPage % 8);
+    }
+  }
+}
+
+bool BufferPage::sealPage() {
+  uint32_t empty = 0;
+  return __atomic_compare_exchange_n(hotRowsField(), &empty, sealedPageRows,
+                                     false, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_RELAXED);
+}
+
 void BufferPage::initializePage() {
   // Memset May Cause Performance Problems.
   // Optimized to just clear the header and occuBitMap
   memset(content, 0, PBRB_PAGE_HEADER_SIZE);
   // memset(pagePtr, 0x00, sizeof(BufferPage));
-  setMagicPage(0x1010);
+  setMagicPage(livePageMagic);
   setSchemaIDPage(0);
   setHotRowsNumPage(0);
   setPrevPage(nullptr);
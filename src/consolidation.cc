@@ -0,0 +1,93 @@
+//
+//  consolidation.cc
+//  PROJECT consolidation
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "consolidation.h"
+#include <algorithm>
+#include <cmath>
+
+namespace NKV {
+
+void ChainTracker::addCandidate(SchemaId sid, uint64_t primaryKey) {
+  CandidateKey key{sid, primaryKey};
+  Shard &shard = _shardOf(key);
+  std::lock_guard<std::mutex> guard(shard.lock);
+  shard.readCounts.try_emplace(key, 0);
+}
+
+void ChainTracker::recordRead(SchemaId sid, uint64_t primaryKey) {
+  CandidateKey key{sid, primaryKey};
+  Shard &shard = _shardOf(key);
+  std::lock_guard<std::mutex> guard(shard.lock);
+  auto iter = shard.readCounts.find(key);
+  if (iter != shard.readCounts.end()) iter->second++;
+}
+
+void ChainTracker::popHottest(uint32_t maxCount,
+                              std::vector<ChainCandidate> &candidates) {
+  candidates.clear();
+  for (auto &shard : _shards) {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    for (auto &[key, reads] : shard.readCounts) {
+      candidates.push_back({key.first, key.second, reads});
+    }
+  }
+  if (candidates.size() > maxCount) {
+    std::nth_element(candidates.begin(), candidates.begin() + maxCount,
+                     candidates.end(),
+                     [](const ChainCandidate &a, const ChainCandidate &b) {
+                       return a.readCount > b.readCount;
+                     });
+    candidates.resize(maxCount);
+  }
+  for (auto &candidate : candidates) {
+    CandidateKey key{candidate.schemaId, candidate.primaryKey};
+    Shard &shard = _shardOf(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    shard.readCounts.erase(key);
+  }
+}
+
+size_t ChainTracker::size() {
+  size_t count = 0;
+  for (auto &shard : _shards) {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    count += shard.readCounts.size();
+  }
+  return count;
+}
+
+void AdaptiveChainThreshold::_retune() {
+  std::unique_lock<std::mutex> guard(_tuneLock, std::try_to_lock);
+  if (!guard.owns_lock()) return;
+  // halve the samples so that older windows fade out
+  auto decay = [](std::atomic<uint64_t> &counter) {
+    uint64_t value = counter.load();
+    counter.fetch_sub(value / 2);
+    return value;
+  };
+  uint64_t reads = decay(_chainReads);
+  uint64_t links = decay(_linksWalked);
+  uint64_t walkNanos = decay(_walkNanos);
+  uint64_t merges = decay(_merges);
+  uint64_t mergeNanos = decay(_mergeNanos);
+  uint64_t writes = decay(_windowWrites);
+  uint8_t maxThreshold = PARTIAL_CHAIN_HARD_LIMIT - 1;
+  // no read walked a chain: let chains grow
+  if (reads == 0 || links == 0) {
+    _threshold.store(maxThreshold);
+    return;
+  }
+  double linkCost = (double)walkNanos / links;
+  // without a measured merge, guess it as one more chain walk plus a row
+  double mergeCost = merges == 0 ? ((double)links / reads + 1) * linkCost
+                                 : (double)mergeNanos / merges;
+  double best = std::sqrt(2.0 * writes * mergeCost / (reads * linkCost));
+  _threshold.store((uint8_t)std::clamp(best, 0.0, (double)maxThreshold));
+}
+
+}  // namespace NKV
@@ -0,0 +1,84 @@
+//
+//  epoch.cc
+//  PROJECT epoch
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "epoch.h"
+#include <thread>
+
+namespace NKV {
+
+uint32_t EpochManager::_shardOfThread() {
+  thread_local uint32_t shard =
+      std::hash<std::thread::id>()(std::this_thread::get_id()) % READER_SHARDS;
+  return shard;
+}
+
+uint64_t EpochManager::enter() {
+  uint32_t shard = _shardOfThread();
+  for (;;) {
+    uint64_t epoch = _epoch.load();
+    _readers[epoch & 1][shard].count.fetch_add(1);
+    // the epoch moved on before we were counted, the advance may not have
+    // seen us, so count again in the new one
+    if (_epoch.load() == epoch) return epoch;
+    _readers[epoch & 1][shard].count.fetch_sub(1);
+  }
+}
+
+void EpochManager::exit(uint64_t epoch) {
+  _readers[epoch & 1][_shardOfThread()].count.fetch_sub(1);
+}
+
+void EpochManager::retire(std::function<void()> deleter) {
+  size_t pending;
+  {
+    std::lock_guard<std::mutex> guard(_limboLock);
+    _limbo[_epoch.load() & 1].push_back(std::move(deleter));
+    pending = _limbo[0].size() + _limbo[1].size();
+  }
+  if (pending >= RECLAIM_BATCH) tryReclaim();
+}
+
+size_t EpochManager::tryReclaim() {
+  std::vector<std::function<void()>> freed;
+  {
+    std::lock_guard<std::mutex> guard(_limboLock);
+    uint64_t epoch = _epoch.load();
+    // a reader of the previous epoch may still see what was retired in it;
+    // the readers of this epoch entered after that was unlinked
+    for (auto &reader : _readers[(epoch - 1) & 1]) {
+      if (reader.count.load() != 0) return 0;
+    }
+    freed.swap(_limbo[(epoch - 1) & 1]);
+    _epoch.store(epoch + 1);
+  }
+  // run the deleters outside the lock, they may retire again
+  for (auto &deleter : freed) deleter();
+  return freed.size();
+}
+
+void EpochManager::drain() {
+  for (;;) {
+    std::vector<std::function<void()>> freed;
+    {
+      std::lock_guard<std::mutex> guard(_limboLock);
+      if (_limbo[0].empty() && _limbo[1].empty()) return;
+      freed.swap(_limbo[0]);
+      freed.insert(freed.end(), std::make_move_iterator(_limbo[1].begin()),
+                   std::make_move_iterator(_limbo[1].end()));
+      _limbo[1].clear();
+    }
+    for (auto &deleter : freed) deleter();
+  }
+}
+
+size_t EpochManager::pendingCount() {
+  std::lock_guard<std::mutex> guard(_limboLock);
+  return _limbo[0].size() + _limbo[1].size();
+}
+
+}  // namespace NKV
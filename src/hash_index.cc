@@ -0,0 +1,221 @@
+//
+//  hash_index.cc
+//  PROJECT hash_index
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "hash_index.h"
+#include <immintrin.h>
+#include <cstring>
+
+namespace NKV {
+
+IndexEntry *const HashIndex::TOMBSTONE = reinterpret_cast<IndexEntry *>(1);
+
+HashIndex::Table::Table(uint64_t groupNum)
+    : groupNum(groupNum), groupMask(groupNum - 1), groups(groupNum) {
+  for (auto &group : groups) {
+    memset(group.ctrl, CTRL_EMPTY, GROUP_SLOTS);
+    for (auto &slot : group.slots) slot.store(nullptr);
+  }
+}
+
+HashIndex::HashIndex(bool ownEntries, EpochManager *epochs,
+                     uint64_t initGroups)
+    : _ownEntries(ownEntries), _epochs(epochs) {
+  uint64_t groupNum = 1;
+  while (groupNum < initGroups) groupNum <<= 1;
+  _table.store(new Table(groupNum));
+}
+
+HashIndex::~HashIndex() {
+  Table *table = _table.load();
+  if (_ownEntries) {
+    for (auto &group : table->groups) {
+      for (auto &slot : group.slots) {
+        IndexEntry *entry = slot.load();
+        if (entry != nullptr && entry != TOMBSTONE) delete entry;
+      }
+    }
+  }
+  delete table;
+  for (auto retired : _retiredTables) delete retired;
+}
+
+uint64_t HashIndex::_hash(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+void HashIndex::prefetch(uint64_t key) const {
+  const Table *table = _table.load(std::memory_order_acquire);
+  const Group &group = table->groups[(_hash(key) >> 7) & table->groupMask];
+  // the control bytes and the first slots share a line, the rest follow
+  __builtin_prefetch(&group, 0, 3);
+  __builtin_prefetch(reinterpret_cast<const char *>(&group) + 64, 0, 3);
+}
+
+IndexEntry *HashIndex::lookup(uint64_t key) const {
+  const Table *table = _table.load(std::memory_order_acquire);
+  uint64_t hash = _hash(key);
+  __m128i tag = _mm_set1_epi8(hash & 0x7F);
+  __m128i empty = _mm_set1_epi8((char)CTRL_EMPTY);
+  uint64_t groupId = (hash >> 7) & table->groupMask;
+  for (uint64_t probe = 0; probe <= table->groupMask; probe++) {
+    const Group &group = table->groups[groupId];
+    __m128i ctrl =
+        _mm_load_si128(reinterpret_cast<const __m128i *>(group.ctrl));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t matches = _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, tag));
+    while (matches) {
+      IndexEntry *entry = group.slots[__builtin_ctz(matches)].load();
+      if (entry != TOMBSTONE && entry->first == key) return entry;
+      matches &= matches - 1;
+    }
+    // a claimed slot gets its tag right after the CAS, so an empty control
+    // byte only ends the probe if the slot itself is still free
+    uint32_t empties = _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, empty));
+    bool chainEnd = false;
+    while (empties) {
+      IndexEntry *entry = group.slots[__builtin_ctz(empties)].load();
+      if (entry == nullptr) {
+        chainEnd = true;
+      } else if (entry != TOMBSTONE && entry->first == key) {
+        return entry;
+      }
+      empties &= empties - 1;
+    }
+    if (chainEnd) return nullptr;
+    groupId = (groupId + probe + 1) & table->groupMask;
+  }
+  return nullptr;
+}
+
+bool HashIndex::_insertInto(Table *table, IndexEntry *entry,
+                            IndexEntry *&existing) {
+  uint64_t key = entry->first;
+  uint64_t hash = _hash(key);
+  uint64_t groupId = (hash >> 7) & table->groupMask;
+  for (uint64_t probe = 0; probe <= table->groupMask; probe++) {
+    Group &group = table->groups[groupId];
+    for (uint32_t i = 0; i < GROUP_SLOTS; i++) {
+      IndexEntry *current = group.slots[i].load();
+      // slots are claimed in probe order and never freed, so the key cannot
+      // be stored past the first free slot
+      if (current == nullptr) {
+        if (group.slots[i].compare_exchange_strong(current, entry)) {
+          __atomic_store_n(&group.ctrl[i], (uint8_t)(hash & 0x7F),
+                           __ATOMIC_RELEASE);
+          table->used.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+      }
+      if (current != TOMBSTONE && current->first == key) {
+        existing = current;
+        return false;
+      }
+    }
+    groupId = (groupId + probe + 1) & table->groupMask;
+  }
+  existing = nullptr;
+  return false;
+}
+
+std::pair<IndexEntry *, bool> HashIndex::insert(IndexEntry *entry) {
+  for (;;) {
+    Table *table;
+    {
+      std::shared_lock<std::shared_mutex> guard(_resizeLock);
+      table = _table.load();
+      uint64_t capacity = table->groupNum * GROUP_SLOTS;
+      // grow at a load factor of 7/8, erased slots included
+      if ((table->used.load(std::memory_order_relaxed) + 1) * 8 <=
+          capacity * 7) {
+        IndexEntry *existing = nullptr;
+        if (_insertInto(table, entry, existing)) {
+          _size.fetch_add(1, std::memory_order_relaxed);
+          return {entry, true};
+        }
+        if (existing != nullptr) return {existing, false};
+      }
+    }
+    _grow(table);
+  }
+}
+
+void HashIndex::_grow(Table *oldTable) {
+  std::unique_lock<std::shared_mutex> guard(_resizeLock);
+  if (_table.load() != oldTable) return;
+  // mostly erased slots are reclaimed at the same size
+  uint64_t groupNum = oldTable->groupNum;
+  if (_size.load() * 2 >= oldTable->used.load()) groupNum *= 2;
+  Table *newTable = new Table(groupNum);
+  for (auto &group : oldTable->groups) {
+    for (auto &slot : group.slots) {
+      IndexEntry *entry = slot.load();
+      if (entry == nullptr || entry == TOMBSTONE) continue;
+      IndexEntry *existing = nullptr;
+      _insertInto(newTable, entry, existing);
+    }
+  }
+  _table.store(newTable, std::memory_order_release);
+  if (_epochs != nullptr) {
+    _epochs->retire([oldTable] { delete oldTable; });
+  } else {
+    _retiredTables.push_back(oldTable);
+  }
+}
+
+IndexEntry *HashIndex::erase(uint64_t key) {
+  std::shared_lock<std::shared_mutex> guard(_resizeLock);
+  Table *table = _table.load();
+  uint64_t hash = _hash(key);
+  uint64_t groupId = (hash >> 7) & table->groupMask;
+  for (uint64_t probe = 0; probe <= table->groupMask; probe++) {
+    Group &group = table->groups[groupId];
+    for (uint32_t i = 0; i < GROUP_SLOTS; i++) {
+      IndexEntry *current = group.slots[i].load();
+      if (current == nullptr) return nullptr;
+      if (current == TOMBSTONE || current->first != key) continue;
+      if (!group.slots[i].compare_exchange_strong(current, TOMBSTONE))
+        return nullptr;
+      __atomic_store_n(&group.ctrl[i], CTRL_DELETED, __ATOMIC_RELEASE);
+      _size.fetch_sub(1, std::memory_order_relaxed);
+      return current;
+    }
+    groupId = (groupId + probe + 1) & table->groupMask;
+  }
+  return nullptr;
+}
+
+bool HashIndex::_scanFrom(Table *table, uint64_t slot, Cursor &cursor) const {
+  uint64_t slotNum = table->groupNum * GROUP_SLOTS;
+  for (; slot < slotNum; slot++) {
+    IndexEntry *entry =
+        table->groups[slot / GROUP_SLOTS].slots[slot % GROUP_SLOTS].load();
+    if (entry == nullptr || entry == TOMBSTONE) continue;
+    cursor.table = table;
+    cursor.slot = slot;
+    cursor.entry = entry;
+    return true;
+  }
+  cursor.entry = nullptr;
+  return false;
+}
+
+bool HashIndex::first(Cursor &cursor) const {
+  return _scanFrom(_table.load(std::memory_order_acquire), 0, cursor);
+}
+
+bool HashIndex::next(Cursor &cursor) const {
+  if (cursor.table == nullptr) return false;
+  return _scanFrom(cursor.table, cursor.slot + 1, cursor);
+}
+
+}  // namespace NKV
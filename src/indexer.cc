@@ -0,0 +1,374 @@
+//
+//  indexer.cc
+//  PROJECT indexer
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "indexer.h"
+#include <thread>
+
+namespace NKV {
+
+IndexerT::iterator &IndexerT::iterator::operator++() {
+  _advance();
+  _skipRemoved();
+  return *this;
+}
+
+void IndexerT::iterator::_skipRemoved() {
+  while (_entry != nullptr && _entry->second.isRemoved()) _advance();
+}
+
+void IndexerT::iterator::_advance() {
+  if (_router != nullptr && _router->_mergesParts()) {
+    // the next key may be in any partition
+    uint64_t key = _entry->first;
+    *this = _router->_smallestOf(
+        [key](IndexerT &part) { return part.upper_bound(key); });
+    return;
+  }
+  switch (_owner->_type) {
+    case IndexType::SKIPLIST:
+      ++_skipIter;
+      _entry = _skipIter == _owner->_skipList->end() ? nullptr : &*_skipIter;
+      break;
+    case IndexType::HASH:
+      _entry = _owner->_hash->next(_hashCursor) ? _hashCursor.entry : nullptr;
+      break;
+    default:
+      _entry = _owner->_btree->next(_cursor) ? _cursor.entry : nullptr;
+      break;
+  }
+  if (_entry == nullptr && _router != nullptr)
+    *this = _router->_partBegin(_part + 1);
+}
+
+IndexerT::IndexerT(IndexType type, EpochManager *epochs,
+                   const IndexPartitioning &partitioning)
+    : _type(type), _epochs(epochs) {
+  if (partitioning.partNum() > 1) {
+    _partType = partitioning.type;
+    _rangeStarts = partitioning.rangeStarts;
+    for (uint32_t i = 0; i < partitioning.partNum(); i++)
+      _parts.push_back(std::make_unique<IndexerT>(type, epochs));
+    return;
+  }
+  switch (_type) {
+    case IndexType::SKIPLIST:
+      _skipList = std::make_unique<SkipListT>();
+      break;
+    case IndexType::BTREE:
+      _btree = std::make_unique<BTreeIndex>();
+      break;
+    case IndexType::HASH:
+      _hash = std::make_unique<HashIndex>(true, _epochs);
+      break;
+    case IndexType::HYBRID:
+      // the entries are shared, the B+tree frees them
+      _btree = std::make_unique<BTreeIndex>();
+      _hash = std::make_unique<HashIndex>(false, _epochs);
+      break;
+  }
+}
+
+IndexerT::iterator IndexerT::_fromSkipList(SkipListT::iterator skipIter) {
+  iterator iter;
+  iter._owner = this;
+  iter._skipIter = skipIter;
+  iter._entry = skipIter == _skipList->end() ? nullptr : &*skipIter;
+  return iter;
+}
+
+IndexerT::iterator IndexerT::_fromCursor(bool found,
+                                         const BTreeIndex::Cursor &cursor) {
+  iterator iter;
+  iter._owner = this;
+  iter._cursor = cursor;
+  iter._entry = found ? cursor.entry : nullptr;
+  return iter;
+}
+
+IndexerT::iterator IndexerT::_fromHashCursor(bool found,
+                                             const HashIndex::Cursor &cursor) {
+  iterator iter;
+  iter._owner = this;
+  iter._hashCursor = cursor;
+  iter._entry = found ? cursor.entry : nullptr;
+  return iter;
+}
+
+uint32_t IndexerT::_partOf(uint64_t key) const {
+  if (_partType == PartitionType::HASH) {
+    // consecutive keys land in different partitions
+    return ((key * 0x9E3779B97F4A7C15ull) >> 32) % _parts.size();
+  }
+  return std::upper_bound(_rangeStarts.begin(), _rangeStarts.end(), key) -
+         _rangeStarts.begin();
+}
+
+IndexerT::iterator IndexerT::_adopt(iterator iter, uint32_t part) const {
+  if (iter._entry == nullptr) return iterator();
+  iter._router = this;
+  iter._part = part;
+  return iter;
+}
+
+IndexerT::iterator IndexerT::_partBegin(uint32_t part) const {
+  for (; part < _parts.size(); part++) {
+    auto iter = _parts[part]->begin();
+    if (iter._entry != nullptr) return _adopt(iter, part);
+  }
+  return iterator();
+}
+
+IndexerT::iterator IndexerT::_smallestOf(
+    const std::function<iterator(IndexerT &)> &position) const {
+  iterator smallest;
+  for (uint32_t part = 0; part < _parts.size(); part++) {
+    auto iter = position(*_parts[part]);
+    if (iter._entry == nullptr) continue;
+    if (smallest._entry == nullptr || iter->first < smallest->first)
+      smallest = _adopt(iter, part);
+  }
+  return smallest;
+}
+
+void IndexerT::splitKeys(uint32_t parts, std::vector<uint64_t> &keys) const {
+  keys.clear();
+  if (_parts.empty()) {
+    if (_btree) _btree->splitKeys(parts, keys);
+    return;
+  }
+  if (_partType == PartitionType::HASH) {
+    // every partition holds a sample of the same key distribution
+    _parts[0]->splitKeys(parts, keys);
+    return;
+  }
+  uint32_t perPart = (parts + _parts.size() - 1) / _parts.size();
+  std::vector<uint64_t> partKeys;
+  for (uint32_t part = 0; part < _parts.size(); part++) {
+    _parts[part]->splitKeys(perPart, partKeys);
+    keys.insert(keys.end(), partKeys.begin(), partKeys.end());
+    if (part < _rangeStarts.size() && _rangeStarts[part] > 0)
+      keys.push_back(_rangeStarts[part] - 1);
+  }
+}
+
+IndexerT::iterator IndexerT::begin() {
+  if (!_parts.empty()) {
+    if (_mergesParts())
+      return _smallestOf([](IndexerT &part) { return part.begin(); });
+    return _partBegin(0);
+  }
+  iterator iter;
+  if (_type == IndexType::SKIPLIST) {
+    iter = _fromSkipList(_skipList->begin());
+  } else if (_type == IndexType::HASH) {
+    HashIndex::Cursor cursor;
+    bool found = _hash->first(cursor);
+    iter = _fromHashCursor(found, cursor);
+  } else {
+    BTreeIndex::Cursor cursor;
+    bool found = _btree->seekFirst(cursor);
+    iter = _fromCursor(found, cursor);
+  }
+  iter._skipRemoved();
+  return iter;
+}
+
+IndexerT::iterator IndexerT::find(uint64_t key) {
+  if (!_parts.empty()) {
+    uint32_t part = _partOf(key);
+    return _adopt(_parts[part]->find(key), part);
+  }
+  if (_type == IndexType::SKIPLIST) {
+    auto skipIter = _skipList->find(key);
+    if (skipIter != _skipList->end() && skipIter->second.isRemoved())
+      return end();
+    return _fromSkipList(skipIter);
+  }
+  // a point lookup leaves the cursor unpositioned until it is iterated
+  BTreeIndex::Cursor cursor;
+  cursor.key = key;
+  if (_type == IndexType::BTREE) {
+    cursor.entry = _btree->lookup(key);
+  } else {
+    cursor.entry = _hash->lookup(key);
+  }
+  if (cursor.entry != nullptr && cursor.entry->second.isRemoved()) return end();
+  if (_type == IndexType::HASH) {
+    // without an order there is nothing to continue from
+    return _fromHashCursor(cursor.entry != nullptr,
+                           HashIndex::Cursor{nullptr, 0, cursor.entry});
+  }
+  return _fromCursor(cursor.entry != nullptr, cursor);
+}
+
+IndexerT::iterator IndexerT::lower_bound(uint64_t key) {
+  if (_type == IndexType::HASH) return end();
+  if (!_parts.empty()) {
+    if (_mergesParts()) {
+      return _smallestOf(
+          [key](IndexerT &part) { return part.lower_bound(key); });
+    }
+    uint32_t part = _partOf(key);
+    auto iter = _parts[part]->lower_bound(key);
+    if (iter._entry == nullptr) return _partBegin(part + 1);
+    return _adopt(iter, part);
+  }
+  iterator iter;
+  if (_type == IndexType::SKIPLIST) {
+    iter = _fromSkipList(_skipList->lower_bound(key));
+  } else {
+    BTreeIndex::Cursor cursor;
+    bool found = _btree->seek(key, false, cursor);
+    iter = _fromCursor(found, cursor);
+  }
+  iter._skipRemoved();
+  return iter;
+}
+
+IndexerT::iterator IndexerT::upper_bound(uint64_t key) {
+  if (_type == IndexType::HASH) return end();
+  if (!_parts.empty()) {
+    if (_mergesParts()) {
+      return _smallestOf(
+          [key](IndexerT &part) { return part.upper_bound(key); });
+    }
+    uint32_t part = _partOf(key);
+    auto iter = _parts[part]->upper_bound(key);
+    if (iter._entry == nullptr) return _partBegin(part + 1);
+    return _adopt(iter, part);
+  }
+  iterator iter;
+  if (_type == IndexType::SKIPLIST) {
+    iter = _fromSkipList(_skipList->upper_bound(key));
+  } else {
+    BTreeIndex::Cursor cursor;
+    bool found = _btree->seek(key, true, cursor);
+    iter = _fromCursor(found, cursor);
+  }
+  iter._skipRemoved();
+  return iter;
+}
+
+std::pair<IndexerT::iterator, bool> IndexerT::insert(const value_type &entry) {
+  if (!_parts.empty()) {
+    uint32_t part = _partOf(entry.first);
+    auto [iter, inserted] = _parts[part]->insert(entry);
+    return {_adopt(iter, part), inserted};
+  }
+  if (_type == IndexType::SKIPLIST) {
+    for (;;) {
+      auto [skipIter, inserted] = _skipList->insert(entry);
+      if (inserted) return {_fromSkipList(skipIter), true};
+      if (skipIter->second.isRemoved() == false) {
+        return {_fromSkipList(skipIter), false};
+      }
+      // a removed entry stays linked, take it over for the new value
+      if (skipIter->second.revive(entry.second)) {
+        _removedNum.fetch_sub(1);
+        return {_fromSkipList(skipIter), true};
+      }
+    }
+  }
+  value_type *newEntry = new value_type(entry);
+  IndexEntry *current;
+  bool inserted;
+  for (;;) {
+    if (_type == IndexType::BTREE) {
+      std::tie(current, inserted) = _btree->insert(newEntry);
+    } else {
+      // the hash table decides which insert of a key wins
+      std::tie(current, inserted) = _hash->insert(newEntry);
+      if (inserted && _type == IndexType::HYBRID) {
+        // an erase of the key may still be unlinking the old entry
+        while (_btree->insert(newEntry).second == false) {
+          std::this_thread::yield();
+        }
+      }
+    }
+    // wait until an erase in progress has unlinked the removed entry
+    if (inserted || current->second.isRemoved() == false) break;
+    std::this_thread::yield();
+  }
+  if (!inserted) delete newEntry;
+  if (_type == IndexType::HASH) {
+    return {_fromHashCursor(true, HashIndex::Cursor{nullptr, 0, current}),
+            inserted};
+  }
+  BTreeIndex::Cursor cursor;
+  cursor.key = current->first;
+  cursor.entry = current;
+  return {_fromCursor(true, cursor), inserted};
+}
+
+void IndexerT::unsafe_erase(iterator iter) {
+  if (iter._entry == nullptr) return;
+  if (!_parts.empty()) return _parts[_partOf(iter->first)]->unsafe_erase(iter);
+  uint64_t key = iter._entry->first;
+  switch (_type) {
+    case IndexType::SKIPLIST:
+      _skipList->unsafe_erase(iter._skipIter);
+      break;
+    case IndexType::BTREE:
+      delete _btree->erase(key);
+      break;
+    case IndexType::HASH:
+      delete _hash->erase(key);
+      break;
+    case IndexType::HYBRID: {
+      IndexEntry *erased = _hash->erase(key);
+      if (erased == nullptr) break;
+      _btree->erase(key, erased);
+      delete erased;
+      break;
+    }
+  }
+}
+
+bool IndexerT::erase(iterator iter) {
+  if (iter._entry == nullptr) return false;
+  if (!_parts.empty()) return _parts[_partOf(iter->first)]->erase(iter);
+  // whoever marks it removed unlinks it
+  if (iter._entry->second.markRemoved() == false) return false;
+  uint64_t key = iter._entry->first;
+  IndexEntry *erased = iter._entry;
+  switch (_type) {
+    case IndexType::SKIPLIST:
+      _removedNum.fetch_add(1);
+      return true;
+    case IndexType::BTREE:
+      _btree->erase(key, erased);
+      break;
+    case IndexType::HASH:
+      _hash->erase(key);
+      break;
+    case IndexType::HYBRID:
+      _hash->erase(key);
+      _btree->erase(key, erased);
+      break;
+  }
+  if (_epochs != nullptr) {
+    _epochs->retire([erased] { delete erased; });
+  } else {
+    delete erased;
+  }
+  return true;
+}
+
+size_t IndexerT::size() const {
+  if (!_parts.empty()) {
+    size_t total = 0;
+    for (auto &part : _parts) total += part->size();
+    return total;
+  }
+  if (_type == IndexType::SKIPLIST)
+    return _skipList->size() - _removedNum.load();
+  if (_type == IndexType::HASH) return _hash->size();
+  return _btree->size();
+}
+
+}  // namespace NKV
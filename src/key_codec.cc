@@ -0,0 +1,58 @@
+//
+//  key_codec.cc
+//  PROJECT key_codec
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "key_codec.h"
+#include <algorithm>
+#include <cstring>
+
+namespace NKV {
+
+bool KeyCodec::isEncodable(FieldType type) {
+  return type == FieldType::INT16T || type == FieldType::INT32T ||
+         type == FieldType::INT64T || type == FieldType::STRING ||
+         type == FieldType::VARSTR;
+}
+
+void KeyCodec::encodeField(FieldType type, uint32_t fieldSize,
+                           const Value &fieldValue, std::string &out) {
+  if (type == FieldType::STRING || type == FieldType::VARSTR) {
+    size_t length = fieldValue.size();
+    // a fixed string is zero padded in the row, the padding is not part of it
+    if (type == FieldType::STRING) {
+      length = std::min<size_t>(length, fieldSize);
+      while (length > 0 && fieldValue[length - 1] == '\0') length--;
+    }
+    for (size_t i = 0; i < length; i++) {
+      out.push_back(fieldValue[i]);
+      if (fieldValue[i] == '\0') out.push_back('\xFF');
+    }
+    out.push_back('\0');
+    out.push_back('\x01');
+    return;
+  }
+  // little endian two's complement, cut or zero extended to the field size
+  std::string raw(fieldSize, '\0');
+  memcpy(raw.data(), fieldValue.data(),
+         std::min<size_t>(fieldValue.size(), fieldSize));
+  size_t begin = out.size();
+  out.append(raw.rbegin(), raw.rend());
+  out[begin] ^= 0x80;
+}
+
+std::string KeyCodec::encodeKey(Schema *schemaPtr,
+                                const std::vector<Value> &keyValues) {
+  std::string key;
+  auto &keyFields = schemaPtr->getKeyFields();
+  for (size_t i = 0; i < keyFields.size() && i < keyValues.size(); i++) {
+    encodeField(schemaPtr->getFieldType(keyFields[i]),
+                schemaPtr->getSize(keyFields[i]), keyValues[i], key);
+  }
+  return key;
+}
+
+}  // namespace NKV
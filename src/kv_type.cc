@@ -7,69 +7,207 @@
 
 
 #include "kv_type.h"
+#include <algorithm>
 #include <atomic>
 
 namespace NKV {
 
  // ValuePtr part
- ValuePtr::ValuePtr(PmemAddress pmAddr, TimeStamp ts) {
-    _pmemAddr = pmAddr;
-    _timestamp.store(ts, std::memory_order_release);
-    _isHot.store(false, std::memory_order_release);
+ ValuePtr::ValuePtr(PmemAddress pmAddr) {
+    _word[0] = _nextLo(0, pmAddr, 0, false);
   }
 
-  ValuePtr::ValuePtr(RowAddr rowAddr, TimeStamp ts) {
-    _pbrbAddr = rowAddr;
-    _timestamp.store(ts, std::memory_order_release);
-    _isHot.store(true, std::memory_order_release);
+  ValuePtr::ValuePtr(const ValuePtr &valuePtr) {
+    State state = valuePtr.getState();
+    _word[0] = state.lo;
+    // a hot copy would share the PBRB row, the copy starts cold
+    if (state.isHot()) {
+      _word[0] &= ~HOT_BIT;
+      return;
+    }
+    _copyInlineRow(valuePtr);
   }
 
-  ValuePtr::ValuePtr(const ValuePtr &valuePtr) {
-    _pmemAddr = valuePtr._pmemAddr;
-    _pbrbAddr = valuePtr._pbrbAddr;
-    _timestamp.store(valuePtr._timestamp, std::memory_order_release);
-    _isHot.store(valuePtr._isHot.load(std::memory_order_acquire),
-                 std::memory_order_release);
+  bool ValuePtr::_cas(State &expected, const State &desired) {
+    bool swapped;
+    __asm__ __volatile__("lock cmpxchg16b %1"
+                         : "=@ccz"(swapped), "+m"(_word), "+a"(expected.lo),
+                           "+d"(expected.hi)
+                         : "b"(desired.lo), "c"(desired.hi)
+                         : "memory");
+    return swapped;
   }
 
-  std::pair<bool, TimeStamp> ValuePtr::getHotStatus() const {
-    return {_isHot.load(std::memory_order_acquire),
-            _timestamp.load(std::memory_order_acquire)};
+  RowAddr ValuePtr::setFullColdPmemAddr(PmemAddress pmAddr) {
+    State state = getState();
+    State next;
+    do {
+      next.lo = _nextLo(state.lo, pmAddr, 0, false);
+      // the inline copy of an inline schema stays, its address tells it old
+      next.hi = state.isHot() ? 0 : state.hi;
+    } while (_cas(state, next) == false);
+    return state.getPBRBAddr();
   }
-  bool ValuePtr::isHot() const { return _isHot.load(std::memory_order_acquire); }
 
-  void ValuePtr::setFullColdPmemAddr(PmemAddress pmAddr, TimeStamp newTS) {
-    _pmemAddr = pmAddr;
-    _timestamp.store(newTS, std::memory_order_release);
-    _prevItemCount.store(0, std::memory_order_release);
-    _isHot.store(false, std::memory_order_release);
+  RowAddr ValuePtr::setPartialColdPmemAddr(PmemAddress pmAddr) {
+    State state = getState();
+    State next;
+    do {
+      uint8_t count = ((state.lo & COUNT_MASK) >> COUNT_SHIFT) + 1;
+      next.lo = _nextLo(state.lo, pmAddr, count, false);
+      next.hi = state.isHot() ? 0 : state.hi;
+    } while (_cas(state, next) == false);
+    return state.getPBRBAddr();
   }
 
-  void ValuePtr::setPartialColdPmemAddr(PmemAddress pmAddr, TimeStamp newTS) {
-    _pmemAddr = pmAddr;
-    _timestamp.store(newTS, std::memory_order_release);
-    _prevItemCount.fetch_add(1, std::memory_order_release);
-    _isHot.store(false, std::memory_order_release);
+  bool ValuePtr::relocatePmemAddr(const State &seen, PmemAddress newAddr) {
+    State state = getState();
+    State next;
+    do {
+      // an update, a remove or a promotion landed since
+      if (state.lo != seen.lo) return false;
+      next.lo = _nextLo(state.lo, newAddr, 0, state.isHot());
+      next.hi = state.hi;
+    } while (_cas(state, next) == false);
+    return true;
   }
 
+  RowAddr ValuePtr::evictToCold() {
+    State state = getState();
+    State next;
+    do {
+      if (state.isHot() == false) return nullptr;
+      next.lo = state.lo & ~HOT_BIT;
+      next.hi = 0;
+    } while (_cas(state, next) == false);
+    return state.getPBRBAddr();
+  }
 
-  void ValuePtr::evictToCold() { _isHot.store(false, std::memory_order_release); }
+  bool ValuePtr::markRemoved() {
+    State state = getState();
+    State next;
+    do {
+      if (state.getPmemAddr() == REMOVED_PMEM_ADDR) return false;
+      next.lo = _nextLo(state.lo, REMOVED_PMEM_ADDR,
+                        (state.lo & COUNT_MASK) >> COUNT_SHIFT, state.isHot());
+      next.hi = state.hi;
+    } while (_cas(state, next) == false);
+    return true;
+  }
 
-  bool ValuePtr::setHotTimeStamp(TimeStamp oldTS, TimeStamp newTS) {
-    if (_timestamp.compare_exchange_weak(oldTS, newTS) == false) {
-      return false;
-    }
-    _isHot.store(true, std::memory_order_release);
+  bool ValuePtr::revive(const ValuePtr &valuePtr) {
+    State state = getState();
+    State fresh = valuePtr.getState();
+    State next;
+    do {
+      if (state.getPmemAddr() != REMOVED_PMEM_ADDR || state.isHot())
+        return false;
+      next.lo = _nextLo(state.lo, fresh.getPmemAddr(), 0, false);
+      next.hi = 0;
+    } while (_cas(state, next) == false);
+    _copyInlineRow(valuePtr);
     return true;
   }
-  bool ValuePtr::setHotPBRBAddr(RowAddr rowAddr, TimeStamp oldTS, TimeStamp newTS) {
-    this->_pbrbAddr = rowAddr;
-    if (_timestamp.compare_exchange_weak(oldTS, newTS) == false) {
-      return false;
+
+  bool ValuePtr::setHotTimeStamp(const State &seen, TimeStamp newTS) {
+    State state = getState();
+    uint64_t tick = (uint64_t)_tickOf(newTS) << TICK_SHIFT;
+    for (;;) {
+      if (state.lo != seen.lo || state.isHot() == false ||
+          state.getPBRBAddr() != seen.getPBRBAddr())
+        return false;
+      if ((state.hi & ~ADDR_MASK) == tick) return true;
+      State next{state.lo, (state.hi & ADDR_MASK) | tick};
+      if (_cas(state, next)) return true;
+    }
+  }
+
+  bool ValuePtr::setHotPBRBAddr(RowAddr rowAddr, const State &seen,
+                                TimeStamp newTS) {
+    if (seen.isHot() || seen.getPmemAddr() == REMOVED_PMEM_ADDR) return false;
+    // the row, the address and the hot bit are published at once; a
+    // writer, a remove or another promotion since seen makes it fail
+    State expected = seen;
+    State next{seen.lo | HOT_BIT,
+               ((uint64_t)rowAddr & ADDR_MASK) |
+                   ((uint64_t)_tickOf(newTS) << TICK_SHIFT)};
+    return _cas(expected, next);
+  }
+
+  bool ValuePtr::accessedAfter(TimeStamp ts) const {
+    uint16_t tick = __atomic_load_n(&_word[1], __ATOMIC_RELAXED) >> TICK_SHIFT;
+    return (int16_t)(tick - _tickOf(ts)) > 0;
+  }
+
+  TimeStamp ValuePtr::getTimestamp() const {
+    TimeStamp ts;
+    if (isHot())
+      ts.txn_ticks = (__atomic_load_n(&_word[1], __ATOMIC_RELAXED) >>
+                      TICK_SHIFT)
+                     << ACCESS_TICK_SHIFT;
+    return ts;
+  }
+
+  void ValuePtr::setInlineRow(PmemAddress pmAddr, const char *row,
+                              uint32_t size) {
+    uint64_t words[2] = {0, 0};
+    memcpy(words, row, std::min(size, INLINE_ROW_SIZE));
+    // writers of one entry take turns, readers retry while the seq is odd
+    State state = getState();
+    State locked;
+    uint64_t seq;
+    do {
+      if (state.isHot()) return;
+      seq = state.hi >> TICK_SHIFT;
+      if ((seq & 1) != 0) {
+        state = getState();
+        continue;
+      }
+      locked = {state.lo, ((seq + 1) << TICK_SHIFT) | (pmAddr & ADDR_MASK)};
+      if (_cas(state, locked)) break;
+    } while (true);
+    _inlineRow[0].store(words[0], std::memory_order_relaxed);
+    _inlineRow[1].store(words[1], std::memory_order_relaxed);
+    // 0 means no copy, the seq skips it when it wraps
+    uint64_t done = (seq + 2) & 0xFFFF;
+    if (done == 0) done = 2;
+    State unlocked;
+    do {
+      unlocked = {locked.lo, (done << TICK_SHIFT) | (pmAddr & ADDR_MASK)};
+    } while (_cas(locked, unlocked) == false);
+  }
+
+  bool ValuePtr::_loadInlineRow(PmemAddress &addr, uint64_t *words) const {
+    for (;;) {
+      State state = getState();
+      uint64_t seq = state.hi >> TICK_SHIFT;
+      if (state.isHot() || seq == 0) return false;
+      if ((seq & 1) != 0) continue;
+      words[0] = _inlineRow[0].load(std::memory_order_relaxed);
+      words[1] = _inlineRow[1].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (__atomic_load_n(&_word[1], __ATOMIC_RELAXED) == state.hi) {
+        addr = state.hi & ADDR_MASK;
+        return true;
+      }
     }
-    _isHot.store(true, std::memory_order_release);
+  }
+
+  bool ValuePtr::readInlineRow(char *row, uint32_t size) const {
+    PmemAddress addr;
+    uint64_t words[2];
+    // a later write or a partial update moved the row on
+    if (_loadInlineRow(addr, words) == false || addr != getPmemAddr())
+      return false;
+    memcpy(row, words, std::min(size, INLINE_ROW_SIZE));
     return true;
   }
 
+  void ValuePtr::_copyInlineRow(const ValuePtr &valuePtr) {
+    PmemAddress addr;
+    uint64_t words[2];
+    if (valuePtr._loadInlineRow(addr, words))
+      setInlineRow(addr, (const char *)words, INLINE_ROW_SIZE);
+  }
 
 } // end of namespace NKV
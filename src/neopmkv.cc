@@ -7,8 +7,15 @@
 //
 
 #include "neopmkv.h"
+#include <oneapi/tbb/blocked_range.h>
+#include <oneapi/tbb/parallel_for.h>
+#include <oneapi/tbb/task_arena.h>
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <mutex>
+#include <numeric>
+#include <unordered_set>
 #include "buffer_page.h"
 #include "field_type.h"
 #include "kv_type.h"
@@ -21,16 +28,91 @@
 
 namespace NKV {
 
+static inline uint64_t elapsedNanos(
+    std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
 SchemaId NeoPMKV::CreateSchema(vector<SchemaField> fields,
-                               uint32_t primarykey_id, string name) {
+                               uint32_t primarykey_id, string name,
+                               IndexType indexType,
+                               const IndexPartitioning &partitioning) {
   Schema newSchema = _schemaAllocator.CreateSchema(name, primarykey_id, fields);
   _sMap.addSchema(newSchema);
   _sParser.insert({newSchema.getSchemaId(), new SchemaParser(_memPoolPtr)});
-  _indexerList.insert({newSchema.getSchemaId(), std::make_shared<IndexerT>()});
+  _indexerList.insert(
+      {newSchema.getSchemaId(),
+       std::make_shared<IndexerT>(indexType, &_epochs, partitioning)});
+  _chainThresholds.insert({newSchema.getSchemaId(),
+                           std::make_unique<AdaptiveChainThreshold>()});
   if (_enable_pbrb == true) {
     _pbrb->createCacheForSchema(newSchema.getSchemaId());
   }
-  return newSchema.getSchemaId();
+  // resolved once here, the maps above only change on DDL
+  SchemaId sid = newSchema.getSchemaId();
+  auto table = std::make_unique<TableHandle>();
+  table->schemaId = sid;
+  table->indexer = _indexerList[sid].get();
+  table->schema = _sMap.find(sid);
+  table->parser = _sParser[sid];
+  table->chainThreshold = _chainThresholds[sid].get();
+  table->secondaryIndexes = &_secondaryIndexes[sid];
+  Schema *schemaPtr = table->schema;
+  if (schemaPtr->hasVarField() == false &&
+      schemaPtr->getAllFieldSize() <= ValuePtr::INLINE_ROW_SIZE) {
+    table->inlineRows = true;
+    table->inlineHead.setMeta(schemaPtr->getAllFieldSize(), RowType::FULL_DATA,
+                              sid, schemaPtr->getVersion());
+  }
+  if (_enable_pbrb == true) _pbrb->resolveTable(*table);
+  _tables.insert({sid, std::move(table)});
+  return sid;
+}
+TableHandle *NeoPMKV::OpenTable(SchemaId sid) {
+  auto iter = _tables.find(sid);
+  if (iter == _tables.end()) {
+    NKV_LOG_E(std::cerr, "unknown schema {}", sid);
+    return nullptr;
+  }
+  return iter->second.get();
+}
+SchemaId NeoPMKV::CreateSchema(vector<SchemaField> fields,
+                               vector<uint32_t> keyFields, string name,
+                               IndexType indexType) {
+  if (keyFields.empty()) {
+    NKV_LOG_E(std::cerr, "schema {} needs at least one key field", name);
+    return 0;
+  }
+  for (auto fieldId : keyFields) {
+    if (fieldId >= fields.size() ||
+        KeyCodec::isEncodable(fields[fieldId].type) == false) {
+      NKV_LOG_E(std::cerr, "field {} of schema {} can not be a key field",
+                fieldId, name);
+      return 0;
+    }
+  }
+  SchemaId sid = CreateSchema(fields, keyFields[0], name, indexType);
+  _sMap.find(sid)->setKeyFields(keyFields);
+  _keySpaces.insert({sid, std::make_unique<EncodedKeySpace>()});
+  return sid;
+}
+void NeoPMKV::SetChainThreshold(SchemaId sid, uint8_t threshold) {
+  auto iter = _chainThresholds.find(sid);
+  if (iter == _chainThresholds.end()) return;
+  iter->second->setOverride(
+      std::min<uint8_t>(threshold, PARTIAL_CHAIN_HARD_LIMIT - 1));
+}
+void NeoPMKV::ResetChainThreshold(SchemaId sid) {
+  auto iter = _chainThresholds.find(sid);
+  if (iter == _chainThresholds.end()) return;
+  iter->second->setOverride(AdaptiveChainThreshold::NO_OVERRIDE);
+}
+uint8_t NeoPMKV::GetChainThreshold(SchemaId sid) {
+  auto iter = _chainThresholds.find(sid);
+  if (iter == _chainThresholds.end()) return PARTIAL_CHAIN_MERGE_THRESHOLD;
+  return iter->second->getThreshold();
 }
 // DML (data manipulation language)
 Schema *NeoPMKV::QuerySchema(SchemaId sid) { return _sMap.find(sid); }
@@ -47,26 +129,35 @@ SchemaVer NeoPMKV::DropField(SchemaId sid, SchemaId fieldId) {
 }
 
 bool NeoPMKV::getValueHelper(IndexerIterator &idxIter,
-                             shared_ptr<IndexerT> indexer, SchemaId schemaid,
-                             Value &value, uint32_t fieldId) {
-  if (idxIter == indexer->end()) {
+                             const TableHandle &table, Value &value,
+                             uint32_t fieldId) {
+  if (idxIter == table.indexer->end()) {
     return false;
   }
   ValuePtr &vPtr = idxIter->second;
-  auto [hotStatus, oldTS] = vPtr.getHotStatus();
+  char inlined[ROW_META_HEAD_SIZE + ValuePtr::INLINE_ROW_SIZE];
+  if (table.inlineRows && readInlineRow(table, vPtr, inlined)) {
+    if (fieldId == UINT32_MAX) {
+      value.assign(inlined,
+                   ROW_META_HEAD_SIZE + table.schema->getAllFieldSize());
+      return true;
+    }
+    return ValueReader(table.schema)
+        .ExtractFieldFromFullRow(inlined, fieldId, value);
+  }
+  auto [hotStatus, oldState] = vPtr.getHotStatus();
 
   // read from pbrb
   if (hotStatus == true) {
     NKV_LOG_D(std::cout, "Read value from PBRB");
-    _pbrb->schemaHit(schemaid);
+    _pbrb->schemaHit(table);
     // Read PBRB
-    TimeStamp newTS;
-    newTS.getNow();
+    TimeStamp newTS = _pbrb->accessStamp();
 
     POINT_PROFILE_START(_timer);
 
-    bool status = _pbrb->read(oldTS, newTS, vPtr.getPBRBAddr(), schemaid, value,
-                              &vPtr, fieldId);
+    bool status = _pbrb->read(oldState, newTS, oldState.getPBRBAddr(), table,
+                              value, &vPtr, fieldId);
     POINT_PROFILE_END(_timer);
     PROFILER_ATMOIC_ADD(_durationStat.pbrbReadCount, 1);
     PROFILER_ATMOIC_ADD(_durationStat.pbrbReadTimeNanoSecs, _timer.duration());
@@ -76,57 +167,83 @@ bool NeoPMKV::getValueHelper(IndexerIterator &idxIter,
   }
   // TODO: add the merge logic
   // Read PLog get a value
-  Schema *schemaPtr = _sMap.find(schemaid);
+  Schema *schemaPtr = table.schema;
   ValueReader valueReader(schemaPtr);
+  // count and address from one snapshot, a partial update between two loads
+  // would pair a full row count with a delta address
+  ValuePtr::State state = vPtr.getState();
+  uint8_t chainLength = state.getPrevItemCount();
+  PmemAddress chainAddr = state.getPmemAddr();
+  // removed since the lookup
+  if (chainAddr == ValuePtr::REMOVED_PMEM_ADDR) return false;
   POINT_PROFILE_START(pmem_timer);
   // read the full value
-  if (fieldId == UINT32_MAX) {
+  if (fieldId == UINT32_MAX && chainLength == 0) {
+    // straight into the caller's buffer, a reused one keeps its capacity
+    Status s = _engine_ptr->read(chainAddr, value);
+    assert(s.is2xxOK());
+  } else if (fieldId == UINT32_MAX) {
     Value v;
-    Status s = _engine_ptr->read(vPtr.getPmemAddr(), v);
-    if (vPtr.getPrevItemCount() != 0) {
-      vector<Value> allValues;
-      while (valueReader.ExtractRowTypeFromRow(v.data()) ==
-             RowType::PARTIAL_FIELD) {
-        allValues.push_back(v);
-        s = _engine_ptr->read(
-            valueReader.ExtractPrevRowFromPartialRow(v.data()), v);
-      }
+    Status s = _engine_ptr->read(chainAddr, v);
+    if (_bg_consolidation)
+      _chainTracker.recordRead(table.schemaId, idxIter->first);
+    auto walkStart = std::chrono::steady_clock::now();
+    vector<Value> allValues;
+    while (valueReader.ExtractRowTypeFromRow(v.data()) ==
+           RowType::PARTIAL_FIELD) {
       allValues.push_back(v);
-      SchemaParser::MergePartialUpdateToFullRow(schemaPtr, value, allValues);
-    } else {
-      value.assign(v);
+      s = _engine_ptr->read(
+          valueReader.ExtractPrevRowFromPartialRow(v.data()), v);
     }
+    allValues.push_back(v);
+    table.chainThreshold->recordChainRead(allValues.size() - 1,
+                                          elapsedNanos(walkStart));
+    SchemaParser::MergePartialUpdateToFullRow(schemaPtr, value, allValues);
+    if (_read_write_back)
+      writeBackMergedRow(table, idxIter->first, state, value);
     assert(s.is2xxOK());
   }
   // read the partial field
   if (fieldId != UINT32_MAX) {
-    Status s = _engine_ptr->read(vPtr.getPmemAddr(), value, schemaPtr, fieldId);
+    if (_bg_consolidation && chainLength != 0)
+      _chainTracker.recordRead(table.schemaId, idxIter->first);
+    auto walkStart = std::chrono::steady_clock::now();
+    Status s = _engine_ptr->read(chainAddr, value, schemaPtr, fieldId);
+    // the field may be found before the end of the chain, count it as walked
+    if (chainLength != 0)
+      table.chainThreshold->recordChainRead(chainLength,
+                                            elapsedNanos(walkStart));
     assert(s.is2xxOK());
   }
   POINT_PROFILE_END(pmem_timer);
   PROFILER_ATMOIC_ADD(_durationStat.pmemReadCount, 1);
   PROFILER_ATMOIC_ADD(_durationStat.pmemReadTimeNanoSecs,
                       pmem_timer.duration());
-  // disable pbrb
-  if (_enable_pbrb == false) {
-    return true;
-  }
   // only partial value
   if (fieldId != UINT32_MAX) {
     return true;
   }
+  // the next read of an inline table is served from the entry
+  if (table.inlineRows) {
+    inlineRow(table, vPtr, chainAddr, value);
+    return true;
+  }
+  // disable pbrb
+  if (_enable_pbrb == false) {
+    return true;
+  }
   TimeStamp newTs;
   newTs.getNow();
 
-  _pbrb->schemaMiss(schemaid);
+  _pbrb->schemaMiss(table);
 
   POINT_PROFILE_START(pbrb_timer);
   if (schemaPtr->hasVarField() == true) {
     std::string fixedValue = value;
-    auto i = _sParser[schemaid]->ParseFromSeqToTwoPart(schemaPtr, fixedValue);
-    bool status = _pbrb->write(oldTS, newTs, schemaid, fixedValue, idxIter);
+    auto i = table.parser->ParseFromSeqToTwoPart(schemaPtr, fixedValue);
+    bool status = _pbrb->write(oldState, newTs, table, fixedValue, idxIter);
   } else {
-    bool status = _pbrb->write(oldTS, newTs, schemaid, value, idxIter);
+    bool status = _pbrb->write(oldState, newTs, table, value, idxIter);
   }
 
   POINT_PROFILE_END(pbrb_timer);
@@ -137,39 +254,54 @@ bool NeoPMKV::getValueHelper(IndexerIterator &idxIter,
 }
 
 bool NeoPMKV::getValueHelper(IndexerIterator &idxIter,
-                             shared_ptr<IndexerT> indexer, SchemaId schemaid,
-                             vector<Value> &values, vector<uint32_t> &fields) {
-  if (idxIter == indexer->end()) {
+                             const TableHandle &table, vector<Value> &values,
+                             vector<uint32_t> &fields) {
+  if (idxIter == table.indexer->end()) {
     return false;
   }
   ValuePtr &vPtr = idxIter->second;
-  auto [hotStatus, oldTS] = vPtr.getHotStatus();
   values.resize(fields.size());
+  char inlined[ROW_META_HEAD_SIZE + ValuePtr::INLINE_ROW_SIZE];
+  if (table.inlineRows && readInlineRow(table, vPtr, inlined)) {
+    ValueReader valueReader(table.schema);
+    for (uint32_t i = 0; i < fields.size(); i++)
+      valueReader.ExtractFieldFromFullRow(inlined, fields[i], values[i]);
+    return true;
+  }
+  auto [hotStatus, oldState] = vPtr.getHotStatus();
   // read from pbrb
   if (hotStatus == true) {
     NKV_LOG_D(std::cout, "Read value from PBRB");
-    _pbrb->schemaHit(schemaid);
+    _pbrb->schemaHit(table);
     // Read PBRB
-    TimeStamp newTS;
-    newTS.getNow();
+    TimeStamp newTS = _pbrb->accessStamp();
 
     POINT_PROFILE_START(_timer);
 
-    bool status = _pbrb->read(oldTS, newTS, vPtr.getPBRBAddr(), schemaid,
+    bool status = _pbrb->read(oldState, newTS, oldState.getPBRBAddr(), table,
                               values, &vPtr, fields);
     POINT_PROFILE_END(_timer);
     PROFILER_ATMOIC_ADD(_durationStat.pbrbReadCount, 1);
     PROFILER_ATMOIC_ADD(_durationStat.pbrbReadTimeNanoSecs, _timer.duration());
-
-    return true;
+    if (status == true) {
+      return true;
+    }
   }
-  Schema *schemaPtr = _sMap.find(schemaid);
+  Schema *schemaPtr = table.schema;
   ValueReader valueReader(schemaPtr);
   // Read PLog get a value
   POINT_PROFILE_START(pmem_timer);
   Value allValue;
-  Status s = _engine_ptr->read(vPtr.getPmemAddr(), allValue);
-  if (vPtr.getPrevItemCount() != 0) {
+  ValuePtr::State state = vPtr.getState();
+  uint8_t chainLength = state.getPrevItemCount();
+  PmemAddress chainAddr = state.getPmemAddr();
+  // removed since the lookup
+  if (chainAddr == ValuePtr::REMOVED_PMEM_ADDR) return false;
+  Status s = _engine_ptr->read(chainAddr, allValue);
+  if (chainLength != 0) {
+    if (_bg_consolidation)
+      _chainTracker.recordRead(table.schemaId, idxIter->first);
+    auto walkStart = std::chrono::steady_clock::now();
     vector<Value> allValues;
     while (valueReader.ExtractRowTypeFromRow(allValue.data()) ==
            RowType::PARTIAL_FIELD) {
@@ -178,7 +310,11 @@ bool NeoPMKV::getValueHelper(IndexerIterator &idxIter,
           valueReader.ExtractPrevRowFromPartialRow(allValue.data()), allValue);
     }
     allValues.push_back(allValue);
+    table.chainThreshold->recordChainRead(allValues.size() - 1,
+                                          elapsedNanos(walkStart));
     SchemaParser::MergePartialUpdateToFullRow(schemaPtr, allValue, allValues);
+    if (_read_write_back)
+      writeBackMergedRow(table, idxIter->first, state, allValue);
   }
   POINT_PROFILE_END(pmem_timer);
   PROFILER_ATMOIC_ADD(_durationStat.pmemReadCount, 1);
@@ -187,20 +323,24 @@ bool NeoPMKV::getValueHelper(IndexerIterator &idxIter,
   for (uint32_t i = 0; i < fields.size(); i++)
     valueReader.ExtractFieldFromFullRow(allValue.data(), fields[i], values[i]);
 
+  if (table.inlineRows) {
+    inlineRow(table, vPtr, chainAddr, allValue);
+    return true;
+  }
   if (_enable_pbrb == false) {
     return true;
   }
   TimeStamp newTs;
   newTs.getNow();
 
-  _pbrb->schemaMiss(schemaid);
+  _pbrb->schemaMiss(table);
 
   POINT_PROFILE_START(pbrb_timer);
   if (schemaPtr->hasVarField() == true) {
-    _sParser[schemaid]->ParseFromSeqToTwoPart(schemaPtr, allValue);
-    bool status = _pbrb->write(oldTS, newTs, schemaid, allValue, idxIter);
+    table.parser->ParseFromSeqToTwoPart(schemaPtr, allValue);
+    bool status = _pbrb->write(oldState, newTs, table, allValue, idxIter);
   } else {
-    bool status = _pbrb->write(oldTS, newTs, schemaid, allValue, idxIter);
+    bool status = _pbrb->write(oldState, newTs, table, allValue, idxIter);
   }
   POINT_PROFILE_END(pbrb_timer);
   PROFILER_ATMOIC_ADD(_durationStat.pbrbWriteCount, 1);
@@ -209,12 +349,12 @@ bool NeoPMKV::getValueHelper(IndexerIterator &idxIter,
   return true;
 }
 bool NeoPMKV::updateFullValue(IndexerIterator &idxIter,
-                              shared_ptr<IndexerT> indexer, const Key &key,
+                              const TableHandle &table, const Key &key,
                               Value &newPartialValue) {
   ValuePtr &vPtr = idxIter->second;
-  auto [hotStatus, oldTS] = vPtr.getHotStatus();
+  auto [hotStatus, oldState] = vPtr.getHotStatus();
 
-  Schema *schemaPtr = _sMap.find(key.getSchemaId());
+  Schema *schemaPtr = table.schema;
   Value newFullValue;
   vector<Value> oldFullValues(2);
   oldFullValues[0] = newPartialValue;
@@ -222,28 +362,34 @@ bool NeoPMKV::updateFullValue(IndexerIterator &idxIter,
   // read from pbrb
   if (hotStatus == true) {
     NKV_LOG_D(std::cout, "Read value from PBRB");
-    _pbrb->schemaHit(key.getSchemaId());
+    _pbrb->schemaHit(table);
     // Read PBRB
-    TimeStamp newTS;
-    newTS.getNow();
+    TimeStamp newTS = _pbrb->accessStamp();
 
     POINT_PROFILE_START(_timer);
 
-    bool status = _pbrb->read(oldTS, newTS, vPtr.getPBRBAddr(),
-                              key.getSchemaId(), oldFullValues.back(), &vPtr);
+    bool status = _pbrb->read(oldState, newTS, oldState.getPBRBAddr(), table,
+                              oldFullValues.back(), &vPtr);
     POINT_PROFILE_END(_timer);
     PROFILER_ATMOIC_ADD(_durationStat.pbrbReadCount, 1);
     PROFILER_ATMOIC_ADD(_durationStat.pbrbReadTimeNanoSecs, _timer.duration());
-    SchemaParser::MergePartialUpdateToFullRow(schemaPtr, newFullValue,
-                                              oldFullValues);
-    return putExistedValue(idxIter, &vPtr, key, newFullValue, false);
+    // the row left the cache meanwhile, merge onto the plog copy instead
+    if (status == true) {
+      SchemaParser::MergePartialUpdateToFullRow(schemaPtr, newFullValue,
+                                                oldFullValues);
+      return putExistedValue(table, idxIter, &vPtr, key, newFullValue, false);
+    }
   }
   ValueReader valueReader(schemaPtr);
   // Read PLog get a value
   POINT_PROFILE_START(pmem_timer);
   Value allValue;
-  Status s = _engine_ptr->read(vPtr.getPmemAddr(), allValue);
-  if (vPtr.getPrevItemCount() != 0) {
+  ValuePtr::State state = vPtr.getState();
+  uint8_t chainLength = state.getPrevItemCount();
+  PmemAddress chainAddr = state.getPmemAddr();
+  if (chainAddr == ValuePtr::REMOVED_PMEM_ADDR) return false;
+  Status s = _engine_ptr->read(chainAddr, allValue);
+  if (chainLength != 0) {
     vector<Value> allValues;
     allValues.push_back(newPartialValue);
     while (valueReader.ExtractRowTypeFromRow(allValue.data()) ==
@@ -259,12 +405,46 @@ bool NeoPMKV::updateFullValue(IndexerIterator &idxIter,
   PROFILER_ATMOIC_ADD(_durationStat.pmemReadCount, 1);
   PROFILER_ATMOIC_ADD(_durationStat.pmemReadTimeNanoSecs,
                       pmem_timer.duration());
-  return putExistedValue(idxIter, &vPtr, key, allValue, false);
+  return putExistedValue(table, idxIter, &vPtr, key, allValue, false);
+}
+
+void NeoPMKV::inlineRow(const TableHandle &table, ValuePtr &vPtr,
+                        PmemAddress pmAddr, const Value &row) {
+  if (table.inlineRows == false ||
+      row.size() != ROW_META_HEAD_SIZE + table.schema->getAllFieldSize() ||
+      memcmp(row.data(), &table.inlineHead, ROW_META_HEAD_SIZE) != 0)
+    return;
+  vPtr.setInlineRow(pmAddr, row.data() + ROW_META_HEAD_SIZE,
+                    table.schema->getAllFieldSize());
+}
+
+bool NeoPMKV::readInlineRow(const TableHandle &table, const ValuePtr &vPtr,
+                            char *row) {
+  if (vPtr.readInlineRow(row + ROW_META_HEAD_SIZE,
+                         ValuePtr::INLINE_ROW_SIZE) == false)
+    return false;
+  memcpy(row, &table.inlineHead, ROW_META_HEAD_SIZE);
+  return true;
 }
 
 bool NeoPMKV::Get(Key &key, Value &value) {
+  TableHandle *table = OpenTable(key.getSchemaId());
+  return table != nullptr && Get(*table, key, value);
+}
+bool NeoPMKV::PartialGet(Key &key, Value &value, uint32_t field) {
+  TableHandle *table = OpenTable(key.getSchemaId());
+  return table != nullptr && PartialGet(*table, key, value, field);
+}
+bool NeoPMKV::MultiPartialGet(Key &key, vector<string> &value,
+                              const vector<uint32_t> fields) {
+  TableHandle *table = OpenTable(key.getSchemaId());
+  return table != nullptr && MultiPartialGet(*table, key, value, fields);
+}
+
+bool NeoPMKV::Get(const TableHandle &table, Key &key, Value &value) {
+  EpochGuard guard(_epochs);
   POINT_PROFILE_START(overall_timer);
-  auto indexer = _indexerList[key.getSchemaId()];
+  IndexerT *indexer = table.indexer;
 
   POINT_PROFILE_START(index_timer);
 
@@ -278,7 +458,7 @@ bool NeoPMKV::Get(Key &key, Value &value) {
   // NKV_LOG_I(std::cout, "key: {} value: {} valuePtr: {}", key, value,
   //           idxIter->second);
   POINT_PROFILE_START(get_timer);
-  bool status = getValueHelper(idxIter, indexer, key.getSchemaId(), value);
+  bool status = getValueHelper(idxIter, table, value);
 
   POINT_PROFILE_END(get_timer);
   PROFILER_ATMOIC_ADD(_durationStat.GetValueFromIteratorCount, 1);
@@ -292,9 +472,11 @@ bool NeoPMKV::Get(Key &key, Value &value) {
   return status;
 }
 
-bool NeoPMKV::PartialGet(Key &key, Value &value, uint32_t field) {
+bool NeoPMKV::PartialGet(const TableHandle &table, Key &key, Value &value,
+                         uint32_t field) {
+  EpochGuard guard(_epochs);
   POINT_PROFILE_START(overall_timer);
-  auto indexer = _indexerList[key.getSchemaId()];
+  IndexerT *indexer = table.indexer;
 
   POINT_PROFILE_START(index_timer);
 
@@ -308,8 +490,7 @@ bool NeoPMKV::PartialGet(Key &key, Value &value, uint32_t field) {
   // NKV_LOG_I(std::cout, "key: {} value: {} valuePtr: {}", key, value,
   //           idxIter->second);
   POINT_PROFILE_START(get_timer);
-  bool status =
-      getValueHelper(idxIter, indexer, key.getSchemaId(), value, field);
+  bool status = getValueHelper(idxIter, table, value, field);
 
   POINT_PROFILE_END(get_timer);
   PROFILER_ATMOIC_ADD(_durationStat.GetValueFromIteratorCount, 1);
@@ -323,11 +504,12 @@ bool NeoPMKV::PartialGet(Key &key, Value &value, uint32_t field) {
   return status;
 }
 
-bool NeoPMKV::MultiPartialGet(Key &key, vector<string> &value,
-                              vector<uint32_t> fields) {
+bool NeoPMKV::MultiPartialGet(const TableHandle &table, Key &key,
+                              vector<Value> &value, vector<uint32_t> fields) {
+  EpochGuard guard(_epochs);
   value.resize(fields.size());
   POINT_PROFILE_START(overall_timer);
-  auto indexer = _indexerList[key.getSchemaId()];
+  IndexerT *indexer = table.indexer;
 
   POINT_PROFILE_START(index_timer);
 
@@ -341,8 +523,7 @@ bool NeoPMKV::MultiPartialGet(Key &key, vector<string> &value,
   // NKV_LOG_I(std::cout, "key: {} value: {} valuePtr: {}", key, value,
   //           idxIter->second);
   POINT_PROFILE_START(get_timer);
-  bool status =
-      getValueHelper(idxIter, indexer, key.getSchemaId(), value, fields);
+  bool status = getValueHelper(idxIter, table, value, fields);
 
   POINT_PROFILE_END(get_timer);
   PROFILER_ATMOIC_ADD(_durationStat.GetValueFromIteratorCount, 1);
@@ -355,23 +536,111 @@ bool NeoPMKV::MultiPartialGet(Key &key, vector<string> &value,
                       overall_timer.duration());
   return status;
 }
+bool NeoPMKV::MultiGet(const vector<Key> &keys, vector<Value> &values) {
+  values.assign(keys.size(), Value());
+  // group the keys by schema, each group shares its table handle
+  vector<uint32_t> order(keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) {
+    return keys[a].getSchemaId() < keys[b].getSchemaId();
+  });
+  EpochGuard guard(_epochs);
+  bool allFound = true;
+  uint32_t begin = 0;
+  while (begin < order.size()) {
+    SchemaId sid = keys[order[begin]].getSchemaId();
+    uint32_t groupEnd = begin;
+    while (groupEnd < order.size() && keys[order[groupEnd]].getSchemaId() == sid)
+      groupEnd++;
+    TableHandle *table = OpenTable(sid);
+    for (; begin < groupEnd; begin += MULTI_GET_BATCH) {
+      uint32_t end = std::min<uint32_t>(begin + MULTI_GET_BATCH, groupEnd);
+      if (table == nullptr ||
+          !multiGetBatch(*table, keys, order, begin, end, values))
+        allFound = false;
+    }
+    begin = groupEnd;
+  }
+  return allFound;
+}
+
+bool NeoPMKV::multiGetBatch(const TableHandle &table, const vector<Key> &keys,
+                            const vector<uint32_t> &order, uint32_t begin,
+                            uint32_t end, vector<Value> &values) {
+  IndexerIterator iters[MULTI_GET_BATCH];
+  uint32_t count = end - begin;
+  // stage 1: start loading the index slots of every key
+  for (uint32_t i = 0; i < count; i++)
+    table.indexer->prefetch(keys[order[begin + i]].primaryKey);
+  // stage 2: probe, and start loading the row each entry points to
+  uint32_t rowSize = table.schema->getSize();
+  for (uint32_t i = 0; i < count; i++) {
+    iters[i] = table.indexer->find(keys[order[begin + i]].primaryKey);
+    if (iters[i] == table.indexer->end()) continue;
+    // the row is in the entry just loaded
+    if (table.inlineRows) continue;
+    ValuePtr &vPtr = iters[i]->second;
+    if (_pbrb != nullptr && vPtr.isHot()) {
+      _pbrb->prefetcht2Row(vPtr.getPBRBAddr(), PBRB_ROW_HEADER_SIZE + rowSize);
+      continue;
+    }
+    PmemAddress pmemAddr = vPtr.getPmemAddr();
+    if (pmemAddr == ValuePtr::REMOVED_PMEM_ADDR) continue;
+    char *record = _engine_ptr->convertToPtr(pmemAddr);
+    if (record == nullptr) continue;
+    for (uint32_t off = 0; off < ROW_META_HEAD_SIZE + rowSize; off += 64)
+      __builtin_prefetch(record + off, 0, 1);
+  }
+  // stage 3: read the rows, by now mostly in the caches
+  bool allFound = true;
+  for (uint32_t i = 0; i < count; i++) {
+    POINT_PROFILE_START(get_timer);
+    if (!getValueHelper(iters[i], table, values[order[begin + i]]))
+      allFound = false;
+    POINT_PROFILE_END(get_timer);
+    PROFILER_ATMOIC_ADD(_durationStat.GetValueFromIteratorCount, 1);
+    PROFILER_ATMOIC_ADD(_durationStat.GetValueFromIteratorTimeNanoSecs,
+                        get_timer.duration());
+  }
+  return allFound;
+}
+
 bool NeoPMKV::Put(const Key &key, Value &value) {
-  Schema *schemaPtr = _sMap.find(key.getSchemaId());
-  return putNewValue(key, value);
+  TableHandle *table = OpenTable(key.getSchemaId());
+  return table != nullptr && putNewValue(*table, key, value);
 }
 bool NeoPMKV::Put(const Key &key, vector<Value> &fieldList) {
-  Schema *schemaPtr = _sMap.find(key.getSchemaId());
-  std::string value = _sParser[key.getSchemaId()]->ParseFromUserWriteToSeq(
-      schemaPtr, fieldList);
-  return putNewValue(key, value);
+  TableHandle *table = OpenTable(key.getSchemaId());
+  return table != nullptr && Put(*table, key, fieldList);
+}
+bool NeoPMKV::Put(const TableHandle &table, const Key &key,
+                  vector<Value> &fieldList) {
+  std::string value =
+      table.parser->ParseFromUserWriteToSeq(table.schema, fieldList);
+  return putNewValue(table, key, value);
 }
 
-bool NeoPMKV::putNewValue(const Key &key, const Value &value) {
-  auto indexer = _indexerList[key.getSchemaId()];
+bool NeoPMKV::putNewValue(const TableHandle &table, const Key &key,
+                          const Value &value) {
+  EpochGuard guard(_epochs);
+  IndexerT *indexer = table.indexer;
+  vector<SecondaryChange> secChanges;
+  if (hasSecondary(table)) {
+    vector<uint32_t> fieldIds;
+    vector<Value> fieldValues;
+    secondaryFieldsOfRow(table, value, fieldIds, fieldValues);
+    auto oldIter = indexer->find(key.primaryKey);
+    PmemAddress oldAddr = oldIter == indexer->end()
+                              ? ValuePtr::REMOVED_PMEM_ADDR
+                              : oldIter->second.getPmemAddr();
+    prepareSecondary(table, key, oldAddr, fieldIds, fieldValues, secChanges);
+  }
 
   PmemAddress pmAddr;
   POINT_PROFILE_START(pmem_timer);
-  Status s = _engine_ptr->append(pmAddr, value.c_str(), value.size());
+  Status s = _engine_ptr->appendWithKey(pmAddr, key.getSchemaId(),
+                                        key.primaryKey, value.c_str(),
+                                        value.size());
 
   POINT_PROFILE_END(pmem_timer);
   PROFILER_ATMOIC_ADD(_durationStat.pmemWriteCount, 1);
@@ -379,9 +648,8 @@ bool NeoPMKV::putNewValue(const Key &key, const Value &value) {
                       pmem_timer.duration());
 
   if (!s.is2xxOK()) return false;
-  TimeStamp putTs;
-  putTs.getNow();
-  ValuePtr vPtr(pmAddr, putTs);
+  ValuePtr vPtr(pmAddr);
+  inlineRow(table, vPtr, pmAddr, value);
 
   // try to insert
 
@@ -394,35 +662,54 @@ bool NeoPMKV::putNewValue(const Key &key, const Value &value) {
                       index_timer.duration());
   // NKV_LOG_I(std::cout, "key: {} value: {} valuePtr: {}", key, value, vPtr);
   // status is true means insert success, we don't have the kv before
-  if (status == true) return true;
   // status is false means having the old kv
-  if (_enable_pbrb == true && iter->second.isHot() == true) {
-    _pbrb->dropRow(iter->second.getPBRBAddr(), _sMap.find(key.getSchemaId()));
+  if (status == false) {
+    retireHotRow(iter->second.setFullColdPmemAddr(pmAddr), table);
+    inlineRow(table, iter->second, pmAddr, value);
   }
-  iter->second.setFullColdPmemAddr(pmAddr, putTs);
-
+  commitSecondary(key, secChanges);
   return true;
 }
 
 bool NeoPMKV::PartialUpdate(Key &key, Value &fieldValue, uint32_t fieldId) {
-  Schema *schemaPtr = _sMap.find(key.getSchemaId());
+  TableHandle *table = OpenTable(key.getSchemaId());
+  return table != nullptr && PartialUpdate(*table, key, fieldValue, fieldId);
+}
+
+bool NeoPMKV::PartialUpdate(const TableHandle &table, Key &key,
+                            Value &fieldValue, uint32_t fieldId) {
+  EpochGuard guard(_epochs);
+  Schema *schemaPtr = table.schema;
   vector<Value> valueList = {fieldValue};
   vector<uint32_t> fieldList = {fieldId};
-  auto indexer = _indexerList[key.getSchemaId()];
+  IndexerT *indexer = table.indexer;
 
   IndexerIterator idxIter = indexer->find(key.primaryKey);
   if (idxIter == indexer->end()) {
     return false;
   }
   ValuePtr *vPtr = &idxIter->second;
-  PmemAddress oldPmemAddr = vPtr->getPmemAddr();
-
-  std::string pValue = _sParser[key.getSchemaId()]->ParseFromPartialUpdateToRow(
-      schemaPtr, vPtr->getPmemAddr(), valueList, fieldList);
-  if (vPtr->getPrevItemCount() <= 3) {
-    auto s = putExistedValue(idxIter, vPtr, key, pValue, true);
+  ValuePtr::State state = vPtr->getState();
+  PmemAddress oldPmemAddr = state.getPmemAddr();
+  if (oldPmemAddr == ValuePtr::REMOVED_PMEM_ADDR) return false;
+  vector<SecondaryChange> secChanges;
+  prepareSecondary(table, key, oldPmemAddr, fieldList, valueList, secChanges);
+
+  std::string pValue = table.parser->ParseFromPartialUpdateToRow(
+      schemaPtr, oldPmemAddr, valueList, fieldList);
+  uint8_t chainLength = state.getPrevItemCount();
+  // with the background worker, writers only append deltas up to a hard cap
+  AdaptiveChainThreshold *chainTuner = table.chainThreshold;
+  chainTuner->recordPartialWrite();
+  if (chainLength <= chainTuner->getThreshold() ||
+      (_bg_consolidation && chainLength < PARTIAL_CHAIN_HARD_LIMIT)) {
+    auto s = putExistedValue(table, idxIter, vPtr, key, pValue, true);
     if (s == false) return s;
-    if (_in_place_update_opt == false) return true;
+    commitSecondary(key, secChanges);
+    trackPartialChain(table, key, chainLength + 1);
+    // an inline copy is only current while its address is, it would miss
+    // a row rewritten in place
+    if (_in_place_update_opt == false || table.inlineRows) return true;
     // now we can do the in-place-update optimization
     if (schemaPtr->getFieldType(fieldId) == FieldType::VARSTR) {
       return true;
@@ -432,17 +719,30 @@ bool NeoPMKV::PartialUpdate(Key &key, Value &fieldValue, uint32_t fieldId) {
     if (iSize > schemaPtr->getSize(fieldId))
       iSize = schemaPtr->getSize(fieldId);
     _engine_ptr->write(oldPmemAddr + iOffset, fieldValue.data(), iSize);
-    vPtr->setFullColdPmemAddr(oldPmemAddr);
+    retireHotRow(vPtr->setFullColdPmemAddr(oldPmemAddr), table);
     return true;
   }
 
-  return updateFullValue(idxIter, indexer, key, pValue);
+  auto mergeStart = std::chrono::steady_clock::now();
+  bool status = updateFullValue(idxIter, table, key, pValue);
+  chainTuner->recordMerge(1, elapsedNanos(mergeStart));
+  if (status == true) commitSecondary(key, secChanges);
+  return status;
 }
 
 bool NeoPMKV::MultiPartialUpdate(Key &key, vector<Value> &fieldValues,
                                  vector<uint32_t> &fields) {
-  Schema *schemaPtr = _sMap.find(key.getSchemaId());
-  auto indexer = _indexerList[key.getSchemaId()];
+  TableHandle *table = OpenTable(key.getSchemaId());
+  return table != nullptr &&
+         MultiPartialUpdate(*table, key, fieldValues, fields);
+}
+
+bool NeoPMKV::MultiPartialUpdate(const TableHandle &table, Key &key,
+                                 vector<Value> &fieldValues,
+                                 vector<uint32_t> &fields) {
+  EpochGuard guard(_epochs);
+  Schema *schemaPtr = table.schema;
+  IndexerT *indexer = table.indexer;
 
   IndexerIterator idxIter = indexer->find(key.primaryKey);
   if (idxIter == indexer->end()) {
@@ -450,14 +750,27 @@ bool NeoPMKV::MultiPartialUpdate(Key &key, vector<Value> &fieldValues,
   }
 
   ValuePtr *vPtr = &idxIter->second;
-  PmemAddress oldPmemAddr = vPtr->getPmemAddr();
-
-  std::string pValue = _sParser[key.getSchemaId()]->ParseFromPartialUpdateToRow(
-      schemaPtr, vPtr->getPmemAddr(), fieldValues, fields);
-  if (vPtr->getPrevItemCount() <= 3) {
-    bool s = putExistedValue(idxIter, vPtr, key, pValue, true);
+  ValuePtr::State state = vPtr->getState();
+  PmemAddress oldPmemAddr = state.getPmemAddr();
+  if (oldPmemAddr == ValuePtr::REMOVED_PMEM_ADDR) return false;
+  vector<SecondaryChange> secChanges;
+  prepareSecondary(table, key, oldPmemAddr, fields, fieldValues, secChanges);
+
+  std::string pValue = table.parser->ParseFromPartialUpdateToRow(
+      schemaPtr, oldPmemAddr, fieldValues, fields);
+  uint8_t chainLength = state.getPrevItemCount();
+  // with the background worker, writers only append deltas up to a hard cap
+  AdaptiveChainThreshold *chainTuner = table.chainThreshold;
+  chainTuner->recordPartialWrite();
+  if (chainLength <= chainTuner->getThreshold() ||
+      (_bg_consolidation && chainLength < PARTIAL_CHAIN_HARD_LIMIT)) {
+    bool s = putExistedValue(table, idxIter, vPtr, key, pValue, true);
     if (s == false) return s;
-    if (_in_place_update_opt == false) return true;
+    commitSecondary(key, secChanges);
+    trackPartialChain(table, key, chainLength + 1);
+    // an inline copy is only current while its address is, it would miss
+    // a row rewritten in place
+    if (_in_place_update_opt == false || table.inlineRows) return true;
     // now we can do the in-place-update optimization
     for (auto i : fields) {
       if (schemaPtr->getFieldType(i) == FieldType::VARSTR) {
@@ -472,18 +785,25 @@ bool NeoPMKV::MultiPartialUpdate(Key &key, vector<Value> &fieldValues,
         iSize = schemaPtr->getSize(iFieldId);
       _engine_ptr->write(oldPmemAddr + iOffset, fieldValues[i].data(), iSize);
     }
-    vPtr->setFullColdPmemAddr(oldPmemAddr);
+    retireHotRow(vPtr->setFullColdPmemAddr(oldPmemAddr), table);
     return true;
   }
-  return updateFullValue(idxIter, indexer, key, pValue);
+  auto mergeStart = std::chrono::steady_clock::now();
+  bool status = updateFullValue(idxIter, table, key, pValue);
+  chainTuner->recordMerge(1, elapsedNanos(mergeStart));
+  if (status == true) commitSecondary(key, secChanges);
+  return status;
 }
 
-bool NeoPMKV::putExistedValue(IndexerIterator &idxIter, ValuePtr *vPtr,
+bool NeoPMKV::putExistedValue(const TableHandle &table,
+                              IndexerIterator &idxIter, ValuePtr *vPtr,
                               const Key &key, const Value &value,
                               bool isPartial) {
   PmemAddress pmAddr;
   POINT_PROFILE_START(pmem_timer);
-  Status s = _engine_ptr->append(pmAddr, value.c_str(), value.size());
+  Status s = _engine_ptr->appendWithKey(pmAddr, key.getSchemaId(),
+                                        key.primaryKey, value.c_str(),
+                                        value.size());
 
   POINT_PROFILE_END(pmem_timer);
   PROFILER_ATMOIC_ADD(_durationStat.pmemUpdateCount, 1);
@@ -491,42 +811,296 @@ bool NeoPMKV::putExistedValue(IndexerIterator &idxIter, ValuePtr *vPtr,
                       pmem_timer.duration());
 
   if (!s.is2xxOK()) return false;
-  TimeStamp putTs;
-  putTs.getNow();
 
   // NKV_LOG_I(std::cout, "key: {} value: {} valuePtr: {}", key, value, vPtr);
   // status is true means insert success, we don't have the kv before
   // status is false means having the old kv
-  if (_enable_pbrb == true && idxIter->second.isHot() == true) {
-    _pbrb->dropRow(idxIter->second.getPBRBAddr(),
-                   _sMap.find(key.getSchemaId()));
-  }
   if (isPartial == true) {
-    vPtr->setPartialColdPmemAddr(pmAddr, putTs);
+    retireHotRow(vPtr->setPartialColdPmemAddr(pmAddr), table);
   } else {
-    vPtr->setFullColdPmemAddr(pmAddr, putTs);
+    retireHotRow(vPtr->setFullColdPmemAddr(pmAddr), table);
+    inlineRow(table, *vPtr, pmAddr, value);
   }
 
   return true;
 }
 bool NeoPMKV::Remove(Key &key) {
-  auto indexer = _indexerList[key.getSchemaId()];
+  TableHandle *table = OpenTable(key.getSchemaId());
+  return table != nullptr && Remove(*table, key);
+}
+
+bool NeoPMKV::Remove(const TableHandle &table, Key &key) {
+  EpochGuard guard(_epochs);
+  IndexerT *indexer = table.indexer;
 
   IndexerIterator idxIter = indexer->find(key.primaryKey);
   if (idxIter == indexer->end()) {
     return false;
   }
-  bool isHot = idxIter->second.isHot();
-  if (isHot) {
-    _pbrb->dropRow(idxIter->second.getPBRBAddr(),
-                   _sMap.find(key.getSchemaId()));
+  // leave a tombstone so that the change stream sees the removal
+  RowMetaHead tombstone;
+  tombstone.setMeta(0, RowType::TOMBSTONE, key.getSchemaId(),
+                    table.schema->getVersion());
+  PmemAddress tombAddr;
+  Status s = _engine_ptr->appendWithKey(tombAddr, key.getSchemaId(),
+                                        key.primaryKey, (char *)&tombstone,
+                                        ROW_META_HEAD_SIZE);
+  if (!s.is2xxOK()) return false;
+  vector<SecondaryChange> secChanges;
+  if (hasSecondary(table)) {
+    vector<uint32_t> fieldIds;
+    for (auto &secIdx : *table.secondaryIndexes)
+      fieldIds.push_back(secIdx->getFieldId());
+    prepareSecondary(table, key, idxIter->second.getPmemAddr(), fieldIds, {},
+                     secChanges);
+  }
+  // readers that found the entry keep it until they leave their epoch
+  if (indexer->erase(idxIter) == false) return false;
+  commitSecondary(key, secChanges);
+  // after the removal, so that a racing PBRB write either sees it or
+  // leaves its row to be dropped here
+  retireHotRow(idxIter->second.evictToCold(), table);
+  return true;
+}
+
+void NeoPMKV::retireHotRow(RowAddr rowAddr, const TableHandle &table) {
+  // only the thread whose state swap took the row out of the entry drops it
+  if (rowAddr == nullptr) return;
+  Schema *schemaPtr = table.schema;
+  _epochs.retire([this, rowAddr, schemaPtr] {
+    _pbrb->dropRow(rowAddr, schemaPtr);
+  });
+}
+
+bool NeoPMKV::ApplyReplicatedRange(PmemAddress addr, const char *data,
+                                   uint32_t size) {
+  EpochGuard guard(_epochs);
+  Status s = _engine_ptr->replicate(addr, data, size);
+  if (!s.is2xxOK()) return false;
+  PlogIterator iter(_engine_ptr, addr);
+  PlogRecord record;
+  while (iter.getPosition() < addr + size && iter.Next(record)) {
+    if (record.hasKey == false) continue;
+    if (!applyReplicatedRecord(record)) return false;
+  }
+  return true;
+}
+
+bool NeoPMKV::applyReplicatedRecord(PlogRecord &record) {
+  auto tableIter = _tables.find(record.schemaId);
+  if (tableIter == _tables.end()) {
+    NKV_LOG_E(std::cerr, "replicated row of unknown schema {}",
+              record.schemaId);
+    return false;
+  }
+  const TableHandle &table = *tableIter->second;
+  IndexerT *indexer = table.indexer;
+  IndexerIterator idxIter = indexer->find(record.primaryKey);
+  bool existed = idxIter != indexer->end();
+  if (record.relocated) {
+    // a compacted copy only wins if nothing changed the key since
+    if (existed) {
+      ValuePtr &vPtr = idxIter->second;
+      retireHotRow(vPtr.evictToCold(), table);
+      ValuePtr::State state = vPtr.getState();
+      if (state.getPmemAddr() == record.relocatedFrom)
+        vPtr.relocatePmemAddr(state, record.rowAddr);
+    }
+    return true;
+  }
+  switch (record.type) {
+    case RowType::TOMBSTONE:
+      if (existed && indexer->erase(idxIter))
+        retireHotRow(idxIter->second.evictToCold(), table);
+      return true;
+    case RowType::PARTIAL_FIELD:
+      // a partial row always follows the row it was merged against
+      if (!existed) return false;
+      retireHotRow(idxIter->second.setPartialColdPmemAddr(record.rowAddr),
+                   table);
+      return true;
+    default:
+      if (!existed) {
+        indexer->insert({record.primaryKey, ValuePtr(record.rowAddr)});
+      } else {
+        retireHotRow(idxIter->second.setFullColdPmemAddr(record.rowAddr),
+                     table);
+      }
+      return true;
+  }
+}
+
+bool NeoPMKV::readMergedRow(PmemAddress pmemAddr, Schema *schemaPtr,
+                            Value &value) {
+  ValueReader valueReader(schemaPtr);
+  Status s = _engine_ptr->read(pmemAddr, value);
+  if (!s.is2xxOK()) return false;
+  if (valueReader.ExtractRowTypeFromRow(value.data()) != RowType::PARTIAL_FIELD)
+    return true;
+  vector<Value> allValues;
+  while (valueReader.ExtractRowTypeFromRow(value.data()) ==
+         RowType::PARTIAL_FIELD) {
+    allValues.push_back(value);
+    s = _engine_ptr->read(valueReader.ExtractPrevRowFromPartialRow(value.data()),
+                          value);
+    if (!s.is2xxOK()) return false;
+  }
+  allValues.push_back(value);
+  return SchemaParser::MergePartialUpdateToFullRow(schemaPtr, value, allValues);
+}
+
+bool NeoPMKV::Compact(SchemaId sid, uint32_t batchRows) {
+  EpochGuard guard(_epochs);
+  TableHandle *table = OpenTable(sid);
+  if (table == nullptr) return false;
+  IndexerT *indexer = table->indexer;
+  Schema *schemaPtr = table->schema;
+
+  vector<uint64_t> keys;
+  vector<ValuePtr::State> seen;
+  vector<Value> rows;
+  uint64_t relocated = 0;
+  // the indexer is ordered, so every batch lands in key order in the plog
+  for (auto iter = indexer->begin(); iter != indexer->end(); iter++) {
+    ValuePtr::State state = iter->second.getState();
+    // removed, the entry only waits for its reclamation
+    if (state.getPmemAddr() == ValuePtr::REMOVED_PMEM_ADDR) continue;
+    Value row;
+    if (!readMergedRow(state.getPmemAddr(), schemaPtr, row)) return false;
+    keys.push_back(iter->first);
+    seen.push_back(state);
+    rows.push_back(std::move(row));
+    if (rows.size() < batchRows) continue;
+    if (!relocateBatch(*table, keys, seen, rows)) return false;
+    relocated += keys.size();
+    keys.clear();
+    seen.clear();
+    rows.clear();
+  }
+  if (!rows.empty() && !relocateBatch(*table, keys, seen, rows)) return false;
+  relocated += keys.size();
+  NKV_LOG_I(std::cout, "compact schema {}: {} rows rewritten", sid, relocated);
+  return true;
+}
+
+void NeoPMKV::writeBackMergedRow(const TableHandle &table, uint64_t primaryKey,
+                                 const ValuePtr::State &seen,
+                                 const Value &mergedRow) {
+  auto mergeStart = std::chrono::steady_clock::now();
+  vector<uint64_t> keys{primaryKey};
+  vector<ValuePtr::State> seenStates{seen};
+  vector<Value> rows{mergedRow};
+  // the swap only happens if no writer moved the key since it was read
+  if (relocateBatch(table, keys, seenStates, rows)) {
+    table.chainThreshold->recordMerge(1, elapsedNanos(mergeStart));
+    PROFILER_ATMOIC_ADD(_durationStat.consolidateCount, 1);
+  }
+}
+
+void NeoPMKV::trackPartialChain(const TableHandle &table, const Key &key,
+                                uint8_t chainLength) {
+  if (_bg_consolidation &&
+      chainLength > table.chainThreshold->getThreshold()) {
+    _chainTracker.addCandidate(key.getSchemaId(), key.primaryKey);
+  }
+}
+
+uint32_t NeoPMKV::consolidateChains(uint32_t maxCount) {
+  vector<ChainCandidate> candidates;
+  _chainTracker.popHottest(maxCount, candidates);
+  if (candidates.empty()) return 0;
+  POINT_PROFILE_START(consolidate_timer);
+  // group by schema and write every group in key order
+  std::sort(candidates.begin(), candidates.end(),
+            [](const ChainCandidate &a, const ChainCandidate &b) {
+              return a.schemaId != b.schemaId ? a.schemaId < b.schemaId
+                                               : a.primaryKey < b.primaryKey;
+            });
+  uint32_t merged = 0;
+  size_t begin = 0;
+  while (begin < candidates.size()) {
+    EpochGuard guard(_epochs);
+    SchemaId sid = candidates[begin].schemaId;
+    const TableHandle &table = *_tables[sid];
+    IndexerT *indexer = table.indexer;
+    Schema *schemaPtr = table.schema;
+    vector<uint64_t> keys;
+    vector<ValuePtr::State> seen;
+    vector<Value> rows;
+    auto mergeStart = std::chrono::steady_clock::now();
+    for (; begin < candidates.size() && candidates[begin].schemaId == sid;
+         begin++) {
+      IndexerIterator idxIter = indexer->find(candidates[begin].primaryKey);
+      if (idxIter == indexer->end()) continue;
+      ValuePtr::State state = idxIter->second.getState();
+      if (state.getPrevItemCount() == 0 ||
+          state.getPmemAddr() == ValuePtr::REMOVED_PMEM_ADDR)
+        continue;
+      Value row;
+      if (!readMergedRow(state.getPmemAddr(), schemaPtr, row)) continue;
+      keys.push_back(candidates[begin].primaryKey);
+      seen.push_back(state);
+      rows.push_back(std::move(row));
+    }
+    if (!rows.empty() && relocateBatch(table, keys, seen, rows)) {
+      merged += rows.size();
+      table.chainThreshold->recordMerge(rows.size(), elapsedNanos(mergeStart));
+    }
+  }
+  POINT_PROFILE_END(consolidate_timer);
+  PROFILER_ATMOIC_ADD(_durationStat.consolidateCount, merged);
+  PROFILER_ATMOIC_ADD(_durationStat.consolidateTimeNanoSecs,
+                      consolidate_timer.duration());
+  return merged;
+}
+
+void NeoPMKV::consolidateLoop() {
+  while (_stopConsolidation.load() == false) {
+    if (consolidateChains(_consolidateBatch) == 0) {
+      std::this_thread::sleep_for(
+          std::chrono::microseconds(_consolidateIntervalMicro));
+    }
+  }
+}
+
+bool NeoPMKV::relocateBatch(const TableHandle &table, vector<uint64_t> &keys,
+                            vector<ValuePtr::State> &seen,
+                            vector<Value> &rows) {
+  vector<PmemAddress> oldAddrs;
+  for (auto &state : seen) oldAddrs.push_back(state.getPmemAddr());
+  vector<PmemAddress> newAddrs;
+  POINT_PROFILE_START(pmem_timer);
+  Status s = _engine_ptr->appendRelocated(newAddrs, table.schemaId, keys,
+                                          oldAddrs, rows);
+  POINT_PROFILE_END(pmem_timer);
+  PROFILER_ATMOIC_ADD(_durationStat.pmemWriteCount, keys.size());
+  PROFILER_ATMOIC_ADD(_durationStat.pmemWriteTimeNanoSecs,
+                      pmem_timer.duration());
+  if (!s.is2xxOK()) return false;
+  for (size_t i = 0; i < keys.size(); i++) {
+    IndexerIterator idxIter = table.indexer->find(keys[i]);
+    if (idxIter == table.indexer->end()) continue;
+    // a concurrent update or remove keeps its newer row
+    if (idxIter->second.relocatePmemAddr(seen[i], newAddrs[i]))
+      inlineRow(table, idxIter->second, newAddrs[i], rows[i]);
   }
-  indexer->unsafe_erase(idxIter);
   return true;
 }
 
 bool NeoPMKV::Scan(Key &start, vector<Value> &value_list, uint32_t scan_len) {
-  auto indexer = _indexerList[start.getSchemaId()];
+  TableHandle *table = OpenTable(start.getSchemaId());
+  return table != nullptr && Scan(*table, start, value_list, scan_len);
+}
+
+bool NeoPMKV::Scan(const TableHandle &table, Key &start,
+                   vector<Value> &value_list, uint32_t scan_len) {
+  EpochGuard guard(_epochs);
+  IndexerT *indexer = table.indexer;
+  if (indexer->isOrdered() == false) {
+    NKV_LOG_E(std::cerr, "schema {} has no ordered index to scan",
+              start.getSchemaId());
+    return false;
+  }
 
   POINT_PROFILE_START(index_timer);
 
@@ -542,7 +1116,7 @@ bool NeoPMKV::Scan(Key &start, vector<Value> &value_list, uint32_t scan_len) {
 
   for (auto i = 0; i < scan_len && iter != indexer->end(); i++, iter++) {
     string tmp_value;
-    getValueHelper(iter, indexer, start.getSchemaId(), tmp_value);
+    getValueHelper(iter, table, tmp_value);
     value_list.push_back(tmp_value);
   }
   POINT_PROFILE_END(get_value);
@@ -552,9 +1126,200 @@ bool NeoPMKV::Scan(Key &start, vector<Value> &value_list, uint32_t scan_len) {
   return true;
 }
 
+std::unique_ptr<ScanIterator> NeoPMKV::NewScanIterator(
+    SchemaId sid, const ScanRange &range) {
+  TableHandle *table = OpenTable(sid);
+  if (table == nullptr) return nullptr;
+  return NewScanIterator(*table, range);
+}
+
+std::unique_ptr<ScanIterator> NeoPMKV::NewScanIterator(
+    const TableHandle &table, const ScanRange &range) {
+  return std::make_unique<ScanIterator>(this, table, range);
+}
+
+bool NeoPMKV::ParallelScan(SchemaId sid, const ScanRange &range,
+                           const ScanCallback &callback, uint32_t partitions) {
+  TableHandle *table = OpenTable(sid);
+  return table != nullptr && ParallelScan(*table, range, callback, partitions);
+}
+bool NeoPMKV::ParallelScan(SchemaId sid, const ScanRange &range,
+                           vector<Value> &valueList, uint32_t partitions) {
+  TableHandle *table = OpenTable(sid);
+  return table != nullptr &&
+         ParallelScan(*table, range, valueList, partitions);
+}
+
+bool NeoPMKV::ParallelScan(const TableHandle &table, const ScanRange &range,
+                           const ScanCallback &callback, uint32_t partitions) {
+  if (table.indexer->isOrdered() == false) {
+    NKV_LOG_E(std::cerr, "schema {} has no ordered index to scan",
+              table.schemaId);
+    return false;
+  }
+  vector<ScanRange> parts;
+  partitionRange(table, range, partitions, parts);
+  scanPartitions(table, parts, callback);
+  return true;
+}
+
+bool NeoPMKV::ParallelScan(const TableHandle &table, const ScanRange &range,
+                           vector<Value> &valueList, uint32_t partitions) {
+  if (table.indexer->isOrdered() == false) {
+    NKV_LOG_E(std::cerr, "schema {} has no ordered index to scan",
+              table.schemaId);
+    return false;
+  }
+  vector<ScanRange> parts;
+  partitionRange(table, range, partitions, parts);
+  // every partition fills its own list, they are joined in key order
+  vector<vector<Value>> results(parts.size());
+  scanPartitions(table, parts,
+                 [&results](uint32_t partition, uint64_t, const Value &row) {
+                   results[partition].push_back(row);
+                 });
+  if (range.reverse) std::reverse(results.begin(), results.end());
+  for (auto &result : results) {
+    valueList.insert(valueList.end(), std::make_move_iterator(result.begin()),
+                     std::make_move_iterator(result.end()));
+  }
+  return true;
+}
+
+void NeoPMKV::partitionRange(const TableHandle &table, const ScanRange &range,
+                             uint32_t partitions, vector<ScanRange> &parts) {
+  parts.clear();
+  uint64_t lo, hi;
+  if (range.toInclusive(lo, hi) == false) return;
+  if (partitions == 0)
+    partitions = 4 * oneapi::tbb::this_task_arena::max_concurrency();
+  // a cut is the last key of the partition before it
+  vector<uint64_t> cuts;
+  table.indexer->splitKeys(partitions, cuts);
+  if (cuts.empty()) {
+    ScanRange backwards = range;
+    backwards.reverse = !range.reverse;
+    ScanIterator firstIter(this, table, range.reverse ? backwards : range);
+    ScanIterator lastIter(this, table, range.reverse ? range : backwards);
+    if (firstIter.Valid() == false) return;
+    uint64_t first = firstIter.getKey();
+    uint64_t span = lastIter.getKey() - first;
+    uint64_t width = span / partitions + 1;
+    for (uint64_t i = 1; i < partitions && width * i - 1 < span; i++)
+      cuts.push_back(first + width * i - 1);
+  }
+  uint64_t start = lo;
+  for (uint64_t cut : cuts) {
+    if (cut < start || cut >= hi) continue;
+    ScanRange part = range;
+    part.start = start;
+    part.end = cut;
+    part.startInclusive = part.endInclusive = true;
+    parts.push_back(part);
+    start = cut + 1;
+  }
+  ScanRange part = range;
+  part.start = start;
+  part.end = hi;
+  part.startInclusive = part.endInclusive = true;
+  parts.push_back(part);
+}
+
+void NeoPMKV::scanPartitions(const TableHandle &table,
+                             const vector<ScanRange> &parts,
+                             const ScanCallback &callback) {
+  oneapi::tbb::parallel_for(
+      oneapi::tbb::blocked_range<size_t>(0, parts.size(), 1),
+      [&](const oneapi::tbb::blocked_range<size_t> &block) {
+        for (size_t p = block.begin(); p != block.end(); p++) {
+          for (ScanIterator iter(this, table, parts[p]); iter.Valid();
+               iter.Next()) {
+            const Value &row = iter.getValue();
+            // removed since the batch was taken
+            if (row.empty()) continue;
+            callback(p, iter.getKey(), row);
+          }
+        }
+      });
+}
+
+bool NeoPMKV::ResolveKey(SchemaId sid, const vector<Value> &keyValues,
+                         Key &key, bool create) {
+  auto spaceIter = _keySpaces.find(sid);
+  if (spaceIter == _keySpaces.end()) {
+    NKV_LOG_E(std::cerr, "schema {} has no composite key", sid);
+    return false;
+  }
+  Schema *schemaPtr = _sMap.find(sid);
+  if (keyValues.size() != schemaPtr->getKeyFields().size()) return false;
+  EncodedKeySpace *space = spaceIter->second.get();
+  std::string encoded = KeyCodec::encodeKey(schemaPtr, keyValues);
+  uint64_t id;
+  if (space->keys.find(encoded, id) == false) {
+    if (create == false) return false;
+    // a racing insert of the same tuple may win, its id is taken then
+    id = space->keys.insert(encoded, space->nextId.fetch_add(1)).first;
+  }
+  key = Key(sid, id);
+  return true;
+}
+
+bool NeoPMKV::PutRow(SchemaId sid, vector<Value> &fieldList) {
+  Schema *schemaPtr = _sMap.find(sid);
+  if (schemaPtr == nullptr) return false;
+  vector<Value> keyValues;
+  for (auto fieldId : schemaPtr->getKeyFields()) {
+    if (fieldId >= fieldList.size()) return false;
+    keyValues.push_back(fieldList[fieldId]);
+  }
+  Key key(sid, 0);
+  if (ResolveKey(sid, keyValues, key, true) == false) return false;
+  return Put(key, fieldList);
+}
+
+bool NeoPMKV::ScanByKey(SchemaId sid, const vector<Value> &startKey,
+                        vector<Value> &valueList, uint32_t scanLen) {
+  auto spaceIter = _keySpaces.find(sid);
+  if (spaceIter == _keySpaces.end()) {
+    NKV_LOG_E(std::cerr, "schema {} has no composite key", sid);
+    return false;
+  }
+  const TableHandle &table = *_tables[sid];
+  std::string start = KeyCodec::encodeKey(table.schema, startKey);
+  // removed keys keep their id, their rows are skipped
+  vector<PrefixKeyIndex::Entry> entries;
+  while (valueList.size() < scanLen) {
+    entries.clear();
+    uint32_t batch = scanLen - valueList.size();
+    spaceIter->second->keys.scan(start, true, batch, entries);
+    for (auto &[_, id] : entries) {
+      Key key(sid, id);
+      Value value;
+      if (Get(table, key, value)) valueList.push_back(value);
+    }
+    if (entries.size() < batch) break;
+    start = entries.back().first;
+  }
+  return true;
+}
+
 bool NeoPMKV::PartialScan(Key &start, vector<Value> &value_list,
                           uint32_t scan_len, uint32_t field) {
-  auto indexer = _indexerList[start.getSchemaId()];
+  TableHandle *table = OpenTable(start.getSchemaId());
+  return table != nullptr &&
+         PartialScan(*table, start, value_list, scan_len, field);
+}
+
+bool NeoPMKV::PartialScan(const TableHandle &table, Key &start,
+                          vector<Value> &value_list, uint32_t scan_len,
+                          uint32_t field) {
+  EpochGuard guard(_epochs);
+  IndexerT *indexer = table.indexer;
+  if (indexer->isOrdered() == false) {
+    NKV_LOG_E(std::cerr, "schema {} has no ordered index to scan",
+              start.getSchemaId());
+    return false;
+  }
 
   POINT_PROFILE_START(index_timer);
 
@@ -570,7 +1335,7 @@ bool NeoPMKV::PartialScan(Key &start, vector<Value> &value_list,
 
   for (auto i = 0; i < scan_len && iter != indexer->end(); i++, iter++) {
     string tmp_value;
-    getValueHelper(iter, indexer, start.getSchemaId(), tmp_value, field);
+    getValueHelper(iter, table, tmp_value, field);
     value_list.push_back(tmp_value);
   }
   POINT_PROFILE_END(get_value);
@@ -580,6 +1345,141 @@ bool NeoPMKV::PartialScan(Key &start, vector<Value> &value_list,
   return true;
 }
 
+bool NeoPMKV::CreateSecondaryIndex(SchemaId sid, uint32_t fieldId) {
+  TableHandle *table = OpenTable(sid);
+  if (table == nullptr) return false;
+  Schema *schemaPtr = table->schema;
+  if (fieldId >= schemaPtr->getFieldsCount() ||
+      fieldId == schemaPtr->getPrimaryKeyField() ||
+      !SecondaryIndex::isIndexable(schemaPtr->getFieldType(fieldId))) {
+    NKV_LOG_E(std::cerr, "field {} of schema {} cannot have a secondary index",
+              fieldId, sid);
+    return false;
+  }
+  auto &secIdxs = *table->secondaryIndexes;
+  for (auto &secIdx : secIdxs) {
+    if (secIdx->getFieldId() == fieldId) return true;
+  }
+  auto secIdx = std::make_unique<SecondaryIndex>(schemaPtr, fieldId);
+  EpochGuard guard(_epochs);
+  IndexerT *indexer = table->indexer;
+  for (auto iter = indexer->begin(); iter != indexer->end(); iter++) {
+    Value fieldValue;
+    PmemAddress pmemAddr = iter->second.getPmemAddr();
+    if (pmemAddr == ValuePtr::REMOVED_PMEM_ADDR) continue;
+    Status s = _engine_ptr->read(pmemAddr, fieldValue, schemaPtr, fieldId);
+    if (s.is2xxOK()) secIdx->insert(fieldValue, iter->first);
+  }
+  secIdxs.push_back(std::move(secIdx));
+  return true;
+}
+
+bool NeoPMKV::GetBySecondary(SchemaId sid, uint32_t fieldId,
+                             const Value &fieldValue,
+                             vector<Value> &valueList) {
+  return readBySecondary(sid, fieldId, fieldValue, fieldValue, valueList,
+                         UINT32_MAX);
+}
+
+bool NeoPMKV::ScanBySecondary(SchemaId sid, uint32_t fieldId,
+                              const Value &low, const Value &high,
+                              vector<Value> &valueList, uint32_t scanLen) {
+  return readBySecondary(sid, fieldId, low, high, valueList, scanLen);
+}
+
+bool NeoPMKV::readBySecondary(SchemaId sid, uint32_t fieldId,
+                              const Value &low, const Value &high,
+                              vector<Value> &valueList, uint32_t scanLen) {
+  TableHandle *table = OpenTable(sid);
+  if (table == nullptr) return false;
+  SecondaryIndex *secIdx = nullptr;
+  for (auto &index : *table->secondaryIndexes) {
+    if (index->getFieldId() == fieldId) secIdx = index.get();
+  }
+  if (secIdx == nullptr) {
+    NKV_LOG_E(std::cerr, "no secondary index on field {} of schema {}",
+              fieldId, sid);
+    return false;
+  }
+  EpochGuard guard(_epochs);
+  IndexerT *indexer = table->indexer;
+  ValueReader valueReader(table->schema);
+  std::string lowKey = secIdx->encode(low);
+  std::string highKey = secIdx->encode(high);
+
+  vector<uint64_t> primaryKeys;
+  secIdx->lookup(low, high, primaryKeys);
+  std::unordered_set<uint64_t> returned;
+  for (auto primaryKey : primaryKeys) {
+    if (valueList.size() >= scanLen) break;
+    IndexerIterator idxIter = indexer->find(primaryKey);
+    Value row;
+    if (!getValueHelper(idxIter, *table, row)) continue;
+    // the pair may be stale, the row has the last word
+    Value rowField;
+    valueReader.ExtractFieldFromFullRow(row.data(), fieldId, rowField);
+    std::string rowKey = secIdx->encode(rowField);
+    if (rowKey < lowKey || rowKey > highKey) continue;
+    if (returned.insert(primaryKey).second == false) continue;
+    valueList.push_back(std::move(row));
+  }
+  return true;
+}
+
+void NeoPMKV::secondaryFieldsOfRow(const TableHandle &table, const Value &row,
+                                   vector<uint32_t> &fieldIds,
+                                   vector<Value> &fieldValues) {
+  ValueReader valueReader(table.schema);
+  for (auto &secIdx : *table.secondaryIndexes) {
+    Value fieldValue;
+    if (!valueReader.ExtractFieldFromFullRow((char *)row.data(),
+                                             secIdx->getFieldId(), fieldValue))
+      continue;
+    fieldIds.push_back(secIdx->getFieldId());
+    fieldValues.push_back(std::move(fieldValue));
+  }
+}
+
+void NeoPMKV::prepareSecondary(const TableHandle &table, const Key &key,
+                               PmemAddress oldAddr,
+                               const vector<uint32_t> &fieldIds,
+                               const vector<Value> &newValues,
+                               vector<SecondaryChange> &changes) {
+  Schema *schemaPtr = table.schema;
+  for (auto &secIdx : *table.secondaryIndexes) {
+    // only the indexed fields this write sets
+    auto pos =
+        std::find(fieldIds.begin(), fieldIds.end(), secIdx->getFieldId());
+    if (pos == fieldIds.end()) continue;
+    SecondaryChange change;
+    change.index = secIdx.get();
+    if (oldAddr != ValuePtr::REMOVED_PMEM_ADDR) {
+      change.hasOld = _engine_ptr
+                          ->read(oldAddr, change.oldValue, schemaPtr,
+                                 secIdx->getFieldId())
+                          .is2xxOK();
+    }
+    if (newValues.empty() == false) {
+      change.hasNew = true;
+      change.newValue = newValues[pos - fieldIds.begin()];
+      // indexed before the row is visible, so that no reader misses it
+      secIdx->insert(change.newValue, key.primaryKey);
+    }
+    changes.push_back(std::move(change));
+  }
+}
+
+void NeoPMKV::commitSecondary(const Key &key,
+                              vector<SecondaryChange> &changes) {
+  for (auto &change : changes) {
+    if (change.hasOld == false) continue;
+    if (change.hasNew && change.index->encode(change.oldValue) ==
+                             change.index->encode(change.newValue))
+      continue;
+    change.index->erase(change.oldValue, key.primaryKey);
+  }
+}
+
 void NeoPMKV::outputReadStat() {
 #ifdef ENABLE_STATISTICS
   NKV_LOG_I(std::cout, " Enable pbrb: {}, async pbrb: {}", _enable_pbrb,
@@ -651,6 +1551,13 @@ void NeoPMKV::outputReadStat() {
             _durationStat.pbrbWriteTimeNanoSecs.load() / (double)NANOSEC_BASE,
             _durationStat.pbrbWriteTimeNanoSecs.load() /
                 (double)_durationStat.pbrbWriteCount.load());
+  NKV_LOG_I(std::cout,
+            "Consolidate: Row Count: {}, Total Time Cost: {:.2f} s, Average "
+            "Time Cost: {:.2f} ns",
+            _durationStat.consolidateCount.load(),
+            _durationStat.consolidateTimeNanoSecs.load() / (double)NANOSEC_BASE,
+            _durationStat.consolidateTimeNanoSecs.load() /
+                (double)_durationStat.consolidateCount.load());
 #endif
 }
 
@@ -7,24 +7,65 @@
 //
 
 #include "pbrb.h"
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <atomic>
 #include <cstdint>
+#include <fstream>
 #include <mutex>
+#include <string>
 #include <thread>
 #include "logging.h"
 #include "profiler.h"
 #include "schema_parser.h"
 
 namespace NKV {
+static constexpr size_t HUGE_PAGE_2MB = 2ul << 20;
+static constexpr size_t HUGE_PAGE_1GB = 1ul << 30;
+
+// the number of NUMA nodes, from the highest one online ("0", "0-1", "0,2")
+static uint32_t onlineNodeNum() {
+  std::ifstream online("/sys/devices/system/node/online");
+  std::string nodes;
+  if (!(online >> nodes) || nodes.empty()) return 1;
+  size_t last = nodes.find_last_of(",-");
+  uint32_t maxNode = std::stoul(
+      last == std::string::npos ? nodes : nodes.substr(last + 1));
+  // a node mask of mbind is one word here
+  return std::min(maxNode + 1, 64u);
+}
+
+static uint32_t nodeOfCpu(uint32_t cpu, uint32_t nodeNum) {
+  for (uint32_t node = 0; node < nodeNum; node++) {
+    std::string path = "/sys/devices/system/node/node" +
+                       std::to_string(node) + "/cpu" + std::to_string(cpu);
+    if (access(path.c_str(), F_OK) == 0) return node;
+  }
+  return 0;
+}
+
+static void *mapHugePages(size_t size, size_t hugePageSize) {
+  int sizeFlag = (hugePageSize == HUGE_PAGE_1GB ? 30 : 21) << MAP_HUGE_SHIFT;
+  void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | sizeFlag, -1, 0);
+  return map == MAP_FAILED ? nullptr : map;
+}
+
 PBRB::PBRB(int maxPageNumber, TimeStamp *wm, IndexerList *indexerListPtr,
            SchemaUMap *umap, SchemaParserMap *sParser, PmemEngine *enginePtr,
            uint64_t retentionWindowMicrosecs, uint32_t maxPageSearchNum,
            bool async_pbrb, bool enable_async_gc, double targetOccupancyRatio,
-           uint64_t gcIntervalMicrosecs, double hitThreshold) {
+           uint64_t gcIntervalMicrosecs, double hitThreshold,
+           AccessTracking accessTracking) {
   static_assert(PBRB_PAGE_HEADER_SIZE == 64, "PBRB_PAGE_HEADER_SIZE != 64");
   // initialization
 
   _watermark = *wm;
+  _accessTracking = accessTracking;
+  _accessClock.store(wm->txn_ticks, std::memory_order_relaxed);
   _schemaUMap = umap;
   _sParser = sParser;
   _enginePtr = enginePtr;
@@ -39,12 +80,20 @@ PBRB::PBRB(int maxPageNumber, TimeStamp *wm, IndexerList *indexerListPtr,
   _asyncGC = enable_async_gc;
   _hitThreshold = hitThreshold;
   // allocate bufferpage
-  auto aligned_val = std::align_val_t{_pageSize};
-  _bufferPoolPtr = static_cast<BufferPage *>(operator new(
-      maxPageNumber * sizeof(BufferPage), aligned_val));
-  _freePageList.set_capacity(maxPageNumber);
+  _allocBufferPool();
+  for (uint32_t node = 0; node < _nodeNum; node++) {
+    _freePageLists.emplace_back(
+        std::make_unique<oneapi::tbb::concurrent_bounded_queue<BufferPage *>>());
+    _freePageLists[node]->set_capacity(_nodePageNum);
+  }
   for (int idx = 0; idx < maxPageNumber; idx++) {
-    _freePageList.push(_bufferPoolPtr + idx);
+    _freePageLists[_nodeOfPage(_bufferPoolPtr + idx)]->push(_bufferPoolPtr +
+                                                            idx);
+  }
+  uint32_t coreNum = std::max(1u, std::thread::hardware_concurrency());
+  for (uint32_t core = 0; core < coreNum; core++) {
+    _freePageCaches.emplace_back(std::make_unique<FreePageCache>());
+    _freePageCaches[core]->node = nodeOfCpu(core, _nodeNum);
   }
   if (_async_pbrb == true) {
     _asyncThread =
@@ -71,28 +120,162 @@ PBRB::~PBRB() {
       _pbrbAsyncWriteTimeNanoSecs.load() / (double)_pbrbAsyncWriteCount.load());
 
   if (_asyncGC) _stopGC();
-  if (_bufferPoolPtr != nullptr) {
-    delete _bufferPoolPtr;
+  // pages and heap parts of rows retired by the last evictions
+  for (auto &[_, idx] : *_indexListPtr) {
+    if (idx->getEpochManager() != nullptr) idx->getEpochManager()->drain();
+  }
+  if (_bufferPoolMap != nullptr) {
+    munmap(_bufferPoolMap, _bufferPoolMapSize);
   }
   outputHitRatios();
 }
 
+void PBRB::_allocBufferPool() {
+  _nodeNum = onlineNodeNum();
+  // partitions start on a 2MB boundary, so that no hugepage spans two nodes
+  uint32_t alignPageNum = HUGE_PAGE_2MB / sizeof(BufferPage);
+  _nodePageNum = (_maxPageNumber + _nodeNum - 1) / _nodeNum;
+  _nodePageNum = (_nodePageNum + alignPageNum - 1) / alignPageNum * alignPageNum;
+  size_t nodeSize = (size_t)_nodePageNum * sizeof(BufferPage);
+  size_t poolSize = nodeSize * _nodeNum;
+
+  // hugetlbfs pages first, 1GB ones if the partitions are made of them
+  const char *backing = "1GB hugepages";
+  if (nodeSize % HUGE_PAGE_1GB == 0)
+    _bufferPoolMap = mapHugePages(poolSize, HUGE_PAGE_1GB);
+  if (_bufferPoolMap == nullptr) {
+    backing = "2MB hugepages";
+    _bufferPoolMap = mapHugePages(poolSize, HUGE_PAGE_2MB);
+  }
+  if (_bufferPoolMap != nullptr) {
+    _bufferPoolMapSize = poolSize;
+    _bufferPoolPtr = static_cast<BufferPage *>(_bufferPoolMap);
+  } else {
+    // none reserved, ask for transparent hugepages on a 2MB aligned range
+    backing = "transparent hugepages";
+    _bufferPoolMapSize = poolSize + HUGE_PAGE_2MB;
+    _bufferPoolMap = mmap(nullptr, _bufferPoolMapSize, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (_bufferPoolMap == MAP_FAILED) {
+      _bufferPoolMap = nullptr;
+      NKV_LOG_E(std::cerr, "PBRB: fail to map a buffer pool of {} bytes",
+                poolSize);
+      throw std::bad_alloc();
+    }
+    uintptr_t aligned = ((uintptr_t)_bufferPoolMap + HUGE_PAGE_2MB - 1) &
+                        ~(HUGE_PAGE_2MB - 1);
+    _bufferPoolPtr = reinterpret_cast<BufferPage *>(aligned);
+    madvise(_bufferPoolPtr, poolSize, MADV_HUGEPAGE);
+  }
+
+  // nothing is touched yet, each partition is faulted in on its node
+  for (uint32_t node = 0; _nodeNum > 1 && node < _nodeNum; node++) {
+    unsigned long nodeMask = 1ul << node;
+    if (syscall(SYS_mbind, _bufferPoolPtr + node * _nodePageNum, nodeSize,
+                MPOL_PREFERRED, &nodeMask, sizeof(nodeMask) * 8, 0) != 0)
+      NKV_LOG_E(std::cerr, "PBRB: fail to bind the pages of node {}", node);
+  }
+  NKV_LOG_I(std::cout, "PBRB: {} pages on {} node(s), backed by {}",
+            _maxPageNumber, _nodeNum, backing);
+}
+
 BufferPage *PBRB::getPageAddr(void *rowAddr) {
   return (BufferPage *)((uint64_t)rowAddr & ~mask);
 }
 
+PBRB::FreePageCache &PBRB::_localFreePageCache() {
+  int core = sched_getcpu();
+  if (core < 0) core = 0;
+  return *_freePageCaches[core % _freePageCaches.size()];
+}
+
+BufferPage *PBRB::_popFreePage() {
+  FreePageCache &cache = _localFreePageCache();
+  BufferPage *pagePtr = nullptr;
+  {
+    std::lock_guard<std::mutex> cacheGuard(cache.lock);
+    // refill a batch from the pool of the node, a remote page only when
+    // the local partition ran out
+    for (uint32_t n = 0; cache.pages.empty() && n < _nodeNum; n++) {
+      auto &freePageList = *_freePageLists[(cache.node + n) % _nodeNum];
+      for (uint32_t i = 0; i < FREE_PAGE_BATCH; i++) {
+        if (freePageList.try_pop(pagePtr) == false) break;
+        cache.pages.push_back(pagePtr);
+      }
+    }
+    pagePtr = nullptr;
+    if (!cache.pages.empty()) {
+      pagePtr = cache.pages.back();
+      cache.pages.pop_back();
+    }
+  }
+  if (pagePtr == nullptr) pagePtr = _stealFreePage(cache);
+  if (pagePtr != nullptr)
+    cache.freeDelta.fetch_sub(1, std::memory_order_relaxed);
+  return pagePtr;
+}
+
+BufferPage *PBRB::_stealFreePage(FreePageCache &thief) {
+  std::vector<BufferPage *> stolen;
+  // the cores of the same node first
+  for (uint32_t pass = 0; pass < 2 && stolen.empty(); pass++) {
+    for (auto &victim : _freePageCaches) {
+      if (victim.get() == &thief || (victim->node == thief.node) == pass)
+        continue;
+      std::lock_guard<std::mutex> victimGuard(victim->lock);
+      // take half, the victim may be about to use the rest
+      size_t stealNum = (victim->pages.size() + 1) / 2;
+      stolen.assign(victim->pages.end() - stealNum, victim->pages.end());
+      victim->pages.resize(victim->pages.size() - stealNum);
+      if (!stolen.empty()) break;
+    }
+  }
+  if (stolen.empty()) return nullptr;
+  BufferPage *pagePtr = stolen.back();
+  stolen.pop_back();
+  std::lock_guard<std::mutex> thiefGuard(thief.lock);
+  thief.pages.insert(thief.pages.end(), stolen.begin(), stolen.end());
+  return pagePtr;
+}
+
+void PBRB::_pushFreePage(BufferPage *pagePtr) {
+  _localFreePageCache().freeDelta.fetch_add(1, std::memory_order_relaxed);
+  _cacheFreePage(pagePtr);
+}
+
+void PBRB::_cacheFreePage(BufferPage *pagePtr) {
+  FreePageCache &cache = _localFreePageCache();
+  std::lock_guard<std::mutex> cacheGuard(cache.lock);
+  cache.pages.push_back(pagePtr);
+  // spill a batch to the global pool, keeping one for the next refill
+  if (cache.pages.size() >= 2 * FREE_PAGE_BATCH) {
+    for (uint32_t i = 0; i < FREE_PAGE_BATCH; i++) {
+      _releaseFreePage(cache.pages.back());
+      cache.pages.pop_back();
+    }
+  }
+}
+
+void PBRB::_releaseFreePage(BufferPage *pagePtr) {
+  _freePageLists[_nodeOfPage(pagePtr)]->push(pagePtr);
+}
+
+uint64_t PBRB::_freePageNum() {
+  int64_t freePageNum = _maxPageNumber;
+  for (auto &cache : _freePageCaches)
+    freePageNum += cache->freeDelta.load(std::memory_order_relaxed);
+  return freePageNum > 0 ? freePageNum : 0;
+}
+
 BufferPage *PBRB::createCacheForSchema(SchemaId schemaId, SchemaVer schemaVer) {
   std::lock_guard<std::mutex> createCacheGuard(_createCacheMutex);
-  if (_freePageList.size() == 0) {
+  // Get a page and set schemaMetadata.
+  BufferPage *pagePtr = _popFreePage();
+  if (pagePtr == nullptr) {
     NKV_LOG_E(std::cerr, "Cannot create cache for schema: {}! (no free page)",
               schemaId);
     return nullptr;
   }
-
-  // Get a page and set schemaMetadata.
-  BufferPage *pagePtr = nullptr;
-  bool page_res = _freePageList.try_pop(pagePtr);
-  if (page_res == false) return pagePtr;
   std::shared_ptr<BufferListBySchema> blbsPtr =
       std::make_shared<BufferListBySchema>(schemaId, _pageSize, _pageHeaderSize,
                                            _rowHeaderSize, _schemaUMap,
@@ -101,11 +284,11 @@ BufferPage *PBRB::createCacheForSchema(SchemaId schemaId, SchemaVer schemaVer) {
   auto &blbs = _bufferMap[schemaId];
   NKV_LOG_I(
       std::cout,
-      "createCacheForSchema, schemaId: {}, pagePtr empty:{}, _freePageList "
-      "size:{}, pageSize: {}, blbs->rowSize:{}, contentSize: {}, "
+      "createCacheForSchema, schemaId: {}, pagePtr empty:{}, free page "
+      "number:{}, pageSize: {}, blbs->rowSize:{}, contentSize: {}, "
       "_bufferMap[{}].rowSize: {}, "
       "maxRowCnt: {}",
-      schemaId, pagePtr == nullptr, _freePageList.size(), sizeof(BufferPage),
+      schemaId, pagePtr == nullptr, _freePageNum(), sizeof(BufferPage),
       blbs->rowSize, _schemaUMap->find(schemaId)->getSize(), schemaId,
       blbs->rowSize, blbs->maxRowCnt);
 
@@ -131,136 +314,43 @@ BufferPage *PBRB::createCacheForSchema(SchemaId schemaId, SchemaVer schemaVer) {
 }
 
 BufferPage *PBRB::AllocNewPageForSchema(SchemaId schemaId) {
-  // al1
-  PointProfiler pointTimer;
-  pointTimer.start();
-
-  if (_freePageList.empty()) {
-    NKV_LOG_E(std::cerr, "No free page!");
-    return nullptr;
-  }
-
-  if (_bufferMap.find(schemaId) == _bufferMap.end()) {
+  auto bMapIter = _bufferMap.find(schemaId);
+  if (bMapIter == _bufferMap.end()) {
     NKV_LOG_E(std::cerr,
               "Didn't find sid: {} in _bufferMap when alloc new page.",
               schemaId);
     return nullptr;
   }
+  BufferListBySchema *blbs = bMapIter->second.get();
 
-  auto &blbs = _bufferMap[schemaId];
-  BufferPage *pagePtr = blbs->headPage;
-  blbs->curPageNum++;
-
-  auto al1ns = pointTimer.end();
-
-  if (pagePtr == nullptr)
-    return createCacheForSchema(schemaId);
-  else {
-    // al2
-    pointTimer.start();
-    assert(_freePageList.size() > 0);
-    BufferPage *newPage = nullptr;
-    bool res = _freePageList.try_pop(newPage);
-    if (res == false) return newPage;
-
-    // Initialize Page.
-    newPage->initializePage();
-    newPage->setSchemaIDPage(schemaId);
-
-    // optimize: using tailPage.
-    BufferPage *tail = blbs->tailPage;
-    // set nextpage
-    newPage->setPrevPage(tail);
-    newPage->setNextPage(nullptr);
-    tail->setNextPage(newPage);
-    blbs->tailPage = newPage;
-
-    auto al2ns = pointTimer.end();
-
-    // al3
-
-    pointTimer.start();
-
-    auto al3ns = pointTimer.end();
-    // K2LOG_I(log::pbrb, "Alloc new page type 1: sid: {}, sname: {},
-    // currPageNum: {}", schemaId, _bufferMap[schemaId].schema->name,
-    // _bufferMap[schemaId].curPageNum);
-    NKV_LOG_D(std::cout, "Remaining _freePageList size:{}",
-              _freePageList.size());
-    NKV_LOG_D(std::cout,
-              "Allocated page for schema: {}, page count: {}, time al1: {}, "
-              "al2: {}, al3: {}, total: {}",
-              blbs->ownSchema->getName(), (blbs->curPageNum).load(), al1ns, al2ns,
-              al3ns, al1ns + al2ns + al3ns);
-
-    return newPage;
-  }
-}
-
-BufferPage *PBRB::AllocNewPageForSchema(SchemaId schemaId,
-                                        BufferPage *pagePtr) {
-  // TODO: validation
-  if (_freePageList.empty()) {
+  BufferPage *newPage = _popFreePage();
+  if (newPage == nullptr) {
     // NKV_LOG_E(std::cout, "No Free Page Now!");
     return nullptr;
   }
 
-  assert(_freePageList.size() > 0);
-  if (_bufferMap.find(schemaId) == _bufferMap.end()) {
-    NKV_LOG_E(std::cerr,
-              "Didn't find sid: {} in _bufferMap when alloc new page.",
-              schemaId);
-    return nullptr;
-  }
-
-  if (pagePtr == nullptr) {
-    NKV_LOG_E(std::cerr, "specified nullptr as start pointer!");
-    return nullptr;
-  }
-
-  auto &blbs = _bufferMap[schemaId];
-  BufferPage *newPage = nullptr;
-  bool res = _freePageList.try_pop(newPage);
-  if (res == false) return newPage;
-  blbs->curPageNum++;
-
   // Initialize Page.
   // memset(newPage, 0, sizeof(BufferPage));
   newPage->initializePage();
   newPage->setSchemaIDPage(schemaId);
+  // the first row is the caller's, nobody sees the page before the push
+  newPage->setRowBitMapPage(0);
+  blbs->pushPage(newPage);
 
-  // insert behind pagePtr
-  // pagePtr -> newPage -> nextPage;
-
-  BufferPage *nextPage = pagePtr->getNextPage();
-  // nextPagePtr != tail
-  if (nextPage != nullptr) {
-    newPage->setNextPage(nextPage);
-    newPage->setPrevPage(pagePtr);
-    pagePtr->setNextPage(newPage);
-    nextPage->setPrevPage(newPage);
-  } else {
-    newPage->setNextPage(nullptr);
-    newPage->setPrevPage(pagePtr);
-    pagePtr->setNextPage(newPage);
-    blbs->tailPage = newPage;
-  }
-
-  // K2LOG_I(log::pbrb, "Alloc new page type 2: sid: {}, sname: {},
-  // currPageNum: {}, fromPagePtr: {}", schemaId,
-  // _bufferMap[schemaId].schema->name, _bufferMap[schemaId].curPageNum, (void
-  // *)pagePtr);
-  NKV_LOG_D(std::cout, "Remaining _freePageList size:{}", _freePageList.size());
-
+  NKV_LOG_D(std::cout, "Remaining free page number:{}", _freePageNum());
   return newPage;
 }
 
 // return pagePtr and rowOffset.
 std::pair<BufferPage *, RowOffset> PBRB::findPageAndRowByAddr(RowAddr rowAddr) {
+  SchemaId sid = getPageAddr(rowAddr)->getSchemaIDPage();
+  return findPageAndRowByAddr(_bufferMap[sid].get(), rowAddr);
+}
+
+std::pair<BufferPage *, RowOffset> PBRB::findPageAndRowByAddr(
+    BufferListBySchema *blbs, RowAddr rowAddr) {
   BufferPage *pagePtr = getPageAddr(rowAddr);
   uint32_t offset = (uint64_t)rowAddr & mask;
-  SchemaId sid = pagePtr->getSchemaIDPage();
-  auto &blbs = _bufferMap[sid];
   RowOffset rowOff =
       (offset - blbs->firstRowOffset - _pageHeaderSize) / blbs->rowSize;
   if ((offset - blbs->firstRowOffset - _pageHeaderSize) % blbs->rowSize != 0)
@@ -270,7 +360,11 @@ std::pair<BufferPage *, RowOffset> PBRB::findPageAndRowByAddr(RowAddr rowAddr) {
 
 RowAddr PBRB::getAddrByPageAndRow(BufferPage *pagePtr, RowOffset rowOff) {
   SchemaId sid = pagePtr->getSchemaIDPage();
-  auto &blbs = _bufferMap[sid];
+  return getAddrByPageAndRow(_bufferMap[sid].get(), pagePtr, rowOff);
+}
+
+RowAddr PBRB::getAddrByPageAndRow(BufferListBySchema *blbs,
+                                  BufferPage *pagePtr, RowOffset rowOff) {
   uint32_t offset =
       _pageHeaderSize + blbs->firstRowOffset + rowOff * blbs->rowSize;
   return (uint8_t *)pagePtr + offset;
@@ -280,20 +374,15 @@ RowAddr PBRB::getAddrByPageAndRow(BufferPage *pagePtr, RowOffset rowOff) {
 
 //
 
-// @brief Find first empty slot in BufferPage pageptr
+// @brief Claim an empty slot in BufferPage pageptr, searching from hint on
 // @return rowOffset (UINT32_MAX for not found).
-inline RowOffset PBRB::findEmptySlotInPage(
-    std::shared_ptr<BufferListBySchema> &blbs, BufferPage *pagePtr,
-    RowOffset beginOffset, RowOffset endOffset) {
-  if (pagePtr->getHotRowsNumPage() >= blbs->maxRowCnt) {
-    // NKV_LOG_I(std::cout, "BufferPage Full, skipped.");
-    return UINT32_MAX;
-  }
+inline RowOffset PBRB::claimSlotInPage(BufferListBySchema *blbs,
+                                       BufferPage *pagePtr, RowOffset hint) {
 #ifdef ENABLE_BREAKDOWN
   PointProfiler timer;
   timer.start();
 #endif
-  uint32_t result = pagePtr->getFirstZeroBit(blbs->maxRowCnt);
+  uint32_t result = pagePtr->claimRow(blbs->maxRowCnt, hint);
 
 #ifdef ENABLE_BREAKDOWN
   timer.end();
@@ -303,9 +392,10 @@ inline RowOffset PBRB::findEmptySlotInPage(
   return result;
 }
 
-// Find first empty slot in linked list start with pagePtr.
+// Claim first empty slot in linked list start with pagePtr.
 std::pair<BufferPage *, RowOffset> PBRB::traverseFindEmptyRow(
-    uint32_t schemaID, BufferPage *pagePtr, uint32_t maxPageSearchingNum) {
+    BufferListBySchema *blbs, BufferPage *pagePtr,
+    uint32_t maxPageSearchingNum) {
   if (maxPageSearchingNum == UINT32_MAX)
     maxPageSearchingNum = _maxPageSearchingNum;
 
@@ -313,23 +403,13 @@ std::pair<BufferPage *, RowOffset> PBRB::traverseFindEmptyRow(
     NKV_LOG_E(std::cerr, "maxPageSearchingNum must > 0, adjusted to 1");
   }
 
-  // Default: Traverse from headPage.
-  if (pagePtr == nullptr) {
-    auto &blbs = _bufferMap[schemaID];
-    pagePtr = blbs->headPage;
-    if (pagePtr == nullptr) {
-      NKV_LOG_E(std::cerr,
-                "[Schema: {}, sid: {}:] blbs->headPage == nullptr, Aborted "
-                "traversing.",
-                blbs->ownSchema->getName(), blbs->ownSchema->getSchemaId());
-    }
-  }
+  // Default: Traverse from headPage, an empty list gets its first page below
+  if (pagePtr == nullptr) pagePtr = blbs->getHeadPage();
 
   BufferPage *travPagePtr = pagePtr;
-  auto &blbs = _bufferMap[schemaID];
   uint32_t visitedPageNum = 1;
   while (visitedPageNum < maxPageSearchingNum && travPagePtr != nullptr) {
-    RowOffset rowOff = findEmptySlotInPage(blbs, travPagePtr);
+    RowOffset rowOff = claimSlotInPage(blbs, travPagePtr);
     if (rowOff != UINT32_MAX) {
       return std::make_pair(travPagePtr, rowOff);
     }
@@ -338,7 +418,7 @@ std::pair<BufferPage *, RowOffset> PBRB::traverseFindEmptyRow(
   }
 
   // Didn't find en empty slot: need to allocate a new page.
-  BufferPage *newPage = AllocNewPageForSchema(schemaID, pagePtr);
+  BufferPage *newPage = AllocNewPageForSchema(blbs->ownSchema->getSchemaId());
 
   // Current Stragegy: return the first slot of new page.
   return std::make_pair(newPage, 0);
@@ -346,21 +426,19 @@ std::pair<BufferPage *, RowOffset> PBRB::traverseFindEmptyRow(
 
 //
 std::pair<BufferPage *, RowOffset> PBRB::findCacheRowPosition(
-    uint32_t schemaID, IndexerIterator iter) {
+    const TableHandle &table, IndexerIterator iter) {
 #ifdef ENABLE_BREAKDOWN
   PointProfiler fcrpTimer;
   fcrpTimer.start();
 #endif
-  if (iter == _indexListPtr->at(schemaID)->end()) {
+  if (iter == table.indexer->end()) {
     NKV_LOG_E(std::cerr, "iter == _indexer->end()");
     return std::make_pair(nullptr, 0);
   }
 
-  auto bmIter = _bufferMap.find(schemaID);
-
-  if (_bufferMap.find(schemaID) == _bufferMap.end()) {
+  if (table.bufferList == nullptr) {
     NKV_LOG_E(std::cerr, "Cannot find buffer list info with schemaID: {}",
-              schemaID);
+              table.schemaId);
     return std::make_pair(nullptr, 0);
   }
 #ifdef ENABLE_BREAKDOWN
@@ -368,7 +446,7 @@ std::pair<BufferPage *, RowOffset> PBRB::findCacheRowPosition(
   idxTimer.start();
 #endif
 
-  auto &blbs = bmIter->second;
+  BufferListBySchema *blbs = table.bufferList;
   // Search in neighboring keys
   uint32_t maxIdxSearchNum = 3;
   IndexerIterator nextIter = iter;
@@ -376,14 +454,18 @@ std::pair<BufferPage *, RowOffset> PBRB::findCacheRowPosition(
   BufferPage *nextPagePtr = nullptr;
   RowOffset nextOff = UINT32_MAX;
   for (int i = 0;
-       i < maxIdxSearchNum && nextIter != _indexListPtr->at(schemaID)->end();
-       i++) {
+       i < maxIdxSearchNum && nextIter != table.indexer->end(); i++) {
     nextIter++;
-    if (nextIter == _indexListPtr->at(schemaID)->end()) break;
+    if (nextIter == table.indexer->end()) break;
     auto valuePtr = &nextIter->second;
     if (valuePtr->isHot()) {
       RowAddr rowAddr = valuePtr->getPBRBAddr();
-      auto retVal = findPageAndRowByAddr(rowAddr);
+      if (rowAddr == nullptr) continue;
+      auto retVal = findPageAndRowByAddr(blbs, rowAddr);
+      // the row may have been dropped and its page unlinked since
+      if (retVal.first->isLivePage() == false ||
+          retVal.first->getSchemaIDPage() != table.schemaId)
+        continue;
       nextPagePtr = retVal.first;
       nextOff = retVal.second;
       break;
@@ -397,15 +479,14 @@ std::pair<BufferPage *, RowOffset> PBRB::findCacheRowPosition(
   std::pair<BufferPage *, RowOffset> result = std::make_pair(nullptr, 0);
   // Case 1: key -> nullptr
   if (nextPagePtr == nullptr) {
-    result = traverseFindEmptyRow(schemaID);
+    result = traverseFindEmptyRow(blbs);
   }
-  // Case 2: key -> nextPagePtr findEmptySlotInPage(maxRowCnt,
-  // nextPagePtr, 0, endOffset);
+  // Case 2: key -> nextPagePtr claimSlotInPage(blbs, nextPagePtr, nextOff);
 
   else if (nextPagePtr != nullptr) {
-    RowOffset rowOff = findEmptySlotInPage(blbs, nextPagePtr, nextOff);
+    RowOffset rowOff = claimSlotInPage(blbs, nextPagePtr, nextOff);
     if (rowOff == UINT32_MAX)
-      result = traverseFindEmptyRow(schemaID, nextPagePtr->getNextPage());
+      result = traverseFindEmptyRow(blbs, nextPagePtr->getNextPage());
     else
       result = std::make_pair(nextPagePtr, rowOff);
   }
@@ -420,47 +501,83 @@ std::pair<BufferPage *, RowOffset> PBRB::findCacheRowPosition(
 
   return result;
 }
-bool PBRB::read(TimeStamp oldTS, TimeStamp newTS, const RowAddr addr,
-                SchemaId schemaid, Value &value, ValuePtr *vPtr,
-                uint32_t fieldId) {
+TableHandle PBRB::_tableOf(SchemaId schemaId) {
+  TableHandle table;
+  table.schemaId = schemaId;
+  table.schema = _schemaUMap->find(schemaId);
+  auto idxIter = _indexListPtr->find(schemaId);
+  if (idxIter != _indexListPtr->end()) table.indexer = idxIter->second.get();
+  resolveTable(table);
+  return table;
+}
+
+void PBRB::resolveTable(TableHandle &table) {
+  auto bmIter = _bufferMap.find(table.schemaId);
+  if (bmIter != _bufferMap.end()) table.bufferList = bmIter->second.get();
+  auto statIter = _AccStatBySchema.find(table.schemaId);
+  if (statIter != _AccStatBySchema.end())
+    table.accessStat = &statIter->second;
+  auto queueIter = _asyncQueueMap.find(table.schemaId);
+  if (queueIter != _asyncQueueMap.end())
+    table.asyncQueue = queueIter->second.get();
+}
+
+bool PBRB::read(ValuePtr::State oldState, TimeStamp newTS,
+                const RowAddr addr, SchemaId schemaid, Value &value,
+                ValuePtr *vPtr, uint32_t fieldId) {
+  return read(oldState, newTS, addr, _tableOf(schemaid), value, vPtr, fieldId);
+}
+
+bool PBRB::read(ValuePtr::State oldState, TimeStamp newTS,
+                const RowAddr addr, const TableHandle &table, Value &value,
+                ValuePtr *vPtr, uint32_t fieldId) {
   BufferPage *pagePtr = getPageAddr(addr);
-  auto &blbs = _bufferMap[schemaid];
-  if (vPtr->setHotTimeStamp(oldTS, newTS) == false) {
+  if (_recordHit(pagePtr, addr, vPtr, oldState, newTS) == false) {
     return false;
   }
-  pagePtr->setTimestampRow(addr, newTS);
-  Schema *schema = _schemaUMap->find(schemaid);
-  char *valuePtr = pagePtr->getValuePtr(addr);
+  uint32_t seq = pagePtr->getSeqRow(addr);
+  Schema *schema = table.schema;
+  char *valuePtr = _rowToParse(pagePtr, addr, table, seq);
+  if (valuePtr == nullptr) return false;
 
   if (fieldId == UINT32_MAX) {
-    return SchemaParser::ParseFromTwoPartToSeq(schema, value, valuePtr);
+    bool s = SchemaParser::ParseFromTwoPartToSeq(schema, value, valuePtr);
+    return _validateRow(pagePtr, addr, vPtr, oldState, seq) && s;
   }
 
   ValueReader fieldReader(schema);
   bool s = fieldReader.ExtractFieldFromFullRow(valuePtr, fieldId, value);
+  if (_validateRow(pagePtr, addr, vPtr, oldState, seq) == false) return false;
   if (s == false) {
-    fieldReader.ExtractFieldFromPmemRow(pagePtr->getPlogAddrRow(addr),
-                                        _enginePtr, fieldId, value);
+    fieldReader.ExtractFieldFromPmemRow(oldState.getPmemAddr(), _enginePtr,
+                                        fieldId, value);
   }
   NKV_LOG_D(std::cout,
             "PBRB: Successfully read row [ts: {}, value: {}, value.size(): {}]",
-            oldTS, value, value.size());
+            newTS, value, value.size());
   return true;
 }
 // Extern interfaces:
 
-bool PBRB::read(TimeStamp oldTS, TimeStamp newTS, const RowAddr addr,
-                SchemaId schemaid, vector<Value> &values, ValuePtr *vPtr,
+bool PBRB::read(ValuePtr::State oldState, TimeStamp newTS,
+                const RowAddr addr, SchemaId schemaid, vector<Value> &values,
+                ValuePtr *vPtr, vector<uint32_t> fields) {
+  return read(oldState, newTS, addr, _tableOf(schemaid), values, vPtr, fields);
+}
+
+bool PBRB::read(ValuePtr::State oldState, TimeStamp newTS,
+                const RowAddr addr, const TableHandle &table,
+                vector<Value> &values, ValuePtr *vPtr,
                 vector<uint32_t> fields) {
   BufferPage *pagePtr = getPageAddr(addr);
-  auto &blbs = _bufferMap[schemaid];
-  if (vPtr->setHotTimeStamp(oldTS, newTS) == false) {
+  if (_recordHit(pagePtr, addr, vPtr, oldState, newTS) == false) {
     return false;
   }
-  pagePtr->setTimestampRow(addr, newTS);
+  uint32_t seq = pagePtr->getSeqRow(addr);
 
-  Schema *schema = _schemaUMap->find(schemaid);
-  char *valuePtr = pagePtr->getValuePtr(addr);
+  Schema *schema = table.schema;
+  char *valuePtr = _rowToParse(pagePtr, addr, table, seq);
+  if (valuePtr == nullptr) return false;
   ValueReader fieldReader(schema);
   for (uint32_t i = 0; i < fields.size(); i++) {
     bool s = fieldReader.ExtractFieldFromFullRow(valuePtr, fields[i], values[i]);
@@ -469,16 +586,73 @@ bool PBRB::read(TimeStamp oldTS, TimeStamp newTS, const RowAddr addr,
     //                                       _enginePtr, fields[i], values[i]);
     // }
   }
+  if (_validateRow(pagePtr, addr, vPtr, oldState, seq) == false) return false;
   NKV_LOG_D(std::cout,
             "PBRB: Successfully read row [ts: {}, value: {}, value.size(): {}]",
-            oldTS, valuePtr, values.size());
+            newTS, valuePtr, values.size());
   NKV_LOG_D(std::cout,
             "PBRB: Successfully read row [ts: {}, value: {}, value.size(): {}]",
-            oldTS, valuePtr, values.size());
+            newTS, valuePtr, values.size());
   return true;
 }
-bool PBRB::write(TimeStamp oldTS, TimeStamp newTS, SchemaId schemaId,
+bool PBRB::_sampleAccess() {
+  // xorshift, seeded apart per thread so that threads sample different hits
+  static thread_local uint32_t seed =
+      std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed % ACCESS_SAMPLE_RATE == 0;
+}
+
+void PBRB::_advanceAccessClock(TimeStamp now) {
+  uint64_t clock = _accessClock.load(std::memory_order_relaxed);
+  while (clock < now.txn_ticks &&
+         !_accessClock.compare_exchange_weak(clock, now.txn_ticks,
+                                             std::memory_order_relaxed))
+    ;
+}
+
+bool PBRB::_recordHit(BufferPage *pagePtr, RowAddr addr, ValuePtr *vPtr,
+                      const ValuePtr::State &seen, TimeStamp newTS) {
+  // a hit that is not recorded only checks the row is still the entry's
+  if (newTS.txn_ticks == 0) return vPtr->matches(seen);
+  if (vPtr->setHotTimeStamp(seen, newTS) == false) return false;
+  // GC goes by the entry, the stamp in the row is only kept exact
+  if (_accessTracking == AccessTracking::EXACT)
+    pagePtr->setTimestampRow(addr, newTS);
+  return true;
+}
+
+// Rows are read optimistically: the row seq is taken before the copy and
+// checked after it, along with the entry still holding the row in the
+// state the caller saw. A row that changed meanwhile has left the entry for
+// good, so the caller falls back to the plog rather than retrying.
+char *PBRB::_rowToParse(BufferPage *pagePtr, RowAddr addr,
+                        const TableHandle &table, uint32_t seq) {
+  char *valuePtr = pagePtr->getValuePtr(addr);
+  if (table.schema->hasVarField() == false) return valuePtr;
+  // heap pointers of variable fields are only followed from a copy of the
+  // row that checked out; their content is checked with the row after
+  static thread_local std::string snapshot;
+  snapshot.assign(valuePtr, table.bufferList->valueSize);
+  if (pagePtr->validateSeqRow(addr, seq) == false) return nullptr;
+  return snapshot.data();
+}
+
+bool PBRB::_validateRow(BufferPage *pagePtr, RowAddr addr, ValuePtr *vPtr,
+                        const ValuePtr::State &seen, uint32_t seq) {
+  return pagePtr->validateSeqRow(addr, seq) && vPtr->matches(seen);
+}
+
+bool PBRB::write(ValuePtr::State oldState, TimeStamp newTS, SchemaId schemaId,
                  const Value &value, IndexerIterator iter) {
+  return write(oldState, newTS, _tableOf(schemaId), value, iter);
+}
+
+bool PBRB::write(ValuePtr::State oldState, TimeStamp newTS,
+                 const TableHandle &table, const Value &value,
+                 IndexerIterator iter) {
   // if (_bufferMap.find(schemaId) == _bufferMap.end()) {
   //   NKV_LOG_I(
   //       std::cout,
@@ -486,23 +660,25 @@ bool PBRB::write(TimeStamp oldTS, TimeStamp newTS, SchemaId schemaId,
   //       schemaId);
   //   createCacheForSchema(schemaId);
   // }
-  double lastIntervalHitRatio =
-      _AccStatBySchema[schemaId].getLastIntervalHitRatio();
+  if (table.bufferList == nullptr) return false;
+  double lastIntervalHitRatio = table.accessStat->getLastIntervalHitRatio();
   if (lastIntervalHitRatio > 0 && lastIntervalHitRatio < _hitThreshold) {
     return false;
   }
   if (_async_pbrb == true) {
-    return asyncWrite(oldTS, newTS, schemaId, value, iter);
+    return table.asyncQueue->EnqueueOneEntry(oldState, newTS, iter, value);
   }
-  return writeImpl(oldTS, newTS, schemaId, value, iter);
+  return writeImpl(oldState, newTS, table, value, iter);
 }
 
-bool PBRB::writeImpl(TimeStamp oldTS, TimeStamp newTS, SchemaId schemaid,
-                     const Value &value, IndexerIterator iter) {
+bool PBRB::writeImpl(ValuePtr::State oldState, TimeStamp newTS,
+                     const TableHandle &table, const Value &value,
+                     IndexerIterator iter) {
   auto valuePtr = &iter->second;
+  if (_accessTracking == AccessTracking::COARSE) _advanceAccessClock(newTS);
 
   // Check value size:
-  auto &blbs = _bufferMap[schemaid];
+  BufferListBySchema *blbs = table.bufferList;
   if (blbs->valueSize != value.size()) {
     NKV_LOG_E(std::cerr, "Value size: {} != blbs->valueSize: {}, Aborted",
               value.size(), blbs->valueSize);
@@ -510,31 +686,31 @@ bool PBRB::writeImpl(TimeStamp oldTS, TimeStamp newTS, SchemaId schemaid,
   }
 
   //  2. Find a position.
-  auto retVal = findCacheRowPosition(schemaid, iter);
+  auto retVal = findCacheRowPosition(table, iter);
   BufferPage *pagePtr = retVal.first;
   RowOffset rowOffset = retVal.second;
   if (pagePtr == nullptr) {
     // NKV_LOG_E(std::cout, "Warning: Cannot find empty slot!");
     return false;
   }
-  RowAddr rowAddr = getAddrByPageAndRow(pagePtr, rowOffset);
+  blbs->curRowNum++;
+  RowAddr rowAddr = getAddrByPageAndRow(blbs, pagePtr, rowOffset);
 
   // 3. copy row.
   // copy header:
 
+  pagePtr->beginWriteRow(rowAddr);
   pagePtr->setTimestampRow(rowAddr, newTS);
-  pagePtr->setPlogAddrRow(rowAddr, valuePtr->getPmemAddr());
+  pagePtr->setPlogAddrRow(rowAddr, oldState.getPmemAddr());
   pagePtr->setKVNodeAddrRow(rowAddr, valuePtr);
   // copy row content:
   pagePtr->setValueRow(rowAddr, value, blbs->valueSize);
-  pagePtr->setRowBitMapPage(rowOffset);
-  blbs->curRowNum++;
+  pagePtr->endWriteRow(rowAddr);
 
   // 4. Check consistency && Update ValuePtr
-  if (valuePtr->setHotPBRBAddr(rowAddr, oldTS, newTS) == false) {
+  if (valuePtr->setHotPBRBAddr(rowAddr, oldState, newTS) == false) {
     // Rollback
-    pagePtr->clearRowBitMapPage(rowOffset);
-    blbs->curRowNum--;
+    _releaseRow(blbs, pagePtr, rowOffset, table.indexer->getEpochManager());
     // NKV_LOG_I(std::cout,
     //           "PBRB: Write [{}] operation timestamp [{}->{}] conflict with
     //           hot "
@@ -546,13 +722,6 @@ bool PBRB::writeImpl(TimeStamp oldTS, TimeStamp newTS, SchemaId schemaid,
   return true;
 }
 
-bool PBRB::asyncWrite(TimeStamp oldTS, TimeStamp newTS, SchemaId schemaId,
-                      const Value &value, IndexerIterator iter) {
-  auto res =
-      _asyncQueueMap[schemaId]->EnqueueOneEntry(oldTS, newTS, iter, value);
-  return res;
-}
-
 void PBRB::asyncWriteHandler(decltype(&_asyncThreadPollList) pollList) {
   // first sleep to wait for create schema to trigger
   while (true) {
@@ -570,9 +739,14 @@ void PBRB::asyncWriteHandler(decltype(&_asyncThreadPollList) pollList) {
 #endif
         auto bufferEntry = asyncBuffer->DequeueOneEntry();
         if (bufferEntry != nullptr) {
-          writeImpl(bufferEntry->_oldTS, bufferEntry->_newTS,
-                    asyncBuffer->getSchemaId(), bufferEntry->_entry_content,
-                    bufferEntry->_iter);
+          TableHandle table = _tableOf(asyncBuffer->getSchemaId());
+          EpochGuard guard(table.indexer->getEpochManager());
+          // the entry may have been removed and freed since it was queued
+          if (table.indexer->find(bufferEntry->_primaryKey) ==
+              bufferEntry->_iter) {
+            writeImpl(bufferEntry->_oldState, bufferEntry->_newTS, table,
+                      bufferEntry->_entry_content, bufferEntry->_iter);
+          }
           bufferEntry->consumeContent();
 #ifdef ENABLE_STATISTICS
           _timer.end();
@@ -587,25 +761,52 @@ void PBRB::asyncWriteHandler(decltype(&_asyncThreadPollList) pollList) {
 }
 bool PBRB::dropRow(RowAddr rAddr, Schema *schemaPtr) {
   auto [pagePtr, rowOffset] = findPageAndRowByAddr(rAddr);
+  BufferListBySchema *blbs = _bufferMap.at(pagePtr->getSchemaIDPage()).get();
+  EpochManager *epochs =
+      _indexListPtr->at(pagePtr->getSchemaIDPage())->getEpochManager();
+  // readers still copying the row fail their check from here on
+  pagePtr->beginWriteRow(rAddr);
   if (schemaPtr->hasVarField() == true) {
     SchemaParser *parser = _sParser->operator[](1);
-    parser->FreeTwoPartRow(schemaPtr, pagePtr->getValuePtr(rAddr));
+    if (epochs == nullptr) {
+      parser->FreeTwoPartRow(schemaPtr, pagePtr->getValuePtr(rAddr));
+    } else {
+      // a reader may still follow the heap pointers of its copy of the row,
+      // so they are freed from a copy once its epoch is over
+      std::string fixedPart(pagePtr->getValuePtr(rAddr), blbs->valueSize);
+      epochs->retire([parser, schemaPtr, fixedPart]() mutable {
+        parser->FreeTwoPartRow(schemaPtr, fixedPart.data());
+      });
+    }
   }
+  pagePtr->endWriteRow(rAddr);
+  return _releaseRow(blbs, pagePtr, rowOffset, epochs);
+}
 
-  bool result = pagePtr->clearRowBitMapPage(rowOffset);
-  if (result == true) {
-    auto &blbs = _bufferMap.at(pagePtr->getSchemaIDPage());
-    blbs->curRowNum--;
-    if (pagePtr->getHotRowsNumPage() == 0)
-      blbs->reclaimPage(_freePageList, pagePtr);
+bool PBRB::_releaseRow(BufferListBySchema *blbs, BufferPage *pagePtr,
+                       RowOffset rowOffset, EpochManager *epochs) {
+  if (pagePtr->clearRowBitMapPage(rowOffset) == false) return false;
+  blbs->curRowNum--;
+  // a writer claiming a row first keeps the page, else the sealer unlinks it
+  if (pagePtr->getHotRowsNumPage() != 0 || pagePtr->sealPage() == false)
+    return true;
+  blbs->unlinkPage(pagePtr);
+  // a writer may have taken the page from a neighbouring row or the list
+  // before it emptied, it finds the page sealed until its epoch is over
+  if (epochs == nullptr) {
+    _pushFreePage(pagePtr);
     return true;
   }
-  return false;
+  // counted as free right away, GC evicts while it holds an epoch itself
+  _localFreePageCache().freeDelta.fetch_add(1, std::memory_order_relaxed);
+  epochs->retire([this, pagePtr] { _cacheFreePage(pagePtr); });
+  return true;
 }
 
 bool PBRB::evictRow(IndexerIterator &iter, Schema *schemaPtr) {
-  RowAddr rAddr = iter->second.getPBRBAddr();
-  iter->second.evictToCold();
+  // a writer or a remove took the row out first
+  RowAddr rAddr = iter->second.evictToCold();
+  if (rAddr == nullptr) return false;
   if (dropRow(rAddr, schemaPtr) == false) return false;
   _evictCnt++;
   return true;
@@ -618,7 +819,7 @@ bool PBRB::traverseIdxGC() {
   NKV_LOG_I(std::cout,
             "Current number of free pages / max page number : ({} / {}), "
             "OccupancyRatio = {:.3f}",
-            _freePageList.size(), getMaxPageNumber(), occupancyRatio);
+            _freePageNum(), getMaxPageNumber(), occupancyRatio);
   if (occupancyRatio < _targetOccupancyRatio) {
     return true;
   }
@@ -653,6 +854,7 @@ bool PBRB::_checkOccupancyRatio(double ratio) {
 bool PBRB::_traverseIdxGCBySchema(SchemaId schemaid) {
   TimeStamp startTS;
   startTS.getNow();
+  _advanceAccessClock(startTS);
   // Adjust retention window size
   TimeStamp watermark = startTS;
   double occupancyRatio = _bufferMap.at(schemaid)->getOccupancyRatio();
@@ -673,11 +875,16 @@ bool PBRB::_traverseIdxGCBySchema(SchemaId schemaid) {
   // Traversal
   uint64_t evictCnt = 0;
   auto &idx = _indexListPtr->at(schemaid);
+  EpochManager *epochs = idx->getEpochManager();
+  // rows dropped by removes come back once their readers are gone
+  if (epochs != nullptr) epochs->tryReclaim();
+  EpochGuard guard(epochs);
   bool achieveTarget = false;
   for (auto iter = idx->begin(); iter != idx->end(); iter++) {
-    // Compare with watermark
+    // Compare with watermark; a SAMPLED or COARSE tick may trail the last
+    // hit, which only makes the row look a little older than it is
     ValuePtr &valuePtr = iter->second;
-    if (valuePtr.isHot() == false || valuePtr.getTimestamp().gt(watermark))
+    if (valuePtr.isHot() == false || valuePtr.accessedAfter(watermark))
       continue;
     if (evictRow(iter, schemaPtr)) {
       evictCnt++;
@@ -703,6 +910,11 @@ bool PBRB::_traverseIdxGCBySchema(SchemaId schemaid) {
 
 bool PBRB::_asyncTraverseIdxGC() {
   while (_isGCRunning.load(std::memory_order_acquire)) {
+    if (_accessTracking == AccessTracking::COARSE) {
+      TimeStamp now;
+      now.getNow();
+      _advanceAccessClock(now);
+    }
     if (_checkOccupancyRatio(_startGCOccupancyRatio)) {
       std::this_thread::sleep_for(_gcIntervalMicrosecs);
       // std::this_thread::yield();
@@ -733,6 +945,16 @@ bool PBRB::schemaMiss(SchemaId sid) {
     ;  // traverseIdxGC();
   return true;
 }
+bool PBRB::schemaHit(const TableHandle &table) {
+  if (table.accessStat == nullptr) return false;
+  table.accessStat->hit();
+  return true;
+}
+bool PBRB::schemaMiss(const TableHandle &table) {
+  if (table.accessStat == nullptr) return false;
+  table.accessStat->miss();
+  return true;
+}
 double PBRB::getHitRatio(SchemaId sid) {
   auto it = _AccStatBySchema.find(sid);
   if (it == _AccStatBySchema.end()) return -1;
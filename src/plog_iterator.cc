@@ -0,0 +1,91 @@
+//
+//  plog_iterator.cc
+//  PROJECT plog_iterator
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "plog_iterator.h"
+#include <immintrin.h>
+#include <thread>
+#include "logging.h"
+
+namespace NKV {
+
+RowMetaHead *PlogIterator::_loadHead(PmemAddress addr) {
+  char *ptr = _engine->convertToPtr(addr);
+  if (ptr == nullptr) return nullptr;
+  // pairs with the release store that publishes the head
+  uint64_t headWord =
+      __atomic_load_n(reinterpret_cast<uint64_t *>(ptr), __ATOMIC_ACQUIRE);
+  if (headWord == 0) return nullptr;
+  return RowMetaPtr(ptr);
+}
+
+bool PlogIterator::Next(PlogRecord &record) {
+  uint64_t chunkSize = _engine->getChunkSize();
+  while (_position < _engine->getUsedSpace()) {
+    // a gap smaller than a head at the end of a chunk is never written
+    uint64_t chunkLeft = chunkSize - _position % chunkSize;
+    if (chunkLeft < ROW_META_HEAD_SIZE) {
+      _position += chunkLeft;
+      continue;
+    }
+    RowMetaHead *head = _loadHead(_position);
+    if (head == nullptr) return false;
+    if (head->getType() == RowType::CHUNK_PADDING) {
+      _position += chunkLeft;
+      continue;
+    }
+    record.recordAddr = _position;
+    record.hasKey = false;
+    record.primaryKey = 0;
+    record.relocated = false;
+    record.relocatedFrom = 0;
+    record.schemaId = head->getSchemaId();
+    uint64_t recordSize = 0;
+    if (head->getType() == RowType::ROW_KEY ||
+        head->getType() == RowType::RELOCATED_KEY) {
+      // the row behind the key is published before the key itself
+      uint64_t *keyBody =
+          reinterpret_cast<uint64_t *>(skipRowMeta((char *)head));
+      record.hasKey = true;
+      record.primaryKey = keyBody[0];
+      if (head->getType() == RowType::RELOCATED_KEY) {
+        record.relocated = true;
+        record.relocatedFrom = keyBody[1];
+      }
+      recordSize = ROW_META_HEAD_SIZE + head->getSize();
+      head = RowMetaPtr((char *)head + recordSize);
+    }
+    record.rowAddr = _position + recordSize;
+    record.rowHead = head;
+    record.type = head->getType();
+    recordSize += alignPlogRecord(head->getSize() + ROW_META_HEAD_SIZE);
+    _position += recordSize;
+    return true;
+  }
+  return false;
+}
+
+bool PlogIterator::WaitNext(PlogRecord &record,
+                            std::chrono::microseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  uint32_t spins = 0;
+  while (Next(record) == false) {
+    if (std::chrono::steady_clock::now() >= deadline) return false;
+    // spin briefly, then yield, then back off to sleeping
+    if (spins < 64) {
+      _mm_pause();
+    } else if (spins < 128) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    spins++;
+  }
+  return true;
+}
+
+}  // namespace NKV
@@ -32,6 +32,9 @@ Status PmemLog::init(PmemEngineConfig &plog_meta) {
   }
   // get engine_path and plog_id from the input parm
   _plog_meta = plog_meta;
+  _chunk_list.reserve(
+      std::max(_plog_meta.engine_capacity / _plog_meta.chunk_size + 2,
+               _plog_meta.chunk_count + 2));
   std::string meta_file_name = _genMetaFile();
   // check whether the metafile exists
   std::filesystem::path meteaFilePath(meta_file_name);
@@ -60,6 +63,8 @@ Status PmemLog::init(PmemEngineConfig &plog_meta) {
     // assign the plog metadata info from pmem space
     _plog_meta = *(PmemEngineConfig *)_plog_meta_file.pmem_addr;
     plog_meta = _plog_meta;
+    _chunk_list.reserve(_plog_meta.engine_capacity / _plog_meta.chunk_size +
+                        _plog_meta.chunk_count + 2);
     for (uint64_t i = 0; i < _plog_meta.chunk_count; i++) {
       std::string chunk_name = _genNewChunkName();
       char *plog_addr = nullptr;
@@ -73,7 +78,8 @@ Status PmemLog::init(PmemEngineConfig &plog_meta) {
     }
 
     _tail_offset.store(_plog_meta.tail_offset);
-    _active_chunk_id.store(_tail_offset.load() / _plog_meta.chunk_size);
+    // the tail may sit on the boundary of a chunk that is not created yet
+    _active_chunk_id.store(_chunk_list.size() - 1);
   } else {
     _plog_meta = plog_meta;
     // write metadata to metaFile
@@ -115,10 +121,133 @@ Status PmemLog::append(PmemAddress &pmemAddr, const char *value,
   if (_tail_offset.load() + append_size > _plog_meta.engine_capacity) {
     return PmemStatuses::S507_Insufficient_Storage_Over_Capcity;
   }
-  pmemAddr = _append((char *)value, size);
+  // a record never straddles two chunks
+  if (alignPlogRecord(size) > _plog_meta.chunk_size) {
+    return PmemStatuses::S403_Forbidden_Invalid_Size;
+  }
+  bool mapped;
+  pmemAddr = _append(value, size, mapped);
+  if (mapped == false) {
+    return PmemStatuses::S507_Insufficient_Storage;
+  }
+  return PmemStatuses::S200_OK_Append;
+}
+
+Status PmemLog::appendWithKey(PmemAddress &rowAddr, SchemaId schemaId,
+                              uint64_t primaryKey, const char *value,
+                              uint32_t size) {
+  uint64_t record_size = ROW_KEY_RECORD_SIZE + alignPlogRecord(size);
+  if (_plog_meta.is_sealed) {
+    return PmemStatuses::S409_Conflict_Append_Sealed_engine;
+  }
+  if (_tail_offset.load() + record_size > _plog_meta.engine_capacity) {
+    return PmemStatuses::S507_Insufficient_Storage_Over_Capcity;
+  }
+  if (size < ROW_META_HEAD_SIZE || record_size > _plog_meta.chunk_size) {
+    return PmemStatuses::S403_Forbidden_Invalid_Size;
+  }
+  bool mapped;
+  PmemAddress keyAddr = _reserve(record_size, mapped);
+  if (mapped == false) {
+    return PmemStatuses::S507_Insufficient_Storage;
+  }
+  rowAddr = keyAddr + ROW_KEY_RECORD_SIZE;
+  char *keyPtr = _convertToPtr(keyAddr);
+  char *rowPtr = keyPtr + ROW_KEY_RECORD_SIZE;
+  // the row is published before its key record, readers start from the key
+  _copy(keyPtr + ROW_META_HEAD_SIZE, (char *)&primaryKey, sizeof(uint64_t));
+  _copy(rowPtr + ROW_META_HEAD_SIZE, value + ROW_META_HEAD_SIZE,
+        size - ROW_META_HEAD_SIZE);
+  _publish(rowPtr, value);
+  RowMetaHead keyHead;
+  keyHead.setMeta(sizeof(uint64_t), RowType::ROW_KEY, schemaId, 0);
+  _publish(keyPtr, (char *)&keyHead);
+  return PmemStatuses::S200_OK_Append;
+}
+
+Status PmemLog::appendRelocated(std::vector<PmemAddress> &rowAddrs,
+                                SchemaId schemaId,
+                                const std::vector<uint64_t> &keys,
+                                const std::vector<PmemAddress> &oldAddrs,
+                                const std::vector<std::string> &rows) {
+  if (_plog_meta.is_sealed) {
+    return PmemStatuses::S409_Conflict_Append_Sealed_engine;
+  }
+  rowAddrs.resize(rows.size());
+  size_t begin = 0;
+  while (begin < rows.size()) {
+    // take as many rows as fit in one chunk into a single reservation
+    uint64_t group_size = 0;
+    size_t end = begin;
+    for (; end < rows.size(); end++) {
+      if (rows[end].size() < ROW_META_HEAD_SIZE) {
+        return PmemStatuses::S403_Forbidden_Invalid_Size;
+      }
+      uint64_t record_size =
+          RELOCATED_KEY_RECORD_SIZE + alignPlogRecord(rows[end].size());
+      if (group_size + record_size > _plog_meta.chunk_size) break;
+      group_size += record_size;
+    }
+    if (end == begin) {
+      return PmemStatuses::S403_Forbidden_Invalid_Size;
+    }
+    if (_tail_offset.load() + group_size > _plog_meta.engine_capacity) {
+      return PmemStatuses::S507_Insufficient_Storage_Over_Capcity;
+    }
+    bool mapped;
+    PmemAddress keyAddr = _reserve(group_size, mapped);
+    if (mapped == false) {
+      return PmemStatuses::S507_Insufficient_Storage;
+    }
+    for (size_t i = begin; i < end; i++) {
+      char *keyPtr = _convertToPtr(keyAddr);
+      char *rowPtr = keyPtr + RELOCATED_KEY_RECORD_SIZE;
+      uint64_t keyBody[2] = {keys[i], oldAddrs[i]};
+      _copy(keyPtr + ROW_META_HEAD_SIZE, (char *)keyBody, sizeof(keyBody));
+      _copy(rowPtr + ROW_META_HEAD_SIZE, rows[i].data() + ROW_META_HEAD_SIZE,
+            rows[i].size() - ROW_META_HEAD_SIZE);
+      _publish(rowPtr, rows[i].data());
+      RowMetaHead keyHead;
+      keyHead.setMeta(sizeof(keyBody), RowType::RELOCATED_KEY, schemaId, 0);
+      _publish(keyPtr, (char *)&keyHead);
+      rowAddrs[i] = keyAddr + RELOCATED_KEY_RECORD_SIZE;
+      keyAddr = rowAddrs[i] + alignPlogRecord(rows[i].size());
+    }
+    begin = end;
+  }
   return PmemStatuses::S200_OK_Append;
 }
 
+Status PmemLog::replicate(PmemAddress addr, const char *data, uint32_t size) {
+  uint64_t chunk_size = _plog_meta.chunk_size;
+  if (_plog_meta.is_sealed) {
+    return PmemStatuses::S409_Conflict_Append_Sealed_engine;
+  }
+  if (addr + size > _plog_meta.engine_capacity) {
+    return PmemStatuses::S507_Insufficient_Storage_Over_Capcity;
+  }
+  uint64_t now_tail_offset = _tail_offset.load();
+  if (addr < now_tail_offset) {
+    return PmemStatuses::S403_Forbidden_Invalid_Offset;
+  }
+  if (size == 0 || addr / chunk_size != (addr + size - 1) / chunk_size) {
+    return PmemStatuses::S403_Forbidden_Invalid_Size;
+  }
+  // the primary skipped to a new chunk, pad the old one like it did
+  if (addr / chunk_size != now_tail_offset / chunk_size &&
+      now_tail_offset % chunk_size != 0 &&
+      _ensureChunkMapped(now_tail_offset / chunk_size)) {
+    _padChunkTail(now_tail_offset);
+  }
+  if (_ensureChunkMapped(addr / chunk_size) == false) {
+    return PmemStatuses::S507_Insufficient_Storage;
+  }
+  _copy(_convertToPtr(addr), data, size);
+  // readers only look below the tail, so the range is visible as a whole
+  _tail_offset.store(addr + size, std::memory_order_release);
+  return PmemStatuses::S200_OK_Write;
+}
+
 Status PmemLog::write(PmemAddress writeAddr, const char *value, uint32_t size) {
   if (writeAddr > _tail_offset.load()) {
     return PmemStatuses::S403_Forbidden_Invalid_Offset;
@@ -180,4 +309,12 @@ uint64_t PmemLog::getFreeSpace() {
 
 uint64_t PmemLog::getUsedSpace() { return _tail_offset.load(); };
 
+char *PmemLog::convertToPtr(PmemAddress addr) {
+  int64_t chunk_id = addr / _plog_meta.chunk_size;
+  if (chunk_id > _active_chunk_id.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  return _convertToPtr(addr);
+}
+
 }  // namespace NKV
@@ -0,0 +1,163 @@
+//
+//  prefix_key_index.cc
+//  PROJECT prefix_key_index
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "prefix_key_index.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace NKV {
+
+static void putVarint(std::string &out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+static uint32_t getVarint(const char *&ptr) {
+  uint32_t value = 0;
+  for (uint32_t shift = 0;; shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(*ptr++);
+    value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) return value;
+  }
+}
+
+// entry layout: varint shared, varint unshared, unshared bytes, 8 byte id
+void PrefixKeyIndex::_encode(const std::vector<Entry> &entries, size_t begin,
+                             size_t end, Block &block) {
+  block.data.clear();
+  block.count = end - begin;
+  const std::string *prev = nullptr;
+  for (size_t i = begin; i < end; i++) {
+    const std::string &key = entries[i].first;
+    uint32_t shared = 0;
+    if (prev != nullptr) {
+      size_t limit = std::min(prev->size(), key.size());
+      while (shared < limit && (*prev)[shared] == key[shared]) shared++;
+    }
+    putVarint(block.data, shared);
+    putVarint(block.data, key.size() - shared);
+    block.data.append(key, shared, std::string::npos);
+    block.data.append(reinterpret_cast<const char *>(&entries[i].second),
+                      sizeof(uint64_t));
+    prev = &key;
+  }
+  block.data.shrink_to_fit();
+}
+
+void PrefixKeyIndex::_decode(const Block &block, std::vector<Entry> &entries) {
+  const char *ptr = block.data.data();
+  std::string key;
+  for (uint32_t i = 0; i < block.count; i++) {
+    uint32_t shared = getVarint(ptr);
+    uint32_t unshared = getVarint(ptr);
+    key.resize(shared);
+    key.append(ptr, unshared);
+    ptr += unshared;
+    uint64_t id;
+    memcpy(&id, ptr, sizeof(uint64_t));
+    ptr += sizeof(uint64_t);
+    entries.emplace_back(key, id);
+  }
+}
+
+std::map<std::string, PrefixKeyIndex::Block>::iterator
+PrefixKeyIndex::_blockOf(const std::string &key) {
+  auto iter = _blocks.upper_bound(key);
+  if (iter != _blocks.begin()) iter--;
+  return iter;
+}
+
+std::map<std::string, PrefixKeyIndex::Block>::const_iterator
+PrefixKeyIndex::_blockOf(const std::string &key) const {
+  auto iter = _blocks.upper_bound(key);
+  if (iter != _blocks.begin()) iter--;
+  return iter;
+}
+
+std::pair<uint64_t, bool> PrefixKeyIndex::insert(const std::string &key,
+                                                 uint64_t id) {
+  std::unique_lock<std::shared_mutex> guard(_lock);
+  if (_blocks.empty()) {
+    _encode({{key, id}}, 0, 1, _blocks[key]);
+    _size++;
+    return {id, true};
+  }
+  auto iter = _blockOf(key);
+  std::vector<Entry> entries;
+  _decode(iter->second, entries);
+  auto pos = std::lower_bound(
+      entries.begin(), entries.end(), key,
+      [](const Entry &entry, const std::string &k) { return entry.first < k; });
+  if (pos != entries.end() && pos->first == key) return {pos->second, false};
+  entries.insert(pos, {key, id});
+  _size++;
+  // the block is re-keyed if the key went in front of it
+  _blocks.erase(iter);
+  if (entries.size() < MAX_BLOCK_KEYS) {
+    _encode(entries, 0, entries.size(), _blocks[entries.front().first]);
+  } else {
+    size_t half = entries.size() / 2;
+    _encode(entries, 0, half, _blocks[entries.front().first]);
+    _encode(entries, half, entries.size(), _blocks[entries[half].first]);
+  }
+  return {id, true};
+}
+
+bool PrefixKeyIndex::find(const std::string &key, uint64_t &id) const {
+  std::shared_lock<std::shared_mutex> guard(_lock);
+  if (_blocks.empty()) return false;
+  std::vector<Entry> entries;
+  _decode(_blockOf(key)->second, entries);
+  for (auto &entry : entries) {
+    if (entry.first == key) {
+      id = entry.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+void PrefixKeyIndex::scan(const std::string &start, bool exclusive,
+                          uint32_t limit, std::vector<Entry> &found) const {
+  std::shared_lock<std::shared_mutex> guard(_lock);
+  if (_blocks.empty()) return;
+  uint32_t count = 0;
+  std::vector<Entry> entries;
+  for (auto iter = _blockOf(start); iter != _blocks.end() && count < limit;
+       iter++) {
+    entries.clear();
+    _decode(iter->second, entries);
+    for (auto &entry : entries) {
+      if (count == limit) break;
+      if (entry.first < start || (exclusive && entry.first == start))
+        continue;
+      found.push_back(std::move(entry));
+      count++;
+    }
+  }
+}
+
+size_t PrefixKeyIndex::size() const {
+  std::shared_lock<std::shared_mutex> guard(_lock);
+  return _size;
+}
+
+size_t PrefixKeyIndex::memoryUsage() const {
+  std::shared_lock<std::shared_mutex> guard(_lock);
+  size_t bytes = 0;
+  for (auto &[firstKey, block] : _blocks) {
+    bytes += firstKey.size() + block.data.capacity() + sizeof(Block);
+  }
+  return bytes;
+}
+
+}  // namespace NKV
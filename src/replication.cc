@@ -0,0 +1,282 @@
+//
+//  replication.cc
+//  PROJECT replication
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "replication.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#include <vector>
+#include "logging.h"
+#include "neopmkv.h"
+
+namespace NKV {
+
+namespace {
+
+const std::string UNIX_PREFIX = "unix:";
+const std::string TCP_PREFIX = "tcp:";
+
+bool writeAll(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::send(fd, buf, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+// false on error or when the peer closed the connection
+bool readAll(int fd, char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::recv(fd, buf, len, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool splitHostPort(const std::string &addr, std::string &host,
+                   std::string &port) {
+  auto pos = addr.rfind(':');
+  if (pos == std::string::npos) return false;
+  host = addr.substr(0, pos);
+  port = addr.substr(pos + 1);
+  return true;
+}
+
+bool fillUnixAddr(const std::string &path, sockaddr_un &addr) {
+  if (path.size() >= sizeof(addr.sun_path)) return false;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path.c_str());
+  return true;
+}
+
+// connect or bind to a tcp endpoint, returns the socket or -1
+int openTcp(const std::string &endpoint, bool passive) {
+  std::string host, port;
+  if (!splitHostPort(endpoint.substr(TCP_PREFIX.size()), host, port)) {
+    return -1;
+  }
+  addrinfo hints, *res = nullptr;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (passive) hints.ai_flags = AI_PASSIVE;
+  if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints,
+                  &res) != 0) {
+    return -1;
+  }
+  int fd = -1;
+  for (addrinfo *ai = res; ai != nullptr; ai = ai->ai_next) {
+    fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) continue;
+    int one = 1;
+    if (passive) {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+    } else {
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+    }
+    ::close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  return fd;
+}
+
+}  // namespace
+
+int ConnectEndpoint(const std::string &endpoint) {
+  if (endpoint.rfind(TCP_PREFIX, 0) == 0) return openTcp(endpoint, false);
+  sockaddr_un addr;
+  if (endpoint.rfind(UNIX_PREFIX, 0) != 0 ||
+      !fillUnixAddr(endpoint.substr(UNIX_PREFIX.size()), addr)) {
+    NKV_LOG_E(std::cerr, "invalid replication endpoint: {}", endpoint);
+    return -1;
+  }
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (::connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int ListenEndpoint(const std::string &endpoint) {
+  int fd = -1;
+  if (endpoint.rfind(TCP_PREFIX, 0) == 0) {
+    fd = openTcp(endpoint, true);
+  } else {
+    sockaddr_un addr;
+    if (endpoint.rfind(UNIX_PREFIX, 0) != 0 ||
+        !fillUnixAddr(endpoint.substr(UNIX_PREFIX.size()), addr)) {
+      NKV_LOG_E(std::cerr, "invalid replication endpoint: {}", endpoint);
+      return -1;
+    }
+    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(addr.sun_path);
+    if (fd >= 0 && ::bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+      ::close(fd);
+      fd = -1;
+    }
+  }
+  if (fd >= 0 && ::listen(fd, 1) != 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+bool ReplicationSender::connect(std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while ((_fd = ConnectEndpoint(_endpoint)) < 0) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      NKV_LOG_E(std::cerr, "connect to follower {} failed", _endpoint);
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  _ackThread = std::thread(&ReplicationSender::_ackLoop, this);
+  return true;
+}
+
+bool ReplicationSender::_sendBatch(PmemAddress start, uint32_t size) {
+  ReplicationFrame frame{.startAddr = start, .size = size, .reserved = 0};
+  // the range is read in place from the mapped chunk
+  char *data = _engine->convertToPtr(start);
+  if (data == nullptr || !writeAll(_fd, (char *)&frame, sizeof(frame)) ||
+      !writeAll(_fd, data, size)) {
+    return false;
+  }
+  _sentOffset.store(start + size);
+  return true;
+}
+
+bool ReplicationSender::shipOnce() {
+  if (_fd < 0) return false;
+  uint64_t chunkSize = _engine->getChunkSize();
+  PmemAddress batchStart = 0;
+  uint64_t batchSize = 0;
+  PlogRecord record;
+  while (_iter.Next(record)) {
+    PmemAddress recordEnd = _iter.getPosition();
+    // a batch is a contiguous range inside one chunk
+    if (batchSize > 0 &&
+        (record.recordAddr != batchStart + batchSize ||
+         record.recordAddr / chunkSize != batchStart / chunkSize ||
+         recordEnd - batchStart > _maxBatchBytes)) {
+      if (!_sendBatch(batchStart, batchSize)) return false;
+      batchSize = 0;
+    }
+    if (batchSize == 0) batchStart = record.recordAddr;
+    batchSize = recordEnd - batchStart;
+  }
+  if (batchSize > 0) return _sendBatch(batchStart, batchSize);
+  return true;
+}
+
+void ReplicationSender::start(uint64_t idle_micro) {
+  _stopFlag.store(false);
+  _shipThread = std::thread([this, idle_micro]() {
+    while (_stopFlag.load() == false) {
+      PmemAddress sent = _sentOffset.load();
+      if (!shipOnce()) break;
+      if (sent == _sentOffset.load()) {
+        std::this_thread::sleep_for(std::chrono::microseconds(idle_micro));
+      }
+    }
+  });
+}
+
+void ReplicationSender::stop() {
+  _stopFlag.store(true);
+  if (_shipThread.joinable()) _shipThread.join();
+  if (_fd < 0) return;
+  // the follower sees the end of the stream and closes its side
+  shutdown(_fd, SHUT_WR);
+  if (_ackThread.joinable()) _ackThread.join();
+  ::close(_fd);
+  _fd = -1;
+}
+
+void ReplicationSender::_ackLoop() {
+  PmemAddress acked;
+  while (readAll(_fd, (char *)&acked, sizeof(acked))) {
+    _ackedOffset.store(acked);
+  }
+}
+
+bool ReplicationSender::waitForAck(PmemAddress offset,
+                                   std::chrono::milliseconds timeout) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (_ackedOffset.load() < offset) {
+    if (std::chrono::steady_clock::now() >= deadline) return false;
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return true;
+}
+
+ReplicationReceiver::~ReplicationReceiver() {
+  if (_listenFd >= 0) ::close(_listenFd);
+}
+
+bool ReplicationReceiver::listen() {
+  _listenFd = ListenEndpoint(_endpoint);
+  if (_listenFd < 0) return false;
+  if (_endpoint.rfind(TCP_PREFIX, 0) == 0) {
+    // report the port picked by the kernel for "tcp:host:0"
+    sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    getsockname(_listenFd, (sockaddr *)&addr, &len);
+    uint16_t port = addr.ss_family == AF_INET6
+                        ? ((sockaddr_in6 *)&addr)->sin6_port
+                        : ((sockaddr_in *)&addr)->sin_port;
+    std::string host, oldPort;
+    splitHostPort(_endpoint.substr(TCP_PREFIX.size()), host, oldPort);
+    _endpoint = TCP_PREFIX + host + ":" + std::to_string(ntohs(port));
+  }
+  return true;
+}
+
+bool ReplicationReceiver::serve(NeoPMKV *kv) {
+  if (_listenFd < 0 && !listen()) return false;
+  int fd = ::accept(_listenFd, nullptr, nullptr);
+  if (fd < 0) return false;
+  std::vector<char> buffer;
+  ReplicationFrame frame;
+  bool status = true;
+  while (readAll(fd, (char *)&frame, sizeof(frame))) {
+    buffer.resize(frame.size);
+    if (!readAll(fd, buffer.data(), frame.size) ||
+        !kv->ApplyReplicatedRange(frame.startAddr, buffer.data(),
+                                  frame.size)) {
+      NKV_LOG_E(std::cerr, "apply replicated range [{}, +{}) failed",
+                frame.startAddr, frame.size);
+      status = false;
+      break;
+    }
+    PmemAddress applied = frame.startAddr + frame.size;
+    _appliedOffset.store(applied);
+    if (!writeAll(fd, (char *)&applied, sizeof(applied))) break;
+  }
+  ::close(fd);
+  return status;
+}
+
+}  // namespace NKV
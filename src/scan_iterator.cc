@@ -0,0 +1,128 @@
+//
+//  scan_iterator.cc
+//  PROJECT scan_iterator
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "scan_iterator.h"
+#include <algorithm>
+#include "logging.h"
+#include "neopmkv.h"
+
+namespace NKV {
+
+ScanIterator::ScanIterator(NeoPMKV *kv, const TableHandle &table,
+                           const ScanRange &range)
+    : _kv(kv),
+      _table(&table),
+      _reverse(range.reverse),
+      _epochs(table.indexer->getEpochManager()) {
+  _batch.reserve(SCAN_BATCH);
+  if (table.indexer->isOrdered() == false) {
+    NKV_LOG_E(std::cerr, "schema {} has no ordered index to scan",
+              table.schemaId);
+    _exhausted = true;
+    return;
+  }
+  if (range.toInclusive(_lo, _hi) == false) {
+    _exhausted = true;
+    return;
+  }
+  _refill();
+}
+
+void ScanIterator::Next() {
+  _pos++;
+  _decoded = false;
+  if (_pos >= _batch.size()) _refill();
+}
+
+const Value &ScanIterator::getValue() {
+  if (_decoded == false) {
+    if (_kv->getValueHelper(_batch[_pos], *_table, _value) == false)
+      _value.clear();
+    _decoded = true;
+  }
+  return _value;
+}
+
+void ScanIterator::_refill() {
+  _batch.clear();
+  _pos = 0;
+  _decoded = false;
+  // the entries of the last batch are not touched any more
+  _leaveEpoch();
+  if (_exhausted) return;
+  if (_epochs != nullptr) {
+    _epoch = _epochs->enter();
+    _inEpoch = true;
+  }
+  if (_reverse) {
+    _refillReverse();
+  } else {
+    _refillForward();
+  }
+}
+
+void ScanIterator::_refillForward() {
+  IndexerT *indexer = _table->indexer;
+  for (auto iter = indexer->lower_bound(_lo);
+       _batch.size() < SCAN_BATCH && iter != indexer->end() &&
+       iter->first <= _hi;
+       iter++) {
+    _batch.push_back(iter);
+  }
+  if (_batch.size() < SCAN_BATCH || _batch.back()->first == _hi) {
+    _exhausted = true;
+  } else {
+    _lo = _batch.back()->first + 1;
+  }
+}
+
+// The index only walks forward, so a reverse batch is the window of the
+// _stride keys below _hi read forward and handed out backwards. The window
+// widens while it comes up short and narrows when it holds too many.
+void ScanIterator::_refillReverse() {
+  IndexerT *indexer = _table->indexer;
+  for (;;) {
+    uint64_t from = _hi - _lo >= _stride ? _hi - _stride + 1 : _lo;
+    bool tooDense = false;
+    for (auto iter = indexer->lower_bound(from);
+         iter != indexer->end() && iter->first <= _hi; iter++) {
+      if (_batch.size() == 4 * SCAN_BATCH) {
+        tooDense = true;
+        break;
+      }
+      _batch.push_back(iter);
+    }
+    if (tooDense) {
+      _batch.clear();
+      _stride = std::max<uint64_t>(_stride / 8, 1);
+      continue;
+    }
+    if (from == _lo) {
+      _exhausted = true;
+    } else {
+      _hi = from - 1;
+    }
+    if (_batch.size() < SCAN_BATCH / 2) {
+      _stride = _stride > UINT64_MAX / 2 ? UINT64_MAX : _stride * 2;
+    } else if (_batch.size() > SCAN_BATCH * 2) {
+      _stride = std::max<uint64_t>(_stride / 2, 1);
+    }
+    if (_batch.empty() && !_exhausted) continue;
+    std::reverse(_batch.begin(), _batch.end());
+    return;
+  }
+}
+
+void ScanIterator::_leaveEpoch() {
+  if (_inEpoch) {
+    _epochs->exit(_epoch);
+    _inEpoch = false;
+  }
+}
+
+}  // namespace NKV
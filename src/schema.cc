@@ -60,6 +60,7 @@ Schema::Schema(std::string name, uint32_t schemaId, uint32_t primaryKeyField,
       latestVersion(0),
       schemaId(schemaId),
       primaryKeyField(primaryKeyField),
+      keyFields({primaryKeyField}),
       fields(fields) {
   size += ROW_META_HEAD_SIZE;
   for (auto &field : fields) {
@@ -90,6 +91,8 @@ Schema::Schema(const Schema &obj) {
   latestVersion = obj.latestVersion;
   schemaId = obj.schemaId;
   primaryKeyField = obj.primaryKeyField;
+  keyFields = obj.keyFields;
+  encodedKey = obj.encodedKey;
   size = obj.size;
   allFieldSize = obj.allFieldSize;
   hasVariableField = obj.hasVariableField;
@@ -0,0 +1,62 @@
+//
+//  secondary_index.cc
+//  PROJECT secondary_index
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "secondary_index.h"
+#include <mutex>
+#include "key_codec.h"
+
+namespace NKV {
+
+SecondaryIndex::SecondaryIndex(Schema *schemaPtr, uint32_t fieldId)
+    : _type(schemaPtr->getFieldType(fieldId)),
+      _fieldId(fieldId),
+      _fieldSize(schemaPtr->getSize(fieldId)) {}
+
+bool SecondaryIndex::isIndexable(FieldType type) {
+  return type == FieldType::INT16T || type == FieldType::INT32T ||
+         type == FieldType::INT64T || type == FieldType::STRING;
+}
+
+std::string SecondaryIndex::encode(const Value &fieldValue) const {
+  std::string encoded;
+  KeyCodec::encodeField(_type, _fieldSize, fieldValue, encoded);
+  return encoded;
+}
+
+void SecondaryIndex::insert(const Value &fieldValue, uint64_t primaryKey) {
+  std::string encoded = encode(fieldValue);
+  std::unique_lock<std::shared_mutex> guard(_lock);
+  _entries.emplace(std::move(encoded), primaryKey);
+}
+
+void SecondaryIndex::erase(const Value &fieldValue, uint64_t primaryKey) {
+  std::string encoded = encode(fieldValue);
+  std::unique_lock<std::shared_mutex> guard(_lock);
+  _entries.erase({encoded, primaryKey});
+}
+
+void SecondaryIndex::lookup(const Value &low, const Value &high,
+                            std::vector<uint64_t> &primaryKeys,
+                            uint32_t limit) const {
+  std::string lowKey = encode(low);
+  std::string highKey = encode(high);
+  std::shared_lock<std::shared_mutex> guard(_lock);
+  for (auto iter = _entries.lower_bound({lowKey, 0});
+       iter != _entries.end() && iter->first <= highKey &&
+       primaryKeys.size() < limit;
+       iter++) {
+    primaryKeys.push_back(iter->second);
+  }
+}
+
+size_t SecondaryIndex::size() const {
+  std::shared_lock<std::shared_mutex> guard(_lock);
+  return _entries.size();
+}
+
+}  // namespace NKV
@@ -0,0 +1,163 @@
+//
+//  async_kv_test.cc
+//  PROJECT async_kv_test
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "async_kv.h"
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include "gtest/gtest.h"
+#include "neopmkv.h"
+#include "schema.h"
+
+using namespace NKV;
+
+class AsyncKVTest : public testing::Test {
+ public:
+  void SetUp() override {
+    std::filesystem::remove_all(db_path);
+    kv_ = new NeoPMKV(db_path, chunk_size, db_size, true);
+    sid_ = kv_->CreateSchema(fields, 0, "async");
+  }
+  void TearDown() override {
+    delete kv_;
+    std::filesystem::remove_all(db_path);
+  }
+
+  std::vector<Value> BuildValue(uint32_t i, uint32_t seed) {
+    std::string num = std::to_string(i + seed);
+    return {std::string(8 - num.size(), '0') + num,
+            std::string(16 - num.size(), '1') + num,
+            std::string(16 - num.size(), '2') + num};
+  }
+
+  // Get returns the full row with its meta head
+  Value RowOf(const Value &row) { return row.substr(ROW_META_HEAD_SIZE); }
+
+  // reap until count completions arrived, sorted by userData
+  std::vector<AsyncCompletion> Reap(AsyncCompletionQueue &cq, uint32_t count) {
+    std::vector<AsyncCompletion> done;
+    while (done.size() < count) {
+      if (cq.wait(done, 1, count - done.size()) == 0) break;
+    }
+    std::sort(done.begin(), done.end(),
+              [](const AsyncCompletion &a, const AsyncCompletion &b) {
+                return a.userData < b.userData;
+              });
+    return done;
+  }
+
+ protected:
+  NeoPMKV *kv_ = nullptr;
+  SchemaId sid_ = 0;
+  std::string db_path = "/mnt/pmem0/tmp-neopmkv-async";
+  std::vector<SchemaField> fields{SchemaField(FieldType::INT64T, "pk"),
+                                  SchemaField(FieldType::STRING, "f1", 16),
+                                  SchemaField(FieldType::STRING, "f2", 16)};
+  const uint64_t chunk_size = 1ULL << 20;
+  const uint64_t db_size = 256ULL << 20;
+};
+
+TEST_F(AsyncKVTest, SubmitAndPoll) {
+  AsyncKV async(kv_, 4, 4096);
+  AsyncCompletionQueue cq;
+  uint32_t count = 1000;
+  for (uint32_t i = 0; i < count; i++) {
+    ASSERT_TRUE(async.SubmitPut(Key(sid_, i), BuildValue(i, 1), cq, i));
+  }
+  auto done = Reap(cq, count);
+  ASSERT_EQ(done.size(), count);
+  for (uint32_t i = 0; i < count; i++) {
+    EXPECT_EQ(done[i].userData, i);
+    EXPECT_EQ(done[i].op, AsyncOp::PUT);
+    EXPECT_TRUE(done[i].status);
+  }
+  EXPECT_EQ(cq.inflight(), 0);
+
+  // a write and the read after it of one key stay in order
+  Value update(16, 'u');
+  for (uint32_t i = 0; i < count; i++) {
+    if (i % 2 == 0) {
+      ASSERT_TRUE(
+          async.SubmitPartialUpdate(Key(sid_, i), update, 1, cq, i * 2));
+    }
+    ASSERT_TRUE(async.SubmitGet(Key(sid_, i), cq, i * 2 + 1));
+  }
+  ASSERT_TRUE(async.SubmitGet(Key(sid_, count + 1), cq, count * 2));
+  done = Reap(cq, count / 2 + count + 1);
+  ASSERT_EQ(done.size(), count / 2 + count + 1);
+  for (auto &completion : done) {
+    uint32_t i = completion.userData / 2;
+    if (i == count) {
+      EXPECT_FALSE(completion.status);
+      EXPECT_TRUE(completion.value.empty());
+      continue;
+    }
+    EXPECT_TRUE(completion.status);
+    if (completion.userData % 2 == 0) {
+      EXPECT_EQ(completion.op, AsyncOp::PARTIAL_UPDATE);
+      continue;
+    }
+    auto fields = BuildValue(i, 1);
+    if (i % 2 == 0) fields[1] = update;
+    EXPECT_EQ(completion.op, AsyncOp::GET);
+    EXPECT_EQ(RowOf(completion.value), fields[0] + fields[1] + fields[2]);
+  }
+  std::vector<AsyncCompletion> none;
+  EXPECT_EQ(cq.poll(none), 0);
+}
+
+TEST_F(AsyncKVTest, ManyLoops) {
+  uint32_t threadNum = 4;
+  uint32_t perThread = 2000;
+  AsyncKV async(kv_, 2, 64);
+  std::vector<std::thread> loops;
+  std::atomic<uint32_t> bad{0};
+  for (uint32_t t = 0; t < threadNum; t++) {
+    loops.emplace_back([&, t] {
+      // each loop reaps only its own completions, keeping a window in flight
+      AsyncCompletionQueue cq;
+      std::vector<AsyncCompletion> done;
+      uint32_t submitted = 0;
+      uint32_t reaped = 0;
+      while (reaped < perThread) {
+        while (submitted < perThread && cq.inflight() < 32) {
+          uint32_t key = t * perThread + submitted;
+          // a full ring is retried after reaping
+          if (!async.SubmitPut(Key(sid_, key), BuildValue(key, 2), cq, key))
+            break;
+          submitted++;
+        }
+        done.clear();
+        if (cq.inflight() == 0) {
+          // the rings are full of the other loops' requests
+          std::this_thread::yield();
+          continue;
+        }
+        reaped += cq.wait(done, 1);
+        for (auto &completion : done) {
+          if (!completion.status || completion.userData / perThread != t)
+            bad++;
+        }
+      }
+    });
+  }
+  for (auto &loop : loops) loop.join();
+  EXPECT_EQ(bad.load(), 0);
+  for (uint32_t key = 0; key < threadNum * perThread; key += 97) {
+    Key k(sid_, key);
+    Value value;
+    ASSERT_TRUE(kv_->Get(k, value));
+    auto fields = BuildValue(key, 2);
+    EXPECT_EQ(RowOf(value), fields[0] + fields[1] + fields[2]);
+  }
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
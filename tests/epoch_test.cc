@@ -0,0 +1,93 @@
+//
+//  epoch_test.cc
+//  PROJECT epoch_test
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "epoch.h"
+#include "gtest/gtest.h"
+
+namespace NKV {
+
+TEST(EpochTest, RetiredKeptWhileReaderInside) {
+  EpochManager epochs;
+  std::atomic<uint32_t> freed{0};
+  {
+    EpochGuard guard(epochs);
+    epochs.retire([&] { freed++; });
+    // the reader entered before the retire, nothing may go
+    for (int i = 0; i < 4; i++) epochs.tryReclaim();
+    EXPECT_EQ(freed.load(), 0);
+  }
+  // two advances move the retired epoch behind every reader
+  epochs.tryReclaim();
+  epochs.tryReclaim();
+  EXPECT_EQ(freed.load(), 1);
+  EXPECT_EQ(epochs.pendingCount(), 0);
+}
+
+TEST(EpochTest, ReaderOfNewEpochDoesNotBlock) {
+  EpochManager epochs;
+  std::atomic<uint32_t> freed{0};
+  epochs.retire([&] { freed++; });
+  epochs.tryReclaim();
+  // entered after the retire, it cannot hold the object
+  EpochGuard guard(epochs);
+  epochs.tryReclaim();
+  EXPECT_EQ(freed.load(), 1);
+}
+
+TEST(EpochTest, DrainAndNullGuard) {
+  std::atomic<uint32_t> freed{0};
+  {
+    EpochManager epochs;
+    for (int i = 0; i < 10; i++) epochs.retire([&] { freed++; });
+    EXPECT_EQ(epochs.pendingCount(), 10);
+  }
+  EXPECT_EQ(freed.load(), 10);
+  EpochGuard guard(nullptr);
+}
+
+TEST(EpochTest, ConcurrentReadersAndRetire) {
+  EpochManager epochs;
+  // a retired slot is set to 0 instead of freed, readers must never see it
+  std::vector<std::atomic<uint64_t> *> retired;
+  std::atomic<std::atomic<uint64_t> *> current{new std::atomic<uint64_t>(1)};
+  std::atomic<bool> done{false};
+  std::atomic<uint64_t> useAfterFree{0};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&] {
+      while (!done.load()) {
+        EpochGuard guard(epochs);
+        if (current.load()->load() == 0) useAfterFree++;
+      }
+    });
+  }
+  for (int i = 0; i < 20000; i++) {
+    auto *old = current.exchange(new std::atomic<uint64_t>(1));
+    epochs.retire([old, &retired] {
+      old->store(0);
+      retired.push_back(old);
+    });
+  }
+  done.store(true);
+  for (auto &reader : readers) reader.join();
+  EXPECT_EQ(useAfterFree.load(), 0);
+  epochs.drain();
+  EXPECT_EQ(retired.size(), 20000);
+  for (auto *slot : retired) delete slot;
+  delete current.load();
+}
+
+}  // namespace NKV
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
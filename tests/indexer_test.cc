@@ -0,0 +1,328 @@
+//
+//  indexer_test.cc
+//  PROJECT indexer_test
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "indexer.h"
+#include "logging.h"
+
+namespace NKV {
+
+class IndexerTest : public testing::TestWithParam<IndexType> {
+ public:
+  void SetUp() override { _indexer = std::make_unique<IndexerT>(GetParam()); }
+
+  void InsertKey(uint64_t key) {
+    _indexer->insert({key, ValuePtr(PmemAddress(key * 8))});
+  }
+
+  // all keys in key order, sorted here if the index is unordered
+  std::vector<uint64_t> CollectKeys() {
+    std::vector<uint64_t> keys;
+    for (auto iter = _indexer->begin(); iter != _indexer->end(); iter++)
+      keys.push_back(iter->first);
+    if (!_indexer->isOrdered()) std::sort(keys.begin(), keys.end());
+    return keys;
+  }
+
+  std::vector<uint64_t> ShuffledKeys(uint64_t count, uint64_t step) {
+    std::vector<uint64_t> keys;
+    for (uint64_t i = 1; i <= count; i++) keys.push_back(i * step);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(2026));
+    return keys;
+  }
+
+ protected:
+  std::unique_ptr<IndexerT> _indexer;
+};
+
+TEST_P(IndexerTest, InsertAndFind) {
+  uint64_t count = 10000;
+  for (auto key : ShuffledKeys(count, 2)) InsertKey(key);
+  EXPECT_EQ(_indexer->size(), count);
+  for (uint64_t i = 1; i <= count; i++) {
+    auto iter = _indexer->find(i * 2);
+    ASSERT_TRUE(iter != _indexer->end());
+    EXPECT_EQ(iter->first, i * 2);
+    EXPECT_EQ(iter->second.getPmemAddr(), i * 16);
+    EXPECT_TRUE(_indexer->find(i * 2 + 1) == _indexer->end());
+  }
+  // a second insert of a key keeps the first entry
+  auto [iter, inserted] = _indexer->insert({20, ValuePtr(PmemAddress(1))});
+  EXPECT_FALSE(inserted);
+  EXPECT_EQ(iter->second.getPmemAddr(), 160);
+  // references handed out stay valid while the index grows
+  ValuePtr *vPtr = &_indexer->find(2)->second;
+  for (uint64_t i = 1; i <= count; i++) InsertKey(i * 2 + 1);
+  EXPECT_EQ(vPtr, &_indexer->find(2)->second);
+}
+
+TEST_P(IndexerTest, OrderedIteration) {
+  if (!_indexer->isOrdered()) GTEST_SKIP();
+  uint64_t count = 5000;
+  for (auto key : ShuffledKeys(count, 10)) InsertKey(key);
+  uint64_t expect = 10;
+  for (auto iter = _indexer->begin(); iter != _indexer->end(); iter++) {
+    EXPECT_EQ(iter->first, expect);
+    expect += 10;
+  }
+  EXPECT_EQ(expect, (count + 1) * 10);
+
+  EXPECT_EQ(_indexer->upper_bound(100)->first, 110);
+  EXPECT_EQ(_indexer->upper_bound(105)->first, 110);
+  EXPECT_EQ(_indexer->lower_bound(100)->first, 100);
+  EXPECT_EQ(_indexer->lower_bound(101)->first, 110);
+  EXPECT_TRUE(_indexer->upper_bound(count * 10) == _indexer->end());
+  EXPECT_EQ(_indexer->upper_bound(0)->first, 10);
+
+  // iterating from a point lookup continues in key order
+  auto iter = _indexer->find(500);
+  for (uint64_t key = 500; key <= 1000; key += 10, iter++) {
+    ASSERT_TRUE(iter != _indexer->end());
+    EXPECT_EQ(iter->first, key);
+  }
+}
+
+TEST_P(IndexerTest, Erase) {
+  uint64_t count = 3000;
+  for (auto key : ShuffledKeys(count, 1)) InsertKey(key);
+  for (uint64_t key = 1; key <= count; key += 2) {
+    _indexer->unsafe_erase(_indexer->find(key));
+  }
+  EXPECT_EQ(_indexer->size(), count / 2);
+  auto keys = CollectKeys();
+  ASSERT_EQ(keys.size(), count / 2);
+  for (uint64_t i = 0; i < keys.size(); i++) EXPECT_EQ(keys[i], i * 2 + 2);
+  EXPECT_TRUE(_indexer->find(1) == _indexer->end());
+  InsertKey(1);
+  EXPECT_EQ(_indexer->find(1)->first, 1);
+  EXPECT_EQ(CollectKeys().front(), 1);
+}
+
+TEST_P(IndexerTest, SafeErase) {
+  EpochManager epochs;
+  _indexer = std::make_unique<IndexerT>(GetParam(), &epochs);
+  uint64_t count = 1000;
+  for (auto key : ShuffledKeys(count, 1)) InsertKey(key);
+  {
+    EpochGuard guard(epochs);
+    auto iter = _indexer->find(10);
+    EXPECT_TRUE(_indexer->erase(iter));
+    // a reader holding the entry still sees it, marked removed
+    EXPECT_EQ(iter->first, 10);
+    EXPECT_TRUE(iter->second.isRemoved());
+    EXPECT_FALSE(_indexer->erase(iter));
+  }
+  EXPECT_TRUE(_indexer->find(10) == _indexer->end());
+  EXPECT_EQ(_indexer->size(), count - 1);
+  EXPECT_EQ(CollectKeys().size(), count - 1);
+  InsertKey(10);
+  EXPECT_EQ(_indexer->find(10)->second.getPmemAddr(), 80);
+  EXPECT_EQ(_indexer->size(), count);
+  epochs.drain();
+}
+
+TEST_P(IndexerTest, SplitKeys) {
+  uint64_t count = 50000;
+  for (auto key : ShuffledKeys(count, 1)) InsertKey(key);
+  std::vector<uint64_t> cuts;
+  _indexer->splitKeys(8, cuts);
+  if (GetParam() != IndexType::BTREE && GetParam() != IndexType::HYBRID) {
+    EXPECT_TRUE(cuts.empty());
+    return;
+  }
+  ASSERT_EQ(cuts.size(), 7);
+  EXPECT_TRUE(std::is_sorted(cuts.begin(), cuts.end()));
+  // the keys are dense, so a cut is about where its share of them ends
+  for (uint64_t i = 0; i < cuts.size(); i++) {
+    EXPECT_NEAR((double)cuts[i], (double)count * (i + 1) / 8, count / 16.0);
+  }
+}
+
+TEST_P(IndexerTest, Partitioned) {
+  IndexPartitioning byRange;
+  byRange.rangeStarts = {1000, 2500, 2600};
+  IndexPartitioning byHash;
+  byHash.type = PartitionType::HASH;
+  byHash.hashParts = 4;
+  uint64_t count = 4000;
+  for (auto &partitioning : {byRange, byHash}) {
+    EpochManager epochs;
+    _indexer = std::make_unique<IndexerT>(GetParam(), &epochs, partitioning);
+    EXPECT_EQ(_indexer->getPartitionNum(), 4);
+    for (auto key : ShuffledKeys(count, 1)) InsertKey(key);
+    EXPECT_EQ(_indexer->size(), count);
+    EXPECT_FALSE(_indexer->insert({5, ValuePtr()}).second);
+    for (uint64_t key = 1; key <= count; key++) {
+      auto iter = _indexer->find(key);
+      ASSERT_TRUE(iter != _indexer->end());
+      EXPECT_EQ(iter->second.getPmemAddr(), key * 8);
+    }
+    // erase across the partition ends
+    for (uint64_t key = 990; key <= 2700; key += 2) {
+      EpochGuard guard(epochs);
+      EXPECT_TRUE(_indexer->erase(_indexer->find(key)));
+    }
+    uint64_t erased = (2700 - 990) / 2 + 1;
+    EXPECT_EQ(_indexer->size(), count - erased);
+    auto keys = CollectKeys();
+    ASSERT_EQ(keys.size(), count - erased);
+    EXPECT_TRUE(std::adjacent_find(keys.begin(), keys.end()) == keys.end());
+    if (_indexer->isOrdered()) {
+      // iteration and the bounds cross the partitions in key order
+      EXPECT_EQ(_indexer->begin()->first, 1);
+      EXPECT_EQ(_indexer->lower_bound(990)->first, 991);
+      EXPECT_EQ(_indexer->upper_bound(999)->first, 1001);
+      EXPECT_EQ(_indexer->upper_bound(2699)->first, 2701);
+      EXPECT_TRUE(_indexer->upper_bound(count) == _indexer->end());
+      uint64_t expect = 2601;
+      for (auto iter = _indexer->upper_bound(2600);
+           iter != _indexer->end() && expect <= 2800; iter++) {
+        EXPECT_EQ(iter->first, expect);
+        expect += expect < 2700 ? 2 : 1;
+      }
+    }
+    epochs.drain();
+    _indexer.reset();
+  }
+  std::vector<uint64_t> cuts;
+  _indexer = std::make_unique<IndexerT>(GetParam(), nullptr, byRange);
+  _indexer->splitKeys(4, cuts);
+  for (uint64_t cut : {999, 2499, 2599}) {
+    EXPECT_TRUE(std::count(cuts.begin(), cuts.end(), cut) == 1);
+  }
+}
+
+TEST_P(IndexerTest, MonotonicAppend) {
+  uint32_t writerNum = 4;
+  uint64_t perWriter = 20000;
+  std::atomic<uint64_t> nextKey{1};
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < writerNum; t++) {
+    threads.emplace_back([&] {
+      for (uint64_t i = 0; i < perWriter; i++) {
+        // the gaps are filled in later, out of order
+        uint64_t key = nextKey.fetch_add(2);
+        InsertKey(key);
+        EXPECT_TRUE(_indexer->find(key + 2) == _indexer->end() ||
+                    _indexer->find(key + 2)->first == key + 2);
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  uint64_t count = writerNum * perWriter;
+  EXPECT_TRUE(_indexer->find(count * 2 + 1) == _indexer->end());
+  for (uint64_t key = count * 2; key > 0; key -= 2) InsertKey(key);
+  EXPECT_EQ(_indexer->size(), count * 2);
+  auto keys = CollectKeys();
+  ASSERT_EQ(keys.size(), count * 2);
+  for (uint64_t i = 0; i < keys.size(); i++) ASSERT_EQ(keys[i], i + 1);
+  for (uint64_t key = 1; key <= count * 2; key += 997) {
+    EXPECT_EQ(_indexer->find(key)->second.getPmemAddr(), key * 8);
+  }
+}
+
+TEST_P(IndexerTest, ConcurrentInsertAndScan) {
+  uint32_t writerNum = 4;
+  uint64_t perWriter = 20000;
+  std::atomic<bool> done{false};
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < writerNum; t++) {
+    threads.emplace_back([&, t] {
+      // interleaved keys so that every writer splits the same leaves
+      for (uint64_t i = 0; i < perWriter; i++) InsertKey(i * writerNum + t);
+    });
+  }
+  std::atomic<uint64_t> badOrder{0};
+  std::atomic<uint64_t> missed{0};
+  std::thread reader([&] {
+    while (!done.load()) {
+      uint64_t last = 0;
+      bool first = true;
+      for (auto iter = _indexer->begin(); iter != _indexer->end(); iter++) {
+        if (_indexer->isOrdered() && !first && iter->first <= last)
+          badOrder++;
+        last = iter->first;
+        first = false;
+      }
+      // every key reached by the walk is found by a point lookup
+      if (!first && _indexer->find(last) == _indexer->end()) missed++;
+    }
+  });
+  for (auto &thread : threads) thread.join();
+  done.store(true);
+  reader.join();
+  EXPECT_EQ(badOrder.load(), 0);
+  EXPECT_EQ(missed.load(), 0);
+  EXPECT_EQ(_indexer->size(), writerNum * perWriter);
+  auto keys = CollectKeys();
+  ASSERT_EQ(keys.size(), writerNum * perWriter);
+  for (uint64_t i = 0; i < keys.size(); i++) ASSERT_EQ(keys[i], i);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, IndexerTest,
+                         testing::Values(IndexType::SKIPLIST,
+                                         IndexType::BTREE, IndexType::HASH,
+                                         IndexType::HYBRID));
+
+TEST(ValuePtrTest, StateTransitions) {
+  EXPECT_EQ(sizeof(ValuePtr), 32);
+  ValuePtr vPtr(PmemAddress(64));
+  TimeStamp ts;
+  ts.getNow();
+  // of the promotions racing from one snapshot only one lands
+  ValuePtr::State seen = vPtr.getState();
+  std::atomic<uint32_t> won{0};
+  std::vector<std::thread> threads;
+  for (uint64_t t = 1; t <= 4; t++) {
+    threads.emplace_back([&, t] {
+      if (vPtr.setHotPBRBAddr(RowAddr(t * 4096), seen, ts)) won++;
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  EXPECT_EQ(won.load(), 1);
+  ASSERT_TRUE(vPtr.isHot());
+  RowAddr rowAddr = vPtr.getPBRBAddr();
+  EXPECT_EQ(vPtr.getPmemAddr(), 64);
+  EXPECT_TRUE(vPtr.setHotTimeStamp(vPtr.getState(), ts));
+  EXPECT_FALSE(vPtr.setHotTimeStamp(seen, ts));
+
+  // a write takes the row out, a snapshot from before it no longer matches
+  ValuePtr::State hot = vPtr.getState();
+  EXPECT_EQ(vPtr.setPartialColdPmemAddr(128), rowAddr);
+  EXPECT_FALSE(vPtr.isHot());
+  EXPECT_EQ(vPtr.getPrevItemCount(), 1);
+  EXPECT_FALSE(vPtr.setHotTimeStamp(hot, ts));
+  EXPECT_FALSE(vPtr.setHotPBRBAddr(RowAddr(4096), seen, ts));
+  EXPECT_EQ(vPtr.evictToCold(), nullptr);
+
+  EXPECT_TRUE(vPtr.setHotPBRBAddr(RowAddr(8192), vPtr.getState(), ts));
+  EXPECT_EQ(vPtr.evictToCold(), RowAddr(8192));
+  EXPECT_EQ(vPtr.evictToCold(), nullptr);
+  EXPECT_EQ(vPtr.setFullColdPmemAddr(256), nullptr);
+  EXPECT_TRUE(vPtr.isFullRecord());
+
+  // a row rewritten in place has the address it had, not the version
+  ValuePtr::State compacted = vPtr.getState();
+  EXPECT_EQ(vPtr.setFullColdPmemAddr(256), nullptr);
+  EXPECT_FALSE(vPtr.relocatePmemAddr(compacted, 512));
+  EXPECT_EQ(vPtr.getPmemAddr(), 256);
+  EXPECT_TRUE(vPtr.relocatePmemAddr(vPtr.getState(), 512));
+  EXPECT_EQ(vPtr.getPmemAddr(), 512);
+}
+
+}  // namespace NKV
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
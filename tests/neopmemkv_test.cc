@@ -6,10 +6,13 @@
 //  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
 //
 #include <unistd.h>
+#include <algorithm>
 #include <iostream>
 
 #include <cstdlib>
+#include <mutex>
 #include <random>
+#include <set>
 #include <string>
 #include <thread>
 #include "gtest/gtest.h"
@@ -30,6 +33,7 @@ class NeoPMKVTest : public testing::Test {
   // clean db files
   void TearDown() override {
     delete neopmkv_;
+    neopmkv_ = nullptr;
     bool status = false;
     if (std::filesystem::exists(db_path)) {
       status = std::filesystem::remove_all(db_path);
@@ -46,6 +50,7 @@ class NeoPMKVTest : public testing::Test {
   };
 
   Key BuildKey(uint32_t i, SchemaId sid) { return Key(sid, i); }
+  Key BuildKey(uint32_t i) { return BuildKey(i, sid); }
 
   std::vector<Value> BuildValue(uint32_t i, uint32_t seed) {
     std::vector<Value> value;
@@ -85,13 +90,306 @@ class NeoPMKVTest : public testing::Test {
     return neopmkv_->Remove(key);
   }
 
-  void SetNeoPMKV(bool enablePBRB = false, bool asyncPBRB = false, bool partialUpdateOpt = false) {
+  bool CompactData() { return neopmkv_->Compact(sid, 64); }
+
+  bool CreateSecondaryIndex(uint32_t fieldId) {
+    return neopmkv_->CreateSecondaryIndex(sid, fieldId);
+  }
+
+  std::vector<Value> GetBySecondary(uint32_t fieldId, const Value &value) {
+    std::vector<Value> values;
+    neopmkv_->GetBySecondary(sid, fieldId, value, values);
+    return values;
+  }
+
+  std::vector<Value> ScanBySecondary(uint32_t fieldId, const Value &low,
+                                     const Value &high) {
+    std::vector<Value> values;
+    neopmkv_->ScanBySecondary(sid, fieldId, low, high, values);
+    return values;
+  }
+
+  std::unique_ptr<PlogIterator> NewCDCIterator(PmemAddress start) {
+    return neopmkv_->NewCDCIterator(start);
+  }
+
+  PmemAddress GetLogTail() { return neopmkv_->GetLogTail(); }
+
+  void SetChainThreshold(int threshold) {
+    if (threshold < 0) {
+      neopmkv_->ResetChainThreshold(sid);
+    } else {
+      neopmkv_->SetChainThreshold(sid, threshold);
+    }
+  }
+
+  uint8_t GetChainThreshold() { return neopmkv_->GetChainThreshold(sid); }
+
+  uint8_t ChainLength(uint32_t i) {
+    auto indexer = neopmkv_->_indexerList[sid];
+    return indexer->find(i)->second.getPrevItemCount();
+  }
+
+  void SetNeoPMKV(bool enablePBRB = false, bool asyncPBRB = false,
+                  bool partialUpdateOpt = false, bool bgConsolidation = false,
+                  bool readWriteBack = false,
+                  IndexType indexType = IndexType::SKIPLIST,
+                  AccessTracking tracking = AccessTracking::EXACT) {
     if (neopmkv_ != nullptr) delete neopmkv_;
     if (neopmkv_ == nullptr) {
       neopmkv_ = new NKV::NeoPMKV(db_path, chunk_size, db_size, enablePBRB,
-                                  asyncPBRB, true, partialUpdateOpt);
+                                  asyncPBRB, true, partialUpdateOpt, 1ull << 18,
+                                  2000, 0.7, 2000, 0.3, bgConsolidation,
+                                  readWriteBack, tracking);
     }
-    sid = neopmkv_->CreateSchema(fields, 0, "test1");
+    sid = neopmkv_->CreateSchema(fields, 0, "test1", indexType);
+  }
+
+  TableHandle *OpenTable(SchemaId schemaId) {
+    return neopmkv_->OpenTable(schemaId);
+  }
+  TableHandle *OpenTable() { return OpenTable(sid); }
+
+  bool PutThrough(const TableHandle &table, uint32_t i, uint32_t seed) {
+    auto key = BuildKey(i, sid);
+    auto value = BuildValue(i, seed);
+    return neopmkv_->Put(table, key, value);
+  }
+
+  Value GetThrough(const TableHandle &table, uint32_t i,
+                   uint32_t fieldId = UINT32_MAX) {
+    Value value;
+    auto key = BuildKey(i, sid);
+    if (fieldId == UINT32_MAX) {
+      neopmkv_->Get(table, key, value);
+    } else {
+      neopmkv_->PartialGet(table, key, value, fieldId);
+    }
+    return value;
+  }
+
+  bool UpdateThrough(const TableHandle &table, uint32_t i, Value &fieldValue,
+                     uint32_t fieldId) {
+    auto key = BuildKey(i, sid);
+    return neopmkv_->PartialUpdate(table, key, fieldValue, fieldId);
+  }
+
+  bool RemoveThrough(const TableHandle &table, uint32_t i) {
+    auto key = BuildKey(i, sid);
+    return neopmkv_->Remove(table, key);
+  }
+
+  std::vector<Value> ScanThrough(const TableHandle &table, uint32_t i,
+                                 uint32_t len) {
+    std::vector<Value> values;
+    auto key = BuildKey(i, sid);
+    neopmkv_->Scan(table, key, values, len);
+    return values;
+  }
+
+  // events keyed by (user, ts)
+  // another schema with the same fields, sid stays on the first one
+  SchemaId AddSchema(
+      const std::string &name, IndexType indexType,
+      const IndexPartitioning &partitioning = IndexPartitioning()) {
+    return neopmkv_->CreateSchema(fields, 0, name, indexType, partitioning);
+  }
+
+  bool PutData(Key &key, std::vector<Value> &value) {
+    return neopmkv_->Put(key, value);
+  }
+
+  Value GetData(Key &key, uint32_t fieldId = UINT32_MAX) {
+    Value value;
+    if (fieldId == UINT32_MAX) {
+      neopmkv_->Get(key, value);
+    } else {
+      neopmkv_->PartialGet(key, value, fieldId);
+    }
+    return value;
+  }
+
+  bool RemoveData(Key &key) { return neopmkv_->Remove(key); }
+
+  bool PartialUpdateData(Key &key, Value &fieldValue, uint32_t fieldId) {
+    return neopmkv_->PartialUpdate(key, fieldValue, fieldId);
+  }
+
+  // (pk, 8 byte string), small enough to be kept in the index entries
+  SchemaId AddTinySchema(const std::string &name) {
+    std::vector<SchemaField> tinyFields{
+        SchemaField(FieldType::INT64T, "pk"),
+        SchemaField(FieldType::STRING, "f1", 8)};
+    return neopmkv_->CreateSchema(tinyFields, 0, name);
+  }
+
+  bool HasInlineRow(const Key &key) {
+    auto indexer = OpenTable(key.getSchemaId())->indexer;
+    auto iter = indexer->find(key.primaryKey);
+    char row[ValuePtr::INLINE_ROW_SIZE];
+    return iter != indexer->end() &&
+           iter->second.readInlineRow(row, sizeof(row));
+  }
+
+  // (pk, 8 byte string, variable string kept on the heap while cached)
+  SchemaId AddVarSchema(const std::string &name) {
+    std::vector<SchemaField> varFields{
+        SchemaField(FieldType::INT64T, "pk"),
+        SchemaField(FieldType::STRING, "f1", 8),
+        SchemaField(FieldType::VARSTR, "f2", 16)};
+    return neopmkv_->CreateSchema(varFields, 0, name);
+  }
+
+  bool IsHot(SchemaId schemaId, uint32_t i) {
+    return neopmkv_->_indexerList[schemaId]->find(i)->second.isHot();
+  }
+  bool IsHot(uint32_t i) { return IsHot(sid, i); }
+
+  // drop the PBRB row of i right away, as GC does
+  bool EvictRow(SchemaId schemaId, uint32_t i) {
+    EpochGuard guard(neopmkv_->_epochs);
+    auto iter = neopmkv_->_indexerList[schemaId]->find(i);
+    return neopmkv_->_pbrb->evictRow(iter, OpenTable(schemaId)->schema);
+  }
+  bool EvictRow(uint32_t i) { return EvictRow(sid, i); }
+
+  // pages of the schemas plus the free ones, the whole pool once quiet
+  uint64_t AccountedPages() {
+    PBRB *pbrb = neopmkv_->_pbrb;
+    neopmkv_->_epochs.drain();
+    uint64_t pages = 0;
+    for (auto &freePageList : pbrb->_freePageLists)
+      pages += freePageList->size();
+    for (auto &cache : pbrb->_freePageCaches) pages += cache->pages.size();
+    for (auto &[_, blbs] : pbrb->_bufferMap) pages += blbs->getPageNum();
+    return pages;
+  }
+  uint64_t FreePages() { return neopmkv_->_pbrb->_freePageNum(); }
+  BufferPage *PopFreePage() { return neopmkv_->_pbrb->_popFreePage(); }
+  void PushFreePage(BufferPage *pagePtr) {
+    neopmkv_->_pbrb->_pushFreePage(pagePtr);
+  }
+  uint64_t MaxPages() { return neopmkv_->_pbrb->getMaxPageNumber(); }
+  uintptr_t BufferPoolAddr() {
+    return (uintptr_t)neopmkv_->_pbrb->_bufferPoolPtr;
+  }
+  uint32_t LocalNode() { return neopmkv_->_pbrb->_localFreePageCache().node; }
+  uint32_t NodeOfPage(BufferPage *pagePtr) {
+    return neopmkv_->_pbrb->_nodeOfPage(pagePtr);
+  }
+  // the pages on the free list of every node, the lists are left as they were
+  std::vector<std::vector<BufferPage *>> NodeFreePages() {
+    PBRB *pbrb = neopmkv_->_pbrb;
+    std::vector<std::vector<BufferPage *>> nodePages(pbrb->_nodeNum);
+    for (uint32_t node = 0; node < pbrb->_nodeNum; node++) {
+      auto &freePageList = pbrb->getFreePageList(node);
+      BufferPage *pagePtr;
+      while (freePageList.try_pop(pagePtr)) nodePages[node].push_back(pagePtr);
+      for (auto page : nodePages[node]) freePageList.push(page);
+    }
+    return nodePages;
+  }
+
+  TimeStamp AccessStamp() { return neopmkv_->_pbrb->accessStamp(); }
+
+  bool MultiGetData(const std::vector<Key> &keys, std::vector<Value> &values) {
+    return neopmkv_->MultiGet(keys, values);
+  }
+
+  // the keys a ScanIterator visits, the rows are checked against them
+  std::vector<uint64_t> ScanKeys(SchemaId schemaId, const ScanRange &range,
+                                 uint32_t seed) {
+    std::vector<uint64_t> keys;
+    auto iter = neopmkv_->NewScanIterator(schemaId, range);
+    if (iter == nullptr) return keys;
+    for (; iter->Valid(); iter->Next()) {
+      uint64_t key = iter->getKey();
+      EXPECT_NE(iter->getValue().find(BuildFieldValue(key + seed, 2, 16)),
+                Value::npos);
+      keys.push_back(key);
+    }
+    return keys;
+  }
+  std::vector<uint64_t> ScanKeys(const ScanRange &range, uint32_t seed) {
+    return ScanKeys(sid, range, seed);
+  }
+
+  std::vector<Value> ScanValues(SchemaId schemaId, const ScanRange &range) {
+    std::vector<Value> values;
+    auto iter = neopmkv_->NewScanIterator(schemaId, range);
+    for (; iter != nullptr && iter->Valid(); iter->Next())
+      values.push_back(iter->getValue());
+    return values;
+  }
+
+  bool ParallelScanData(SchemaId schemaId, const ScanRange &range,
+                        std::vector<Value> &values, uint32_t partitions = 0) {
+    return neopmkv_->ParallelScan(schemaId, range, values, partitions);
+  }
+
+  // (partition, key) of every row, in the order the partitions come
+  bool ParallelScanKeys(SchemaId schemaId, const ScanRange &range,
+                        std::vector<std::pair<uint32_t, uint64_t>> &keys,
+                        uint32_t partitions) {
+    std::mutex lock;
+    bool status = neopmkv_->ParallelScan(
+        schemaId, range,
+        [&](uint32_t partition, uint64_t key, const Value &row) {
+          std::lock_guard<std::mutex> guard(lock);
+          keys.push_back({partition, key});
+        },
+        partitions);
+    std::stable_sort(keys.begin(), keys.end(),
+                     [](auto &a, auto &b) { return a.first < b.first; });
+    return status;
+  }
+
+  void SetCompositeKeySchema() {
+    std::vector<SchemaField> eventFields{
+        SchemaField(FieldType::STRING, "user", 16),
+        SchemaField(FieldType::INT64T, "ts"),
+        SchemaField(FieldType::STRING, "body", 16)};
+    sid = neopmkv_->CreateSchema(eventFields, {0, 1}, "events");
+  }
+
+  static Value IntValue(int64_t v) {
+    return Value(reinterpret_cast<const char *>(&v), sizeof(v));
+  }
+
+  bool PutEvent(const std::string &user, int64_t ts, const Value &body) {
+    std::vector<Value> row{user, IntValue(ts), body};
+    return neopmkv_->PutRow(sid, row);
+  }
+
+  bool ResolveEvent(const std::string &user, int64_t ts, Key &key) {
+    return neopmkv_->ResolveKey(sid, {user, IntValue(ts)}, key);
+  }
+
+  // the row of (user, ts), empty if there is none
+  Value GetEvent(const std::string &user, int64_t ts) {
+    Key key(sid, 0);
+    Value value;
+    if (ResolveEvent(user, ts, key)) neopmkv_->Get(key, value);
+    return value;
+  }
+
+  bool RemoveEvent(const std::string &user, int64_t ts) {
+    Key key(sid, 0);
+    return ResolveEvent(user, ts, key) && neopmkv_->Remove(key);
+  }
+
+  std::vector<Value> ScanEvents(std::vector<Value> start, uint32_t len) {
+    std::vector<Value> values;
+    neopmkv_->ScanByKey(sid, start, values, len);
+    return values;
+  }
+
+  std::vector<Value> PartialScanData(uint32_t i, uint32_t len,
+                                     uint32_t fieldId) {
+    std::vector<Value> values;
+    auto key = BuildKey(i, sid);
+    neopmkv_->PartialScan(key, values, len, fieldId);
+    return values;
   }
 
  private:
@@ -216,7 +514,939 @@ TEST_F(NeoPMKVTest, ASYNCPBRBTest) {
   }
 }
 
+TEST_F(NeoPMKVTest, CompactInKeyOrder) {
+  SetNeoPMKV(true, false, false);
+  uint32_t count = 1000;
+  uint32_t seed = 3571;
+  // insert in reverse key order, then scatter partial updates
+  for (uint32_t i = count; i > 0; i--) {
+    PrepareData(i - 1, seed);
+  }
+  for (uint32_t i = 0; i < count; i += 3) {
+    auto ev = BuildFieldValue(i + seed + 1, 1, 16);
+    PartialUpdateData(i, ev, 1);
+  }
+  for (uint32_t i = 0; i < count; i += 7) {
+    GetData(i);
+  }
+  for (uint32_t i = 0; i < count; i += 10) {
+    RemoveData(i);
+  }
+  auto tail = GetLogTail();
+  ASSERT_TRUE(CompactData());
+
+  // the rewritten rows follow each other in key order
+  auto iter = NewCDCIterator(tail);
+  PlogRecord record;
+  uint64_t lastKey = 0;
+  PmemAddress lastAddr = 0;
+  uint32_t relocated = 0;
+  while (iter->Next(record)) {
+    ASSERT_TRUE(record.relocated);
+    if (relocated > 0) {
+      EXPECT_GT(record.primaryKey, lastKey);
+      EXPECT_GT(record.rowAddr, lastAddr);
+    }
+    lastKey = record.primaryKey;
+    lastAddr = record.rowAddr;
+    relocated++;
+  }
+  EXPECT_EQ(relocated, count - count / 10);
+
+  for (uint32_t i = 0; i < count; i++) {
+    auto pv = PartialGetData(i, 1);
+    if (i % 10 == 0) {
+      EXPECT_TRUE(pv.empty());
+      continue;
+    }
+    auto ev = BuildFieldValue(i + seed + (i % 3 == 0 ? 1 : 0), 1, 16);
+    EXPECT_STREQ(ev.data(), pv.data());
+    EXPECT_STREQ(BuildFieldValue(i + seed, 2, 16).data(),
+                 PartialGetData(i, 2).data());
+  }
+  // updates after compaction chain onto the compacted rows
+  auto ev = BuildFieldValue(seed, 2, 16);
+  PartialUpdateData(1, ev, 2);
+  EXPECT_STREQ(ev.data(), PartialGetData(1, 2).data());
+}
+
+TEST_F(NeoPMKVTest, BackgroundConsolidation) {
+  SetNeoPMKV(false, false, false, true);
+  SetChainThreshold(PARTIAL_CHAIN_MERGE_THRESHOLD);
+  uint32_t count = 200;
+  uint32_t rounds = 12;
+  uint32_t seed = 7919;
+  for (uint32_t i = 0; i < count; i++) {
+    PrepareData(i, seed);
+  }
+  // writers only append deltas, chains never exceed the hard cap
+  for (uint32_t r = 1; r <= rounds; r++) {
+    for (uint32_t i = 0; i < count; i++) {
+      auto ev = BuildFieldValue(i + seed + r, 1 + r % 2, 16);
+      PartialUpdateData(i, ev, 1 + r % 2);
+      EXPECT_LE(ChainLength(i), PARTIAL_CHAIN_HARD_LIMIT);
+    }
+    for (uint32_t i = 0; i < count; i += 2) {
+      GetData(i);
+    }
+  }
+  // wait for the worker to drain the candidates
+  for (uint32_t wait = 0; wait < 1000; wait++) {
+    bool done = true;
+    for (uint32_t i = 0; i < count && done; i++) {
+      done = ChainLength(i) <= PARTIAL_CHAIN_MERGE_THRESHOLD;
+    }
+    if (done) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    EXPECT_LE(ChainLength(i), PARTIAL_CHAIN_MERGE_THRESHOLD);
+    // field 1 was last written in an even round, field 2 in an odd one
+    auto ev1 = BuildFieldValue(i + seed + rounds, 1, 16);
+    auto ev2 = BuildFieldValue(i + seed + rounds - 1, 2, 16);
+    EXPECT_STREQ(ev1.data(), PartialGetData(i, 1).data());
+    EXPECT_STREQ(ev2.data(), PartialGetData(i, 2).data());
+  }
+}
+
+TEST_F(NeoPMKVTest, AdaptiveChainThreshold) {
+  SetNeoPMKV();
+  uint32_t count = 100;
+  uint32_t seed = 1237;
+  for (uint32_t i = 0; i < count; i++) {
+    PrepareData(i, seed);
+  }
+  EXPECT_EQ(GetChainThreshold(), PARTIAL_CHAIN_MERGE_THRESHOLD);
+  // write only: chains may grow up to the hard cap
+  for (uint32_t r = 0; r < 4200; r++) {
+    auto ev = BuildFieldValue(r, 1, 16);
+    PartialUpdateData(r % count, ev, 1);
+  }
+  EXPECT_EQ(GetChainThreshold(), PARTIAL_CHAIN_HARD_LIMIT - 1);
+  // read mostly: chains are merged early again
+  for (uint32_t r = 0; r < 4200; r++) {
+    auto ev = BuildFieldValue(r, 2, 16);
+    PartialUpdateData(r % count, ev, 2);
+    for (uint32_t i = 0; i < 20; i++) {
+      GetData((r + i * 7) % count);
+    }
+  }
+  EXPECT_LT(GetChainThreshold(), 8);
+  for (uint32_t i = 0; i < count; i++) {
+    EXPECT_LE(ChainLength(i), PARTIAL_CHAIN_HARD_LIMIT);
+  }
+  // a pinned threshold wins over the tuned one
+  SetChainThreshold(5);
+  EXPECT_EQ(GetChainThreshold(), 5);
+  SetChainThreshold(-1);
+  EXPECT_LT(GetChainThreshold(), 8);
+}
+
+TEST_F(NeoPMKVTest, ReadWriteBack) {
+  SetNeoPMKV(false, false, false, false, true);
+  uint32_t count = 50;
+  uint32_t seed = 4421;
+  for (uint32_t i = 0; i < count; i++) {
+    PrepareData(i, seed);
+  }
+  for (uint32_t r = 1; r <= 3; r++) {
+    for (uint32_t i = 0; i < count; i++) {
+      auto ev = BuildFieldValue(i + seed + r, 1, 16);
+      PartialUpdateData(i, ev, 1);
+    }
+  }
+  auto tail = GetLogTail();
+  for (uint32_t i = 0; i < count; i++) {
+    EXPECT_EQ(ChainLength(i), 3);
+    auto fv = GetData(i);
+    // the merged row replaced the chain
+    EXPECT_EQ(ChainLength(i), 0);
+    EXPECT_EQ(fv, GetData(i));
+    EXPECT_STREQ(BuildFieldValue(i + seed + 3, 1, 16).data(),
+                 PartialGetData(i, 1).data());
+  }
+  // one write-back per key, nothing on the second read
+  auto iter = NewCDCIterator(tail);
+  PlogRecord record;
+  uint32_t written = 0;
+  while (iter->Next(record)) {
+    EXPECT_TRUE(record.relocated);
+    written++;
+  }
+  EXPECT_EQ(written, count);
+}
+
+TEST_F(NeoPMKVTest, BTreeIndex) {
+  SetNeoPMKV(true, false, true, false, false, IndexType::BTREE);
+  uint32_t count = 500;
+  uint32_t seed = 84987;
+  for (uint32_t i = 0; i < count; i++) {
+    PrepareData(i, seed);
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    auto ev = BuildFieldValue(i + seed, 2, 16);
+    EXPECT_EQ(ev, PartialGetData(i, 2));
+  }
+  seed = 95465;
+  for (uint32_t i = 0; i < count; i += 2) {
+    auto ev = BuildFieldValue(i + seed, 2, 16);
+    PartialUpdateData(i, ev, 2);
+    EXPECT_EQ(ev, PartialGetData(i, 2));
+  }
+  auto values = PartialScanData(100, 50, 2);
+  ASSERT_EQ(values.size(), 50);
+  for (uint32_t i = 0; i < 50; i++) {
+    uint32_t key = 101 + i;
+    uint32_t keySeed = key % 2 == 0 ? 95465 : 84987;
+    EXPECT_EQ(BuildFieldValue(key + keySeed, 2, 16), values[i]);
+  }
+  for (uint32_t i = 0; i < count; i += 3) {
+    EXPECT_TRUE(RemoveData(i));
+  }
+  EXPECT_FALSE(RemoveData(0));
+  values = PartialScanData(0, 4, 2);
+  ASSERT_EQ(values.size(), 4);
+  EXPECT_EQ(BuildFieldValue(1 + 84987, 2, 16), values[0]);
+  EXPECT_EQ(BuildFieldValue(2 + 95465, 2, 16), values[1]);
+  EXPECT_EQ(BuildFieldValue(4 + 95465, 2, 16), values[2]);
+}
+
+TEST_F(NeoPMKVTest, HashIndex) {
+  SetNeoPMKV(false, false, true, false, false, IndexType::HASH);
+  uint32_t count = 500;
+  uint32_t seed = 84987;
+  for (uint32_t i = 0; i < count; i++) {
+    PrepareData(i, seed);
+  }
+  seed = 95465;
+  for (uint32_t i = 0; i < count; i += 2) {
+    auto ev = BuildFieldValue(i + seed, 2, 16);
+    PartialUpdateData(i, ev, 2);
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t keySeed = i % 2 == 0 ? 95465 : 84987;
+    EXPECT_EQ(BuildFieldValue(i + keySeed, 2, 16), PartialGetData(i, 2));
+  }
+  for (uint32_t i = 0; i < count; i += 3) {
+    EXPECT_TRUE(RemoveData(i));
+  }
+  EXPECT_FALSE(RemoveData(0));
+  EXPECT_TRUE(PartialGetData(0, 2).empty());
+  // no ordered index to scan on this schema
+  EXPECT_TRUE(PartialScanData(0, 4, 2).empty());
+  EXPECT_TRUE(CompactData());
+  EXPECT_EQ(BuildFieldValue(1 + 84987, 2, 16), PartialGetData(1, 2));
+  EXPECT_EQ(BuildFieldValue(2 + 95465, 2, 16), PartialGetData(2, 2));
+}
+
+TEST_F(NeoPMKVTest, ConcurrentRemove) {
+  for (auto indexType : {IndexType::SKIPLIST, IndexType::BTREE,
+                         IndexType::HASH, IndexType::HYBRID}) {
+    SCOPED_TRACE(static_cast<int>(indexType));
+    // a fresh instance and plog for every index type
+    TearDown();
+    SetUp();
+    // concurrent PBRB writes of different keys can still claim one slot
+    SetNeoPMKV(false, false, false, false, false, indexType);
+    uint32_t count = 2000;
+    uint32_t seed = 3389;
+    for (uint32_t i = 0; i < count; i++) {
+      PrepareData(i, seed);
+    }
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> wrongValue{0};
+    std::vector<std::thread> readers;
+    for (uint32_t t = 0; t < 3; t++) {
+      readers.emplace_back([&] {
+        while (!done.load()) {
+          for (uint32_t i = 0; i < count; i++) {
+            // a key is either gone or still holds its full row
+            Value value = GetData(i);
+            if (!value.empty() &&
+                value.find(BuildFieldValue(i + seed, 1, 16)) == Value::npos)
+              wrongValue++;
+          }
+        }
+      });
+    }
+    for (uint32_t round = 0; round < 3; round++) {
+      for (uint32_t i = round; i < count; i += 2) EXPECT_TRUE(RemoveData(i));
+      for (uint32_t i = round; i < count; i += 2) PrepareData(i, seed);
+    }
+    for (uint32_t i = 0; i < count; i += 2) EXPECT_TRUE(RemoveData(i));
+    done.store(true);
+    for (auto &reader : readers) reader.join();
+    EXPECT_EQ(wrongValue.load(), 0);
+    for (uint32_t i = 0; i < count; i++) {
+      if (i % 2 == 0) {
+        EXPECT_TRUE(GetData(i).empty());
+      } else {
+        EXPECT_EQ(BuildFieldValue(i + seed, 2, 16), PartialGetData(i, 2));
+      }
+    }
+    // removed keys can be put again
+    PrepareData(0, seed);
+    EXPECT_EQ(BuildFieldValue(seed, 2, 16), PartialGetData(0, 2));
+  }
+}
+
+TEST_F(NeoPMKVTest, SecondaryIndex) {
+  SetNeoPMKV();
+  uint32_t count = 200;
+  uint32_t seed = 1000;
+  for (uint32_t i = 0; i < count / 2; i++) {
+    PrepareData(i, seed);
+  }
+  // the rows stored before are indexed on creation
+  EXPECT_TRUE(CreateSecondaryIndex(1));
+  EXPECT_FALSE(CreateSecondaryIndex(0));
+  for (uint32_t i = count / 2; i < count; i++) {
+    PrepareData(i, seed);
+  }
+  for (uint32_t i : {5, 150}) {
+    auto rows = GetBySecondary(1, BuildFieldValue(i + seed, 1, 16));
+    ASSERT_EQ(rows.size(), 1);
+    EXPECT_NE(rows[0].find(BuildFieldValue(i + seed, 2, 16)), Value::npos);
+  }
+  // several keys share a value after partial updates
+  Value shared = BuildFieldValue(99999, 1, 16);
+  for (uint32_t i = 10; i < 20; i++) {
+    PartialUpdateData(i, shared, 1);
+  }
+  EXPECT_EQ(GetBySecondary(1, shared).size(), 10);
+  EXPECT_TRUE(GetBySecondary(1, BuildFieldValue(10 + seed, 1, 16)).empty());
+  // updates of other fields leave the index alone
+  auto other = BuildFieldValue(7, 2, 16);
+  PartialUpdateData(10, other, 2);
+  EXPECT_EQ(GetBySecondary(1, shared).size(), 10);
+  // a full put and a remove take keys out of the value
+  PrepareData(11, seed);
+  EXPECT_TRUE(RemoveData(12));
+  EXPECT_EQ(GetBySecondary(1, shared).size(), 8);
+  EXPECT_EQ(GetBySecondary(1, BuildFieldValue(11 + seed, 1, 16)).size(), 1);
+  // a range comes back in field order
+  auto rows = ScanBySecondary(1, BuildFieldValue(150 + seed, 1, 16),
+                              BuildFieldValue(159 + seed, 1, 16));
+  ASSERT_EQ(rows.size(), 10);
+  for (uint32_t i = 0; i < rows.size(); i++) {
+    EXPECT_NE(rows[i].find(BuildFieldValue(150 + i + seed, 2, 16)),
+              Value::npos);
+  }
+}
+
+TEST_F(NeoPMKVTest, CompositeKey) {
+  SetNeoPMKV();
+  SetCompositeKeySchema();
+  std::vector<std::string> users{"carol", "alice", "bob"};
+  for (auto &user : users) {
+    for (int64_t ts = 10; ts > -10; ts--) {
+      EXPECT_TRUE(PutEvent(user, ts, BuildFieldValue(ts + 100, 0, 16)));
+    }
+  }
+  // a point lookup goes through the id of the tuple
+  EXPECT_NE(GetEvent("bob", -3).find(BuildFieldValue(97, 0, 16)), Value::npos);
+  EXPECT_TRUE(GetEvent("bob", 11).empty());
+  EXPECT_TRUE(GetEvent("dave", 0).empty());
+  // a put of an existing tuple overwrites its row
+  EXPECT_TRUE(PutEvent("bob", -3, BuildFieldValue(7, 0, 16)));
+  EXPECT_NE(GetEvent("bob", -3).find(BuildFieldValue(7, 0, 16)), Value::npos);
+
+  // the rows of a user come back in ts order, negative ones first
+  auto rows = ScanEvents({"bob"}, 20);
+  ASSERT_EQ(rows.size(), 20);
+  for (int64_t i = 0; i < 20; i++) {
+    if (i - 9 == -3) continue;
+    EXPECT_NE(rows[i].find(BuildFieldValue(i - 9 + 100, 0, 16)), Value::npos);
+  }
+  EXPECT_NE(rows[0].find("bob"), Value::npos);
+  EXPECT_NE(rows[19].find("bob"), Value::npos);
+  // a scan after a full tuple goes on into the next user, skipping removed
+  EXPECT_TRUE(RemoveEvent("carol", -9));
+  EXPECT_TRUE(GetEvent("carol", -9).empty());
+  rows = ScanEvents({"bob", IntValue(9)}, 3);
+  ASSERT_EQ(rows.size(), 3);
+  EXPECT_NE(rows[0].find("bob"), Value::npos);
+  EXPECT_NE(rows[1].find("carol"), Value::npos);
+  EXPECT_NE(rows[1].find(BuildFieldValue(92, 0, 16)), Value::npos);
+  EXPECT_EQ(ScanEvents({"alice"}, 100).size(), 59);
+}
+
+TEST_F(NeoPMKVTest, TableHandle) {
+  SetNeoPMKV(true);
+  EXPECT_EQ(OpenTable(9999), nullptr);
+  TableHandle *table = OpenTable();
+  ASSERT_NE(table, nullptr);
+  EXPECT_EQ(table, OpenTable());
+  EXPECT_EQ(table->schema->getSchemaId(), table->schemaId);
+  EXPECT_NE(table->bufferList, nullptr);
+  uint32_t count = 100;
+  uint32_t seed = 7;
+  for (uint32_t i = 0; i < count; i++) {
+    EXPECT_TRUE(PutThrough(*table, i, seed));
+  }
+  // twice, so that the second read hits the PBRB
+  for (int round = 0; round < 2; round++) {
+    for (uint32_t i = 0; i < count; i++) {
+      EXPECT_NE(GetThrough(*table, i).find(BuildFieldValue(i + seed, 2, 16)),
+                Value::npos);
+    }
+  }
+  // both APIs see the same rows
+  Value fieldValue = BuildFieldValue(5000, 1, 16);
+  EXPECT_TRUE(UpdateThrough(*table, 10, fieldValue, 1));
+  EXPECT_EQ(PartialGetData(10, 1), fieldValue);
+  EXPECT_EQ(GetThrough(*table, 10, 1), fieldValue);
+  EXPECT_TRUE(RemoveData(20));
+  EXPECT_TRUE(GetThrough(*table, 20).empty());
+  EXPECT_FALSE(RemoveThrough(*table, 20));
+  EXPECT_TRUE(RemoveThrough(*table, 21));
+  EXPECT_TRUE(GetData(21).empty());
+  auto rows = ScanThrough(*table, 18, 3);
+  ASSERT_EQ(rows.size(), 3);
+  EXPECT_NE(rows[0].find(BuildFieldValue(19 + seed, 2, 16)), Value::npos);
+  EXPECT_NE(rows[1].find(BuildFieldValue(22 + seed, 2, 16)), Value::npos);
+}
+
+TEST_F(NeoPMKVTest, MultiGet) {
+  SetNeoPMKV(true, false, false, false, false, IndexType::HASH);
+  SchemaId other = AddSchema("test2", IndexType::SKIPLIST);
+  uint32_t count = 100;
+  uint32_t seed = 3;
+  for (uint32_t i = 0; i < count; i++) {
+    PrepareData(i, seed);
+    auto key = BuildKey(i, other);
+    auto value = BuildValue(i, seed + 1);
+    ASSERT_TRUE(PutData(key, value));
+  }
+  // read half of the rows once, so that the batch mixes hot and cold rows
+  for (uint32_t i = 0; i < count; i += 2) GetData(i);
+  EXPECT_TRUE(RemoveData(7));
+
+  std::vector<Key> keys;
+  for (uint32_t i = 0; i < count; i++) {
+    keys.push_back(BuildKey(count - 1 - i));
+    keys.push_back(BuildKey(i, other));
+  }
+  std::vector<Value> values;
+  EXPECT_FALSE(MultiGetData(keys, values));
+  ASSERT_EQ(values.size(), keys.size());
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t first = count - 1 - i;
+    if (first == 7) {
+      EXPECT_TRUE(values[i * 2].empty());
+    } else {
+      EXPECT_EQ(values[i * 2], GetData(first));
+      EXPECT_NE(values[i * 2].find(BuildFieldValue(first + seed, 2, 16)),
+                Value::npos);
+    }
+    EXPECT_NE(values[i * 2 + 1].find(BuildFieldValue(i + seed + 1, 2, 16)),
+              Value::npos);
+  }
+
+  // missing keys and unknown schemas leave their value empty
+  keys = {BuildKey(1), BuildKey(count + 5), BuildKey(2, 9999),
+          BuildKey(3, other)};
+  EXPECT_FALSE(MultiGetData(keys, values));
+  ASSERT_EQ(values.size(), 4);
+  EXPECT_EQ(values[0], GetData(1));
+  EXPECT_TRUE(values[1].empty());
+  EXPECT_TRUE(values[2].empty());
+  EXPECT_FALSE(values[3].empty());
+  keys = {BuildKey(1), BuildKey(3, other)};
+  EXPECT_TRUE(MultiGetData(keys, values));
+  keys.clear();
+  EXPECT_TRUE(MultiGetData(keys, values));
+  EXPECT_TRUE(values.empty());
+}
+
+TEST_F(NeoPMKVTest, ScanIterator) {
+  SetNeoPMKV(true);
+  SchemaId btree = AddSchema("test2", IndexType::BTREE);
+  SchemaId hash = AddSchema("test3", IndexType::HASH);
+  uint32_t count = 1000;
+  uint32_t seed = 5;
+  for (uint32_t i = 0; i < count; i++) {
+    PrepareData(i * 3, seed);
+    for (SchemaId other : {btree, hash}) {
+      auto key = BuildKey(i * 3, other);
+      auto value = BuildValue(i * 3, seed);
+      ASSERT_TRUE(PutData(key, value));
+    }
+  }
+  EXPECT_TRUE(RemoveData(300));
+  // every third key, without the removed one, in [lo, hi]
+  auto expectKeys = [&](uint64_t lo, uint64_t hi, bool reverse,
+                        bool withRemoved) {
+    std::vector<uint64_t> keys;
+    for (uint64_t key = 0; key < count * 3; key += 3) {
+      if (key >= lo && key <= hi && (withRemoved || key != 300))
+        keys.push_back(key);
+    }
+    if (reverse) std::reverse(keys.begin(), keys.end());
+    return keys;
+  };
+
+  for (bool reverse : {false, true}) {
+    ScanRange range;
+    range.reverse = reverse;
+    EXPECT_EQ(ScanKeys(range, seed), expectKeys(0, UINT64_MAX, reverse, false));
+    EXPECT_EQ(ScanKeys(btree, range, seed),
+              expectKeys(0, UINT64_MAX, reverse, true));
+    // [start, end) and (start, end]
+    range.start = 30;
+    range.end = 900;
+    range.endInclusive = false;
+    EXPECT_EQ(ScanKeys(range, seed), expectKeys(30, 899, reverse, false));
+    EXPECT_EQ(ScanKeys(btree, range, seed), expectKeys(30, 899, reverse, true));
+    range.startInclusive = false;
+    range.endInclusive = true;
+    EXPECT_EQ(ScanKeys(range, seed), expectKeys(31, 900, reverse, false));
+    // bounds between the keys
+    range.start = 31;
+    range.end = 35;
+    EXPECT_EQ(ScanKeys(btree, range, seed), expectKeys(32, 35, reverse, true));
+    range.start = 2000;
+    range.end = 1000;
+    EXPECT_TRUE(ScanKeys(range, seed).empty());
+    range.start = UINT64_MAX;
+    EXPECT_TRUE(ScanKeys(range, seed).empty());
+    // an unordered index has nothing to scan
+    EXPECT_TRUE(ScanKeys(hash, ScanRange(), seed).empty());
+  }
+  EXPECT_TRUE(ScanKeys(9999, ScanRange(), seed).empty());
+}
+
+TEST_F(NeoPMKVTest, ParallelScan) {
+  SetNeoPMKV(true);
+  SchemaId btree = AddSchema("test2", IndexType::BTREE);
+  SchemaId hash = AddSchema("test3", IndexType::HASH);
+  uint32_t count = 20000;
+  for (uint32_t i = 0; i < count; i++) {
+    for (SchemaId schemaId : {btree, hash}) {
+      auto key = BuildKey(i * 7, schemaId);
+      auto value = BuildValue(i * 7, 1);
+      ASSERT_TRUE(PutData(key, value));
+    }
+    PrepareData(i * 7, 1);
+  }
+  for (uint32_t i = 0; i < count; i += 100) EXPECT_TRUE(RemoveData(i * 7));
+  std::vector<SchemaId> ordered{btree, OpenTable()->schemaId};
+  for (SchemaId schemaId : ordered) {
+    for (bool reverse : {false, true}) {
+      ScanRange range;
+      range.reverse = reverse;
+      std::vector<Value> values;
+      EXPECT_TRUE(ParallelScanData(schemaId, range, values));
+      EXPECT_EQ(values, ScanValues(schemaId, range));
+      range.start = 1000;
+      range.end = 100000;
+      range.endInclusive = false;
+      values.clear();
+      EXPECT_TRUE(ParallelScanData(schemaId, range, values, 7));
+      EXPECT_EQ(values, ScanValues(schemaId, range));
+    }
+    // partitions are disjoint, in key order, and each is in key order
+    std::vector<std::pair<uint32_t, uint64_t>> keys;
+    EXPECT_TRUE(ParallelScanKeys(schemaId, ScanRange(), keys, 16));
+    EXPECT_EQ(keys.size(), ScanValues(schemaId, ScanRange()).size());
+    std::set<uint32_t> partitions;
+    for (size_t i = 0; i < keys.size(); i++) {
+      partitions.insert(keys[i].first);
+      if (i > 0) EXPECT_LT(keys[i - 1].second, keys[i].second);
+    }
+    EXPECT_GT(partitions.size(), 1);
+  }
+  std::vector<Value> values;
+  EXPECT_FALSE(ParallelScanData(hash, ScanRange(), values));
+  EXPECT_FALSE(ParallelScanData(9999, ScanRange(), values));
+}
+
+TEST_F(NeoPMKVTest, PartitionedIndex) {
+  SetNeoPMKV(true);
+  IndexPartitioning byHash;
+  byHash.type = PartitionType::HASH;
+  byHash.hashParts = 8;
+  IndexPartitioning byRange;
+  byRange.rangeStarts = {10000, 20000, 30000};
+  uint32_t threadNum = 4;
+  uint32_t perThread = 10000;
+  for (auto &partitioning : {byHash, byRange}) {
+    SchemaId schemaId =
+        AddSchema(std::to_string(partitioning.partNum()) + "parts",
+                  IndexType::SKIPLIST, partitioning);
+    EXPECT_EQ(OpenTable(schemaId)->indexer->getPartitionNum(),
+              partitioning.partNum());
+    // every thread appends growing keys
+    std::vector<std::thread> writers;
+    for (uint32_t t = 0; t < threadNum; t++) {
+      writers.emplace_back([&, t] {
+        for (uint32_t i = 0; i < perThread; i++) {
+          auto key = BuildKey(i * threadNum + t, schemaId);
+          auto value = BuildValue(i * threadNum + t, 9);
+          PutData(key, value);
+        }
+      });
+    }
+    for (auto &writer : writers) writer.join();
+    uint32_t count = threadNum * perThread;
+    std::vector<Key> keys;
+    for (uint32_t i = 0; i < count; i += 101)
+      keys.push_back(BuildKey(i, schemaId));
+    std::vector<Value> values;
+    EXPECT_TRUE(MultiGetData(keys, values));
+    for (size_t i = 0; i < keys.size(); i++) {
+      EXPECT_NE(values[i].find(BuildFieldValue(keys[i].primaryKey + 9, 2, 16)),
+                Value::npos);
+    }
+    ScanRange range;
+    range.start = 9990;
+    range.end = 30010;
+    auto scanned = ScanKeys(schemaId, range, 9);
+    ASSERT_EQ(scanned.size(), 30010 - 9990 + 1);
+    for (size_t i = 0; i < scanned.size(); i++)
+      EXPECT_EQ(scanned[i], 9990 + i);
+    range.reverse = true;
+    EXPECT_EQ(ScanKeys(schemaId, range, 9).front(), 30010);
+    values.clear();
+    EXPECT_TRUE(ParallelScanData(schemaId, ScanRange(), values));
+    EXPECT_EQ(values.size(), count);
+  }
+}
+
+TEST_F(NeoPMKVTest, InlineRows) {
+  SetNeoPMKV(true);
+  EXPECT_FALSE(OpenTable()->inlineRows);
+  SchemaId tiny = AddTinySchema("tiny");
+  ASSERT_TRUE(OpenTable(tiny)->inlineRows);
+  uint32_t count = 100;
+  for (uint32_t i = 0; i < count; i++) {
+    auto key = BuildKey(i, tiny);
+    std::vector<Value> value{BuildFieldValue(i, 0, 8),
+                             BuildFieldValue(i, 1, 8)};
+    ASSERT_TRUE(PutData(key, value));
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    auto key = BuildKey(i, tiny);
+    EXPECT_TRUE(HasInlineRow(key));
+    Value row = GetData(key);
+    EXPECT_EQ(row.substr(ROW_META_HEAD_SIZE),
+              BuildFieldValue(i, 0, 8) + BuildFieldValue(i, 1, 8));
+    EXPECT_EQ(GetData(key, 1), BuildFieldValue(i, 1, 8));
+  }
+  // a partial update leaves the copy behind, the next full read renews it
+  auto key = BuildKey(10, tiny);
+  Value fieldValue = BuildFieldValue(5000, 1, 8);
+  Value before = GetData(key);
+  ASSERT_TRUE(PartialUpdateData(key, fieldValue, 1));
+  EXPECT_FALSE(HasInlineRow(key));
+  EXPECT_EQ(GetData(key, 1), fieldValue);
+  Value merged = GetData(key);
+  EXPECT_EQ(merged.substr(0, ROW_META_HEAD_SIZE + 8),
+            before.substr(0, ROW_META_HEAD_SIZE + 8));
+  EXPECT_EQ(merged.substr(ROW_META_HEAD_SIZE + 8), fieldValue);
+  EXPECT_TRUE(HasInlineRow(key));
+  EXPECT_EQ(GetData(key), merged);
+  // a full put replaces the copy right away
+  std::vector<Value> value{BuildFieldValue(10, 0, 8), BuildFieldValue(7, 1, 8)};
+  ASSERT_TRUE(PutData(key, value));
+  EXPECT_TRUE(HasInlineRow(key));
+  EXPECT_EQ(GetData(key, 1), BuildFieldValue(7, 1, 8));
+
+  key = BuildKey(20, tiny);
+  ASSERT_TRUE(RemoveData(key));
+  EXPECT_FALSE(HasInlineRow(key));
+  EXPECT_TRUE(GetData(key).empty());
+  std::vector<Key> keys{BuildKey(30, tiny), BuildKey(20, tiny)};
+  std::vector<Value> values;
+  EXPECT_FALSE(MultiGetData(keys, values));
+  EXPECT_EQ(values[0].substr(ROW_META_HEAD_SIZE),
+            BuildFieldValue(30, 0, 8) + BuildFieldValue(30, 1, 8));
+  EXPECT_TRUE(values[1].empty());
+}
+
+TEST_F(NeoPMKVTest, AccessTracking) {
+  uint32_t count = 200;
+  uint32_t seed = 6151;
+  for (auto tracking : {AccessTracking::SAMPLED, AccessTracking::COARSE}) {
+    TearDown();
+    SetUp();
+    SetNeoPMKV(true, false, false, false, false, IndexType::SKIPLIST,
+               tracking);
+    for (uint32_t i = 0; i < count; i++) PrepareData(i, seed);
+    // the first read promotes the row, the rest are hits
+    for (uint32_t round = 0; round < 3; round++) {
+      for (uint32_t i = 0; i < count; i++) {
+        EXPECT_EQ(GetData(i).substr(ROW_META_HEAD_SIZE),
+                  BuildFieldValue(i + seed, 0, 8) +
+                      BuildFieldValue(i + seed, 1, 16) +
+                      BuildFieldValue(i + seed, 2, 16));
+        EXPECT_TRUE(IsHot(i));
+      }
+    }
+    uint32_t recorded = 0;
+    uint64_t last = 0;
+    for (uint32_t i = 0; i < 1000; i++) {
+      TimeStamp ts = AccessStamp();
+      if (ts.txn_ticks != 0) recorded++;
+      // the shared clock only moves forwards
+      if (tracking == AccessTracking::COARSE) {
+        EXPECT_GE(ts.txn_ticks, last);
+        last = ts.txn_ticks;
+      }
+    }
+    if (tracking == AccessTracking::SAMPLED) {
+      EXPECT_GT(recorded, 0);
+      EXPECT_LT(recorded, 1000 / 4);
+    } else {
+      EXPECT_EQ(recorded, 1000);
+      // hits alone move the clock on
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      for (uint32_t i = 0; i < 1000; i++) AccessStamp();
+      EXPECT_GT(AccessStamp().txn_ticks, last);
+    }
+  }
+}
+
+TEST_F(NeoPMKVTest, ConcurrentEviction) {
+  SetNeoPMKV(true);
+  uint32_t count = 500;
+  uint32_t seed = 7013;
+  for (uint32_t i = 0; i < count; i++) PrepareData(i, seed);
+  std::atomic<uint32_t> running{3};
+  std::atomic<uint64_t> wrongValue{0};
+  std::vector<std::thread> readers;
+  for (uint32_t t = 0; t < 3; t++) {
+    readers.emplace_back([&] {
+      for (uint32_t pass = 0; pass < 20; pass++) {
+        // reads promote the rows again, into slots other keys just left
+        for (uint32_t i = 0; i < count; i++) {
+          Value value = GetData(i);
+          if (value.substr(ROW_META_HEAD_SIZE) !=
+              BuildFieldValue(i + seed, 0, 8) +
+                  BuildFieldValue(i + seed, 1, 16) +
+                  BuildFieldValue(i + seed, 2, 16))
+            wrongValue++;
+          if (PartialGetData(i, 1) != BuildFieldValue(i + seed, 1, 16))
+            wrongValue++;
+        }
+      }
+      running--;
+    });
+  }
+  uint32_t evicted = 0;
+  while (running.load() != 0) {
+    for (uint32_t i = 0; i < count; i++) evicted += EvictRow(i);
+  }
+  for (auto &reader : readers) reader.join();
+  // a row is only evicted while hot, so most were promoted again
+  EXPECT_GT(evicted, count * 2);
+  EXPECT_EQ(wrongValue.load(), 0);
+  for (uint32_t i = 0; i < count; i++) {
+    GetData(i);
+    EXPECT_TRUE(IsHot(i));
+  }
+}
+
+TEST_F(NeoPMKVTest, ConcurrentEvictionVarField) {
+  SetNeoPMKV(true);
+  SchemaId var = AddVarSchema("var");
+  uint32_t count = 200;
+  std::vector<Value> expected(count);
+  for (uint32_t i = 0; i < count; i++) {
+    Key key = BuildKey(i, var);
+    std::vector<Value> value{BuildFieldValue(i, 0, 8),
+                             BuildFieldValue(i, 0, 8),
+                             BuildFieldValue(i, 1, 24 + i % 40)};
+    ASSERT_TRUE(PutData(key, value));
+    // the row type in the meta differs between plog and PBRB copies
+    expected[i] = GetData(key).substr(ROW_META_HEAD_SIZE);
+    ASSERT_FALSE(expected[i].empty());
+  }
+  std::atomic<uint32_t> running{3};
+  std::atomic<uint64_t> wrongValue{0};
+  std::vector<std::thread> readers;
+  for (uint32_t t = 0; t < 3; t++) {
+    readers.emplace_back([&] {
+      for (uint32_t pass = 0; pass < 20; pass++) {
+        // the heap part of a row must outlive the readers of its copy
+        for (uint32_t i = 0; i < count; i++) {
+          Key key = BuildKey(i, var);
+          if (GetData(key).substr(ROW_META_HEAD_SIZE) != expected[i])
+            wrongValue++;
+        }
+      }
+      running--;
+    });
+  }
+  uint32_t evicted = 0;
+  while (running.load() != 0) {
+    for (uint32_t i = 0; i < count; i++) evicted += EvictRow(var, i);
+  }
+  for (auto &reader : readers) reader.join();
+  EXPECT_GT(evicted, count * 2);
+  EXPECT_EQ(wrongValue.load(), 0);
+}
+
+TEST_F(NeoPMKVTest, ConcurrentPartialUpdateEviction) {
+  SetNeoPMKV(true);
+  uint32_t count = 200;
+  uint32_t seed = 1303;
+  for (uint32_t i = 0; i < count; i++) PrepareData(i, seed);
+  std::atomic<bool> done{false};
+  std::atomic<uint64_t> wrongValue{0};
+  std::atomic<uint32_t> updateRound{0};
+  // field 1 of every key only moves through the rounds of the updater
+  std::thread updater([&] {
+    for (uint32_t round = 1; round <= 20; round++) {
+      for (uint32_t i = 0; i < count; i++) {
+        Value ev = BuildFieldValue(round, 1, 16);
+        PartialUpdateData(i, ev, 1);
+      }
+      updateRound.store(round);
+    }
+  });
+  std::vector<std::thread> readers;
+  for (uint32_t t = 0; t < 2; t++) {
+    readers.emplace_back([&] {
+      while (!done.load()) {
+        for (uint32_t i = 0; i < count; i++) {
+          uint32_t before = updateRound.load();
+          Value value = GetData(i);
+          uint32_t after = updateRound.load();
+          if (value.size() != ROW_META_HEAD_SIZE + 40 ||
+              value.substr(ROW_META_HEAD_SIZE, 8) !=
+                  BuildFieldValue(i + seed, 0, 8) ||
+              value.substr(ROW_META_HEAD_SIZE + 24) !=
+                  BuildFieldValue(i + seed, 2, 16)) {
+            wrongValue++;
+            continue;
+          }
+          Value field = value.substr(ROW_META_HEAD_SIZE + 8, 16);
+          bool seen = before == 0 && field == BuildFieldValue(i + seed, 1, 16);
+          for (uint32_t r = std::max(before, 1u); r <= after + 1; r++)
+            seen |= field == BuildFieldValue(r, 1, 16);
+          if (seen == false) wrongValue++;
+          if (PartialGetData(i, 2) != BuildFieldValue(i + seed, 2, 16))
+            wrongValue++;
+        }
+      }
+    });
+  }
+  uint32_t evicted = 0;
+  while (updateRound.load() < 20) {
+    for (uint32_t i = 0; i < count; i++) evicted += EvictRow(i);
+  }
+  updater.join();
+  done.store(true);
+  for (auto &reader : readers) reader.join();
+  EXPECT_GT(evicted, 0);
+  EXPECT_EQ(wrongValue.load(), 0);
+  for (uint32_t i = 0; i < count; i++) {
+    EXPECT_EQ(PartialGetData(i, 1), BuildFieldValue(20, 1, 16));
+    EXPECT_EQ(PartialGetData(i, 0), BuildFieldValue(i + seed, 0, 8));
+  }
+}
+
+TEST_F(NeoPMKVTest, ConcurrentPromotion) {
+  SetNeoPMKV(true);
+  uint32_t count = 4000;
+  uint32_t seed = 2711;
+  uint32_t threadNum = 4;
+  for (uint32_t i = 0; i < count; i++) PrepareData(i, seed);
+  std::atomic<uint32_t> running{threadNum};
+  std::atomic<uint64_t> wrongValue{0};
+  std::vector<std::thread> readers;
+  for (uint32_t t = 0; t < threadNum; t++) {
+    readers.emplace_back([&, t] {
+      // every reader fills the cache of the same schema with its own keys
+      for (uint32_t pass = 0; pass < 5; pass++) {
+        for (uint32_t i = t; i < count; i += threadNum) {
+          if (GetData(i).substr(ROW_META_HEAD_SIZE) !=
+              BuildFieldValue(i + seed, 0, 8) +
+                  BuildFieldValue(i + seed, 1, 16) +
+                  BuildFieldValue(i + seed, 2, 16))
+            wrongValue++;
+        }
+      }
+      running--;
+    });
+  }
+  // empties pages while they are filled
+  uint32_t evicted = 0;
+  while (running.load() != 0) {
+    for (uint32_t i = 0; i < count; i += 3) evicted += EvictRow(i);
+  }
+  for (auto &reader : readers) reader.join();
+  EXPECT_GT(evicted, 0);
+  EXPECT_EQ(wrongValue.load(), 0);
+  for (uint32_t i = 0; i < count; i++) {
+    GetData(i);
+    EXPECT_TRUE(IsHot(i));
+  }
+  // no page was lost or handed out twice
+  EXPECT_EQ(AccountedPages(), MaxPages());
+  EXPECT_EQ(FreePages(), MaxPages() - OpenTable()->bufferList->getPageNum());
+}
+
+TEST_F(NeoPMKVTest, FreePageCaches) {
+  SetNeoPMKV(true);
+  uint64_t freePages = FreePages();
+  ASSERT_EQ(freePages, MaxPages() - 1);
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < 4; t++) {
+    threads.emplace_back([&] {
+      // taken and given back through the cache of the current core
+      std::vector<BufferPage *> pages;
+      for (uint32_t round = 0; round < 100; round++) {
+        for (uint32_t i = 0; i < 50; i++) pages.push_back(PopFreePage());
+        for (auto pagePtr : pages) PushFreePage(pagePtr);
+        pages.clear();
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  EXPECT_EQ(FreePages(), freePages);
+  EXPECT_EQ(AccountedPages(), MaxPages());
+  // one core still gets every free page, cached on other cores or not
+  std::vector<BufferPage *> pages;
+  for (BufferPage *pagePtr = PopFreePage(); pagePtr != nullptr;
+       pagePtr = PopFreePage())
+    pages.push_back(pagePtr);
+  EXPECT_EQ(pages.size(), freePages);
+  EXPECT_EQ(FreePages(), 0);
+  std::sort(pages.begin(), pages.end());
+  EXPECT_EQ(std::unique(pages.begin(), pages.end()), pages.end());
+  for (auto pagePtr : pages) PushFreePage(pagePtr);
+  EXPECT_EQ(FreePages(), freePages);
+  EXPECT_EQ(AccountedPages(), MaxPages());
+}
+
+TEST_F(NeoPMKVTest, BufferPoolPartitions) {
+  SetNeoPMKV(true);
+  // hugepages of either kind start on a 2MB boundary
+  EXPECT_EQ(BufferPoolAddr() % (2ul << 20), 0);
+  // a core takes the pages of its own node while there are some
+  BufferPage *pagePtr = PopFreePage();
+  ASSERT_NE(pagePtr, nullptr);
+  EXPECT_EQ(NodeOfPage(pagePtr), LocalNode());
+  PushFreePage(pagePtr);
+  // spilled pages go back to the free list of their node
+  std::vector<BufferPage *> pages;
+  for (pagePtr = PopFreePage(); pagePtr != nullptr; pagePtr = PopFreePage())
+    pages.push_back(pagePtr);
+  for (auto page : pages) PushFreePage(page);
+  auto nodePages = NodeFreePages();
+  for (uint32_t node = 0; node < nodePages.size(); node++) {
+    for (auto page : nodePages[node]) {
+      EXPECT_EQ(NodeOfPage(page), node);
+      EXPECT_LT(((uintptr_t)page - BufferPoolAddr()) / sizeof(BufferPage),
+                MaxPages());
+    }
+  }
+  EXPECT_EQ(AccountedPages(), MaxPages());
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}
@@ -120,7 +120,7 @@ class PBRBTest : public testing::Test {
         sid == 1 ? BuildSchema1Value(key, seed) : BuildSchema2Value(key, seed);
     // std::cout << "insert data: " << data << std::endl;
     bool status =
-        _pbrbPtr->write(vPtr->getTimestamp(), ts_step, sid, data, iter);
+        _pbrbPtr->write(vPtr->getState(), ts_step, sid, data, iter);
 
     // std::cout << "status: " << status << std::endl;
     return status;
@@ -138,7 +138,7 @@ class PBRBTest : public testing::Test {
       return hotness;
     }
     _pbrbPtr->schemaHit(sid);
-    bool status = _pbrbPtr->read(vPtr->getTimestamp(), ts_step,
+    bool status = _pbrbPtr->read(vPtr->getState(), ts_step,
                                  vPtr->getPBRBAddr(), sid, readValue, vPtr);
     // std::cout << "get value: " << readValue << std::endl;
     // std::cout << "status:" << status << std::endl;
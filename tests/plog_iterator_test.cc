@@ -0,0 +1,150 @@
+//
+//  plog_iterator_test.cc
+//  PROJECT plog_iterator_test
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "plog_iterator.h"
+#include <cstdlib>
+#include <thread>
+#include "gtest/gtest.h"
+#include "neopmkv.h"
+#include "pmem_log.h"
+#include "schema.h"
+
+using namespace NKV;
+
+class PlogIteratorTest : public testing::Test {
+ public:
+  void SetUp() override {
+    if (std::filesystem::exists(testBaseDir)) {
+      std::filesystem::remove_all(testBaseDir);
+    }
+    PmemEngineConfig plogConfig;
+    plogConfig.chunk_size = 1ULL << 20;
+    plogConfig.engine_capacity = 256ULL << 20;
+    strcpy(plogConfig.engine_path, testBaseDir.c_str());
+    ASSERT_TRUE(PmemEngine::open(plogConfig, &engine_ptr).is2xxOK());
+  }
+  void TearDown() override {
+    delete engine_ptr;
+    std::filesystem::remove_all(testBaseDir);
+  }
+  std::string BuildRow(uint32_t size, char content) {
+    std::string row(size, content);
+    RowMetaPtr(row.data())
+        ->setMeta(size - ROW_META_HEAD_SIZE, RowType::FULL_DATA, 1, 0);
+    return row;
+  }
+
+ public:
+  PmemEngine *engine_ptr = nullptr;
+  std::string testBaseDir = "/mnt/pmem0/NKV-PLOG-ITER-TEST";
+};
+
+TEST_F(PlogIteratorTest, ReadAcrossChunks) {
+  // 3000 rows of ~1KB cross the 1MB chunks several times
+  uint32_t count = 3000;
+  for (uint32_t i = 0; i < count; i++) {
+    auto row = BuildRow(1000 + i % 7, 'a' + i % 26);
+    PmemAddress addr;
+    ASSERT_TRUE(
+        engine_ptr->appendWithKey(addr, 1, i, row.data(), row.size())
+            .is2xxOK());
+  }
+  PlogIterator iter(engine_ptr);
+  PlogRecord record;
+  for (uint32_t i = 0; i < count; i++) {
+    ASSERT_TRUE(iter.Next(record));
+    ASSERT_TRUE(record.hasKey);
+    EXPECT_EQ(record.primaryKey, i);
+    EXPECT_EQ(record.schemaId, 1);
+    EXPECT_EQ(record.type, RowType::FULL_DATA);
+    EXPECT_EQ(record.rowSize(), 1000 + i % 7);
+    EXPECT_EQ(record.rowData()[ROW_META_HEAD_SIZE], 'a' + i % 26);
+    // the row address is the one returned to the indexer
+    std::string value;
+    engine_ptr->read(record.rowAddr, value);
+    EXPECT_EQ(value.size(), record.rowSize());
+  }
+  EXPECT_FALSE(iter.Next(record));
+  EXPECT_EQ(iter.getPosition(), engine_ptr->getUsedSpace());
+}
+
+TEST_F(PlogIteratorTest, TailWhileWriting) {
+  uint32_t threadNum = 4;
+  uint32_t countPerThread = 5000;
+  std::vector<std::thread> writers;
+  for (uint32_t t = 0; t < threadNum; t++) {
+    writers.emplace_back([&, t]() {
+      for (uint32_t i = 0; i < countPerThread; i++) {
+        auto row = BuildRow(64 + (i % 5) * 40, 'x');
+        PmemAddress addr;
+        engine_ptr->appendWithKey(addr, 1, t * countPerThread + i, row.data(),
+                                  row.size());
+      }
+    });
+  }
+  std::vector<bool> seen(threadNum * countPerThread, false);
+  PlogIterator iter(engine_ptr);
+  PlogRecord record;
+  uint32_t found = 0;
+  while (found < threadNum * countPerThread) {
+    ASSERT_TRUE(iter.WaitNext(record, std::chrono::seconds(10)));
+    ASSERT_TRUE(record.hasKey);
+    ASSERT_LT(record.primaryKey, seen.size());
+    EXPECT_FALSE(seen[record.primaryKey]);
+    EXPECT_EQ(record.rowData()[record.rowSize() - 1], 'x');
+    seen[record.primaryKey] = true;
+    found++;
+  }
+  for (auto &w : writers) w.join();
+  EXPECT_FALSE(iter.Next(record));
+}
+
+TEST_F(PlogIteratorTest, NeoPMKVChangeStream) {
+  std::string db_path = "/mnt/pmem0/tmp-neopmkv-cdc-test";
+  std::filesystem::remove_all(db_path);
+  std::vector<SchemaField> fields{SchemaField(FieldType::INT64T, "pk"),
+                                  SchemaField(FieldType::STRING, "f1", 16),
+                                  SchemaField(FieldType::STRING, "f2", 16)};
+  auto kv = new NeoPMKV(db_path, 16ULL << 20, 256ULL << 20);
+  SchemaId sid = kv->CreateSchema(fields, 0, "cdc");
+  std::vector<Value> row{std::string(8, '1'), std::string(16, 'a'),
+                         std::string(16, 'b')};
+  Key key(sid, 7);
+  ASSERT_TRUE(kv->Put(key, row));
+  auto tail = kv->GetLogTail();
+  Value field(16, 'c');
+  ASSERT_TRUE(kv->PartialUpdate(key, field, 1));
+  ASSERT_TRUE(kv->Remove(key));
+
+  auto iter = kv->NewCDCIterator();
+  PlogRecord record;
+  ASSERT_TRUE(iter->Next(record));
+  EXPECT_EQ(record.type, RowType::FULL_DATA);
+  EXPECT_EQ(record.primaryKey, 7);
+  EXPECT_EQ(record.schemaId, sid);
+  EXPECT_EQ(iter->getPosition(), tail);
+  ASSERT_TRUE(iter->Next(record));
+  EXPECT_EQ(record.type, RowType::PARTIAL_FIELD);
+  EXPECT_EQ(record.primaryKey, 7);
+  ASSERT_TRUE(iter->Next(record));
+  EXPECT_EQ(record.type, RowType::TOMBSTONE);
+  EXPECT_EQ(record.primaryKey, 7);
+  EXPECT_FALSE(iter->Next(record));
+
+  // resume from the saved tail
+  auto resumed = kv->NewCDCIterator(tail);
+  ASSERT_TRUE(resumed->Next(record));
+  EXPECT_EQ(record.type, RowType::PARTIAL_FIELD);
+  delete kv;
+  std::filesystem::remove_all(db_path);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,114 @@
+//
+//  prefix_key_index_test.cc
+//  PROJECT prefix_key_index_test
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "gtest/gtest.h"
+#include "key_codec.h"
+#include "prefix_key_index.h"
+
+namespace NKV {
+
+class PrefixKeyIndexTest : public testing::Test {
+ public:
+  void SetUp() override {
+    std::vector<SchemaField> fields{SchemaField(FieldType::STRING, "user", 16),
+                                    SchemaField(FieldType::INT64T, "ts"),
+                                    SchemaField(FieldType::STRING, "body", 16)};
+    _schema = std::make_unique<Schema>("events", 0, 0, fields);
+    _schema->setKeyFields({0, 1});
+  }
+
+  static Value IntValue(int64_t v) {
+    return Value(reinterpret_cast<const char *>(&v), sizeof(v));
+  }
+
+  std::string Encode(const std::string &user, int64_t ts) {
+    return KeyCodec::encodeKey(_schema.get(), {user, IntValue(ts)});
+  }
+
+ protected:
+  std::unique_ptr<Schema> _schema;
+};
+
+TEST_F(PrefixKeyIndexTest, EncodingOrder) {
+  std::vector<int64_t> ints{INT64_MIN, -70000, -1, 0, 1, 255, 256, INT64_MAX};
+  for (size_t i = 1; i < ints.size(); i++) {
+    EXPECT_LT(Encode("a", ints[i - 1]), Encode("a", ints[i]));
+  }
+  // the first field decides before the second
+  EXPECT_LT(Encode("a", INT64_MAX), Encode("b", INT64_MIN));
+  // a string sorts before the longer ones it prefixes
+  EXPECT_LT(Encode("ab", INT64_MAX), Encode("abc", INT64_MIN));
+  EXPECT_LT(Encode("ab", INT64_MAX), Encode("ab\x01", INT64_MIN));
+  // zero padding of a fixed string is not part of it
+  EXPECT_EQ(Encode("ab", 5), Encode(std::string("ab\0\0", 4), 5));
+  // a tuple prefix sorts right before the tuples that have it
+  std::string prefix = KeyCodec::encodeKey(_schema.get(), {"ab"});
+  EXPECT_LT(prefix, Encode("ab", INT64_MIN));
+  EXPECT_GT(prefix, Encode("aa", INT64_MAX));
+  EXPECT_EQ(Encode("ab", 3).compare(0, prefix.size(), prefix), 0);
+}
+
+TEST_F(PrefixKeyIndexTest, InsertFindScan) {
+  PrefixKeyIndex index;
+  std::vector<std::pair<std::string, uint64_t>> keys;
+  for (int64_t user = 0; user < 50; user++) {
+    for (int64_t ts = -20; ts < 20; ts++) {
+      keys.emplace_back(Encode("user" + std::to_string(user), ts),
+                        keys.size() + 1);
+    }
+  }
+  auto shuffled = keys;
+  std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937_64(2026));
+  for (auto &[key, id] : shuffled) {
+    EXPECT_TRUE(index.insert(key, id).second);
+  }
+  EXPECT_EQ(index.size(), keys.size());
+  // a second insert keeps the first id
+  auto [id, inserted] = index.insert(keys[7].first, 99999);
+  EXPECT_FALSE(inserted);
+  EXPECT_EQ(id, keys[7].second);
+
+  std::sort(keys.begin(), keys.end());
+  for (auto &[key, expect] : keys) {
+    uint64_t found = 0;
+    ASSERT_TRUE(index.find(key, found));
+    EXPECT_EQ(found, expect);
+  }
+  uint64_t found;
+  EXPECT_FALSE(index.find(Encode("user1", 100), found));
+  EXPECT_FALSE(index.find("", found));
+
+  // a full walk comes back in key order across blocks
+  std::vector<PrefixKeyIndex::Entry> entries;
+  index.scan("", false, UINT32_MAX, entries);
+  EXPECT_EQ(entries, keys);
+  // a prefix starts at its first tuple
+  entries.clear();
+  index.scan(KeyCodec::encodeKey(_schema.get(), {"user12"}), true, 5, entries);
+  ASSERT_EQ(entries.size(), 5);
+  EXPECT_EQ(entries[0].first, Encode("user12", -20));
+  EXPECT_EQ(entries[4].first, Encode("user12", -16));
+  entries.clear();
+  index.scan(Encode("user12", -16), true, 1, entries);
+  EXPECT_EQ(entries[0].first, Encode("user12", -15));
+
+  // the shared prefixes are stored once per run of keys
+  size_t rawBytes = 0;
+  for (auto &[key, _] : keys) rawBytes += key.size() + sizeof(uint64_t);
+  EXPECT_LT(index.memoryUsage(), rawBytes);
+}
+
+}  // namespace NKV
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,154 @@
+//
+//  replication_test.cc
+//  PROJECT replication_test
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include "replication.h"
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdlib>
+#include "gtest/gtest.h"
+#include "neopmkv.h"
+#include "schema.h"
+
+using namespace NKV;
+
+class ReplicationTest : public testing::Test {
+ public:
+  void SetUp() override {
+    std::filesystem::remove_all(primary_path);
+    std::filesystem::remove_all(follower_path);
+  }
+  void TearDown() override {
+    std::filesystem::remove_all(primary_path);
+    std::filesystem::remove_all(follower_path);
+  }
+
+  NeoPMKV *OpenKV(std::string path, SchemaId &sid) {
+    auto kv = new NeoPMKV(path, chunk_size, db_size);
+    sid = kv->CreateSchema(fields, 0, "replication");
+    return kv;
+  }
+
+  std::vector<Value> BuildValue(uint32_t i, uint32_t seed) {
+    std::vector<Value> value;
+    std::string num = std::to_string(i + seed);
+    value.push_back(std::string(8 - num.size(), '0') + num);
+    value.push_back(std::string(16 - num.size(), '1') + num);
+    value.push_back(std::string(16 - num.size(), '2') + num);
+    return value;
+  }
+
+  // the expected content of key i after RunPrimary
+  bool ExpectedValue(uint32_t i, Value &value) {
+    if (i % 10 == 0) return false;
+    auto fields = BuildValue(i, i % 3 == 0 ? 200 : 100);
+    if (i % 4 == 0) fields[1] = std::string(16, 'u');
+    value = fields[0] + fields[1] + fields[2];
+    return true;
+  }
+
+  // puts, overwrites, partial updates and removes on the primary
+  void RunPrimary(NeoPMKV *kv, SchemaId sid) {
+    for (uint32_t i = 0; i < count; i++) {
+      auto value = BuildValue(i, 100);
+      Key key(sid, i);
+      kv->Put(key, value);
+    }
+    for (uint32_t i = 0; i < count; i += 3) {
+      auto value = BuildValue(i, 200);
+      Key key(sid, i);
+      kv->Put(key, value);
+    }
+    Value update(16, 'u');
+    for (uint32_t i = 0; i < count; i += 4) {
+      Key key(sid, i);
+      kv->PartialUpdate(key, update, 1);
+    }
+    for (uint32_t i = 0; i < count; i += 10) {
+      Key key(sid, i);
+      kv->Remove(key);
+    }
+  }
+
+  // follower process: apply the stream, then check every key
+  int RunFollower(ReplicationReceiver &receiver) {
+    SchemaId sid;
+    NeoPMKV *kv = OpenKV(follower_path, sid);
+    if (!receiver.serve(kv)) return 2;
+    int res = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      Key key(sid, i);
+      Value expected, value;
+      bool found = kv->Get(key, value);
+      if (found != ExpectedValue(i, expected)) res = 3;
+      // Get returns the full row with its meta head
+      if (found && value.substr(ROW_META_HEAD_SIZE) != expected) res = 4;
+    }
+    delete kv;
+    return res;
+  }
+
+  void ReplicateTo(std::string endpoint) {
+    ReplicationReceiver receiver(endpoint);
+    ASSERT_TRUE(receiver.listen());
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+      _exit(RunFollower(receiver));
+    }
+    SchemaId sid;
+    NeoPMKV *kv = OpenKV(primary_path, sid);
+    auto sender = kv->NewReplicationSender(receiver.getEndpoint());
+    ASSERT_TRUE(sender->connect());
+    // ship while writing, then drain the rest
+    sender->start();
+    RunPrimary(kv, sid);
+    PmemAddress tail = kv->GetLogTail();
+    EXPECT_TRUE(sender->waitForAck(tail, std::chrono::seconds(10)));
+    EXPECT_EQ(sender->getAckedOffset(), tail);
+    sender->stop();
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    delete kv;
+  }
+
+ public:
+  std::string primary_path = "/mnt/pmem0/tmp-neopmkv-primary";
+  std::string follower_path = "/mnt/pmem0/tmp-neopmkv-follower";
+  std::vector<SchemaField> fields{SchemaField(FieldType::INT64T, "pk"),
+                                  SchemaField(FieldType::STRING, "f1", 16),
+                                  SchemaField(FieldType::STRING, "f2", 16)};
+  // small chunks, so batches cross several chunk boundaries
+  const uint64_t chunk_size = 1ULL << 20;
+  const uint64_t db_size = 256ULL << 20;
+  uint32_t count = 40000;
+};
+
+TEST_F(ReplicationTest, UnixSocketFollower) {
+  ReplicateTo("unix:/tmp/neopmkv-replication-test.sock");
+}
+
+TEST_F(ReplicationTest, TcpLoopbackFollower) { ReplicateTo("tcp:127.0.0.1:0"); }
+
+TEST_F(ReplicationTest, RejectRangeBehindTail) {
+  SchemaId sid;
+  NeoPMKV *kv = OpenKV(follower_path, sid);
+  std::string zeros(64, '\0');
+  EXPECT_FALSE(kv->ApplyReplicatedRange(0, zeros.data(), 0));
+  EXPECT_TRUE(kv->ApplyReplicatedRange(0, zeros.data(), zeros.size()));
+  EXPECT_FALSE(kv->ApplyReplicatedRange(0, zeros.data(), zeros.size()));
+  // a range must not straddle two chunks
+  EXPECT_FALSE(kv->ApplyReplicatedRange(chunk_size - 8, zeros.data(), 64));
+  delete kv;
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
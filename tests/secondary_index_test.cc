@@ -0,0 +1,81 @@
+//
+//  secondary_index_test.cc
+//  PROJECT secondary_index_test
+//
+//  Created by zhenliu on 18/10/2026.
+//  Copyright (c) 2022 zhenliu <liuzhenm@mail.ustc.edu.cn>.
+//
+
+#include <vector>
+#include "gtest/gtest.h"
+#include "secondary_index.h"
+
+namespace NKV {
+
+class SecondaryIndexTest : public testing::Test {
+ public:
+  void SetUp() override {
+    std::vector<SchemaField> fields{SchemaField(FieldType::INT64T, "pk"),
+                                    SchemaField(FieldType::INT32T, "age"),
+                                    SchemaField(FieldType::STRING, "name", 8)};
+    _schema = std::make_unique<Schema>("people", 0, 0, fields);
+  }
+
+  static Value IntValue(int32_t v) {
+    return Value(reinterpret_cast<const char *>(&v), sizeof(v));
+  }
+
+ protected:
+  std::unique_ptr<Schema> _schema;
+};
+
+TEST_F(SecondaryIndexTest, Indexable) {
+  EXPECT_TRUE(SecondaryIndex::isIndexable(FieldType::INT16T));
+  EXPECT_TRUE(SecondaryIndex::isIndexable(FieldType::STRING));
+  EXPECT_FALSE(SecondaryIndex::isIndexable(FieldType::VARSTR));
+  EXPECT_FALSE(SecondaryIndex::isIndexable(FieldType::DOUBLE));
+}
+
+TEST_F(SecondaryIndexTest, IntegerOrder) {
+  SecondaryIndex index(_schema.get(), 1);
+  std::vector<int32_t> ages{-70000, -3, -1, 0, 1, 2, 255, 256, 70000};
+  for (uint32_t i = 1; i < ages.size(); i++) {
+    EXPECT_LT(index.encode(IntValue(ages[i - 1])),
+              index.encode(IntValue(ages[i])));
+  }
+  for (uint32_t i = 0; i < ages.size(); i++) {
+    index.insert(IntValue(ages[ages.size() - 1 - i]), i);
+  }
+  std::vector<uint64_t> keys;
+  index.lookup(IntValue(-3), IntValue(255), keys);
+  EXPECT_EQ(keys, std::vector<uint64_t>({7, 6, 5, 4, 3, 2}));
+  keys.clear();
+  index.lookup(IntValue(-100000), IntValue(100000), keys, 3);
+  EXPECT_EQ(keys, std::vector<uint64_t>({8, 7, 6}));
+}
+
+TEST_F(SecondaryIndexTest, DuplicatesAndErase) {
+  SecondaryIndex index(_schema.get(), 2);
+  // values are padded to the field size like in the row
+  index.insert("bob", 3);
+  index.insert(Value("bob\0\0\0\0\0", 8), 1);
+  index.insert("alice", 2);
+  index.insert("carol", 4);
+  EXPECT_EQ(index.size(), 4);
+  std::vector<uint64_t> keys;
+  index.lookup("bob", "bob", keys);
+  EXPECT_EQ(keys, std::vector<uint64_t>({1, 3}));
+  index.erase("bob", 1);
+  index.erase("dave", 1);
+  keys.clear();
+  index.lookup("a", "c", keys);
+  EXPECT_EQ(keys, std::vector<uint64_t>({2, 3}));
+  EXPECT_EQ(index.size(), 3);
+}
+
+}  // namespace NKV
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}